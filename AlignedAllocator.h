@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <malloc.h>
+
+#define CACHE_LINE_SIZE		64
+
+/*
+ std::vector allocator that starts every array on a cache line
+ so a SIMD load from the start of an array never splits a line and two arrays never share one
+*/
+
+template<class T, size_t Alignment = CACHE_LINE_SIZE>
+class AlignedAllocator
+{
+public:
+	typedef T							value_type;
+
+	template<class U>
+	struct rebind { typedef AlignedAllocator<U, Alignment> other; };
+
+	AlignedAllocator() {}
+	template<class U>
+	AlignedAllocator(const AlignedAllocator<U, Alignment>&) {}
+
+	T*									allocate(size_t count)
+	{
+		void* p = _aligned_malloc(count * sizeof(T), Alignment);
+		if (p == nullptr)
+			throw std::bad_alloc();
+		return (T*)p;
+	}
+
+	void								deallocate(T* p, size_t) { _aligned_free(p); }
+
+	template<class U>
+	bool								operator==(const AlignedAllocator<U, Alignment>&) const { return true; }
+	template<class U>
+	bool								operator!=(const AlignedAllocator<U, Alignment>&) const { return false; }
+};
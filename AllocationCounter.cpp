@@ -0,0 +1,85 @@
+#include "AllocationCounter.h"
+
+#ifdef ALLOCATION_COUNTER
+
+#include <atomic>
+#include <new>
+#include <cstdlib>
+
+static std::atomic<unsigned long long> allocations(0);
+static unsigned long long frameStart = 0;
+
+unsigned long long AllocationCounter::GetCount()
+{
+	return allocations.load(std::memory_order_relaxed);
+}
+
+unsigned long long AllocationCounter::EndFrame()
+{
+	unsigned long long count = GetCount();
+	unsigned long long frame = count - frameStart;
+	frameStart = count;
+	return frame;
+}
+
+static void* CountedAllocate(size_t bytes)
+{
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	// malloc(0) may return nullptr, new never does
+	return malloc(bytes != 0 ? bytes : 1);
+}
+
+void* operator new(size_t bytes)
+{
+	void* p = CountedAllocate(bytes);
+	if (p == nullptr)
+		throw std::bad_alloc();
+	return p;
+}
+
+void* operator new[](size_t bytes)
+{
+	return operator new(bytes);
+}
+
+void* operator new(size_t bytes, const std::nothrow_t&) noexcept
+{
+	return CountedAllocate(bytes);
+}
+
+void* operator new[](size_t bytes, const std::nothrow_t&) noexcept
+{
+	return CountedAllocate(bytes);
+}
+
+void operator delete(void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept
+{
+	free(p);
+}
+
+void operator delete(void* p, const std::nothrow_t&) noexcept
+{
+	free(p);
+}
+
+void operator delete[](void* p, const std::nothrow_t&) noexcept
+{
+	free(p);
+}
+
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+
+#define ZERO_ALLOCATION_WARMUP	300 // frames for the arena, grids and neighbour caches to reach their working size
+
+// only debug builds count, unless ALLOCATION_COUNTER is defined (e.g. to run the allocation benchmark in release)
+#if defined(_DEBUG) && !defined(ALLOCATION_COUNTER)
+#define ALLOCATION_COUNTER
+#endif
+
+/*
+ counts every call to operator new in the program (the global one is replaced in AllocationCounter.cpp)
+ so a frame can be checked for touching the heap, main asserts in debug builds that a settled frame makes none
+ memory from _aligned_malloc, VirtualAlloc and the d3d runtime isn't counted
+ without ALLOCATION_COUNTER operator new is left alone, so other builds don't pay for the count on every allocation
+*/
+
+#ifdef ALLOCATION_COUNTER
+class AllocationCounter
+{
+public:
+	// allocations since the program started
+	static unsigned long long			GetCount();
+	// allocations since the last call
+	static unsigned long long			EndFrame();
+};
+#endif
@@ -0,0 +1,1849 @@
+#include "Benchmark.h"
+#include "Debug.h"
+#include "NeighbourList.h"
+#include "MortonOrder.h"
+#include "QuadTree.h"
+#include "CellAggregates.h"
+#include "QuantisedPopulation.h"
+#include "SteeringPipeline.h"
+#include "LargePages.h"
+#include "EntityPool.h"
+#include "FrameArena.h"
+#include "AllocationCounter.h"
+#include "JobSystem.h"
+#include "SimulationThread.h"
+
+#include <chrono>
+#include <thread>
+
+#define BENCHMARK_TIMESTEP		(1.0f / 60.0f)
+#define BENCHMARK_SPACING		20.0f	// average distance between boids, gives ~20 neighbours inside NEARBY_DISTANCE
+#define BRUTE_FORCE_SAMPLE		2000	// the brute force path is only timed over this many boids and scaled up
+#define BENCHMARK_FRAMES		120		// frames to run for benchmarks that keep state between frames
+#define DENSITY_FRAMES			10		// kept short so the flock doesn't have time to spread out
+#define AGGREGATE_FRAMES		5		// a million boids in exact mode takes a while
+#define AGGREGATE_ERROR_SAMPLE	10000	// boids in the flock used to measure the cell aggregate error
+#define AGGREGATE_WARMUP_FRAMES	30		// a random start has no local alignment, let the flock form first
+#define CONE_EDGE_TOLERANCE		0.01	// degrees, closer than this to the edge of the cone either answer is fine
+#define FOOTPRINT_PREDATORS		10		// enough for some boids to flee and die
+#define STEERING_REPEATS		10		// kernel passes timed over the same flock
+#define QUANTISED_BIG_FRAMES	3		// ten million boids at a few a second
+#define PIPELINE_PREDATORS		10		// so the flee rule has something to do
+#define CHURN_SECONDS			5		// of simulated time at BENCHMARK_TIMESTEP
+#define ALLOCATION_FRAMES		600		// checked after ZERO_ALLOCATION_WARMUP, so several morton sorts are included
+#define ORDER_THREADS			4		// the double buffered update split between this many threads, however many cores there are
+#define CLUSTER_FRACTION		4		// one boid in this many is packed into the middle of the flock
+#define CLUSTER_SCALE			0.5f	// at 4x the density, so they each have about 4x the neighbours
+#define CONTENTION_FRAMES		60
+#define CONTENTION_AREA			0.25f	// of the flock's width, the predators all start in the middle of it
+#define PIPELINE_SECONDS		3.0
+#define PIPELINE_DISPLAY_HZ		144.0	// the render loop waits for this like Present waits for vsync
+#define MASS_DEATH_SAMPLE		1000	// erasing every death from a million boids one at a time takes minutes, so this many are timed and scaled up
+#define MASS_DEATH_GRID_SAMPLE	10		// and the grid rebuild that went with each one
+
+void Benchmark::Run()
+{
+	Debug::Print("---- benchmark ----");
+	Debug::Print(string("simd kernels: ") + CpuFeatures::Name(CpuFeatures::Level()));
+
+	SpatialGridVsBruteForce(300);
+	SpatialGridVsBruteForce(10000);
+	SpatialGridVsBruteForce(100000);
+
+	// skin 0 is the plain grid every frame
+	NeighbourListSkin(10000, 0.0f);
+	NeighbourListSkin(10000, 5.0f);
+	NeighbourListSkin(10000, 10.0f);
+	NeighbourListSkin(10000, 20.0f);
+	NeighbourListSkin(10000, 40.0f);
+
+	// cache miss rates need a profiler (VTune / WPA) attached to these runs
+	MortonReorder(100000, false, false);
+	MortonReorder(100000, true, false);
+	MortonReorder(100000, true, true);
+
+	FusedSteering(10000);
+	RulePipelines(10000);
+	RulePipelines(100000);
+
+	// the same number of boids packed closer and closer together
+	TopologicalDensity(10000, 40.0f);
+	TopologicalDensity(10000, 20.0f);
+	TopologicalDensity(10000, 10.0f);
+	TopologicalDensity(10000, 5.0f);
+	TopologicalDensity(10000, 2.5f);
+
+	// more boids and more predators, then the opening angle
+	BarnesHut(10000, 1, BARNES_HUT_THETA_DEFAULT);
+	BarnesHut(10000, 16, BARNES_HUT_THETA_DEFAULT);
+	BarnesHut(10000, 256, BARNES_HUT_THETA_DEFAULT);
+	BarnesHut(100000, 1, BARNES_HUT_THETA_DEFAULT);
+	BarnesHut(100000, 16, BARNES_HUT_THETA_DEFAULT);
+	BarnesHut(100000, 256, BARNES_HUT_THETA_DEFAULT);
+	BarnesHut(100000, 64, 0.25f);
+	BarnesHut(100000, 64, 1.0f);
+
+	CellAggregateFlocking(100000, BENCHMARK_SPACING);
+	CellAggregateFlocking(100000, 5.0f);
+	CellAggregateFlocking(1000000, BENCHMARK_SPACING);
+
+	PredatorIndex(10000, 1);
+	PredatorIndex(10000, 100);
+	PredatorIndex(10000, 1000);
+	PredatorIndex(10000, 5000);
+
+	PerceptionConeAgreement(1000000);
+
+	PopulationFootprint(10000);
+	PopulationFootprint(100000);
+
+	SteeringKernelThroughput(10000);
+	SteeringKernelThroughput(100000);
+
+	DimensionSpecialisation(10000);
+	DimensionSpecialisation(100000);
+
+	// drift needs a long run, the bandwidth only shows with a lot of boids
+	QuantisedStorage(10000, 10000);
+	QuantisedStorage(1000000, DENSITY_FRAMES);
+	QuantisedStorage(10000000, QUANTISED_BIG_FRAMES);
+
+	// dtlb miss counts need a profiler (VTune / WPA) attached to these runs
+	LargePageArrays(1000000, DENSITY_FRAMES);
+	LargePageArrays(10000000, QUANTISED_BIG_FRAMES);
+
+	EntityChurn(10000, 10000);
+
+	FrameAllocations(300, true);
+	FrameAllocations(10000, true);
+	FrameAllocations(10000, false);
+
+	DoubleBufferedOrder(10000);
+
+	// 1 thread up to one per core
+	ThreadScaling(10000, BENCHMARK_FRAMES);
+	ThreadScaling(100000, DENSITY_FRAMES);
+	ThreadScaling(1000000, AGGREGATE_FRAMES);
+
+	// more predators than there are boids near them, so they keep going for the same ones
+	PredatorContention(10000, 100);
+	PredatorContention(10000, 1000);
+	PredatorContention(10000, 4000);
+
+	// a step that fits in a display frame, then one that doesn't
+	PipelinedFrames(1000);
+	PipelinedFrames(10000);
+
+	MassDeath(1000000, 10);
+
+	Debug::Print("---- benchmark done ----");
+}
+
+void Benchmark::SpatialGridVsBruteForce(unsigned int boidCount)
+{
+	vector<Predator*> predators;
+
+	// same seed for both so they start from the same flock
+	srand(1);
+	vecBoid bruteBoids = CreateBoids(boidCount, BENCHMARK_SPACING);
+	srand(1);
+	vecBoid gridBoids = CreateBoids(boidCount, BENCHMARK_SPACING);
+
+	// brute force - every boid checks every other boid
+	unsigned int sample = min(boidCount, (unsigned int)BRUTE_FORCE_SAMPLE);
+	double start = Now();
+	for (unsigned int i = 0; i < sample; i++)
+	{
+		bruteBoids[i]->Update(BENCHMARK_TIMESTEP, &bruteBoids, nullptr, &predators, nullptr);
+	}
+	double bruteTime = (Now() - start) * boidCount / sample;
+
+	// spatial grid - rebuild once then every boid only checks the cells around it
+	SpatialGrid grid(NEARBY_DISTANCE);
+	start = Now();
+	grid.Build(gridBoids);
+	double buildTime = Now() - start;
+	for (Boid* b : gridBoids)
+	{
+		b->Update(BENCHMARK_TIMESTEP, &gridBoids, &grid, &predators, nullptr);
+	}
+	double gridTime = Now() - start;
+
+	char sz[1024] = { 0 };
+	sprintf_s(sz, "spatial grid, %u boids: brute force %.2f ms/frame%s, grid %.2f ms/frame (build %.2f ms), %.1fx faster",
+		boidCount, bruteTime * 1000.0, sample < boidCount ? " (sampled)" : "", gridTime * 1000.0, buildTime * 1000.0, bruteTime / gridTime);
+	Debug::Print(string(sz));
+
+	DeleteBoids(bruteBoids);
+	DeleteBoids(gridBoids);
+}
+
+void Benchmark::NeighbourListSkin(unsigned int boidCount, float skin)
+{
+	vector<Predator*> predators;
+
+	srand(1);
+	vecBoid boids = CreateBoids(boidCount, BENCHMARK_SPACING);
+
+	SpatialGrid grid(NEARBY_DISTANCE);
+	NeighbourList neighbourList(NEARBY_DISTANCE, skin);
+
+	double start = Now();
+	for (unsigned int frame = 0; frame < BENCHMARK_FRAMES; frame++)
+	{
+		grid.Build(boids);
+		if (skin > 0.0f)
+			neighbourList.Update(BENCHMARK_TIMESTEP, &boids, &grid);
+
+		for (Boid* b : boids)
+		{
+			b->Update(BENCHMARK_TIMESTEP, &boids, &grid, &predators, nullptr);
+		}
+	}
+	double frameTime = (Now() - start) / BENCHMARK_FRAMES;
+
+	char sz[1024] = { 0 };
+	sprintf_s(sz, "neighbour lists, %u boids, skin %.1f: %.2f ms/frame, rebuilt %u times in %u frames",
+		boidCount, skin, frameTime * 1000.0, neighbourList.GetRebuildCount(), BENCHMARK_FRAMES);
+	Debug::Print(string(sz));
+
+	DeleteBoids(boids);
+}
+
+void Benchmark::MortonReorder(unsigned int boidCount, bool sorted, bool pooled)
+{
+	vector<Predator*> predators;
+
+	// spawn order is random so without sorting neighbours are spread through the list (and through the pool)
+	srand(1);
+	EntityPool<Boid> pool;
+	vecBoid boids;
+	if (pooled)
+	{
+		float size = sqrtf((float)boidCount) * BENCHMARK_SPACING;
+		pool.Create(boidCount);
+		for (unsigned int i = 0; i < boidCount; i++)
+		{
+			Boid* b = pool.Spawn();
+			b->setPosition(XMFLOAT3(((float)rand() / (float)RAND_MAX) * size - (size * 0.5f), ((float)rand() / (float)RAND_MAX) * size - (size * 0.5f), 0));
+			boids.push_back(b);
+		}
+	}
+	else
+	{
+		boids = CreateBoids(boidCount, BENCHMARK_SPACING);
+	}
+
+	SpatialGrid grid(NEARBY_DISTANCE);
+	double sortTime = 0.0;
+
+	double start = Now();
+	for (unsigned int frame = 0; frame < BENCHMARK_FRAMES; frame++)
+	{
+		if (sorted && frame % MORTON_SORT_INTERVAL == 0)
+		{
+			double sortStart = Now();
+			MortonOrder::SortBoids(boids, pooled ? &pool : nullptr);
+			sortTime += Now() - sortStart;
+		}
+
+		grid.Build(boids);
+		for (Boid* b : boids)
+		{
+			b->Update(BENCHMARK_TIMESTEP, &boids, &grid, &predators, nullptr);
+		}
+	}
+	double frameTime = (Now() - start) / BENCHMARK_FRAMES;
+
+	// the list and the pool should now be in the same order
+	unsigned int inPlace = 0;
+	for (unsigned int i = 0; i < boidCount && pooled; i++)
+	{
+		if (boids[i] == boids[0] + i)
+			inPlace++;
+	}
+
+	char sz[1024] = { 0 };
+	sprintf_s(sz, "morton order, %u boids, %s: %.2f ms/frame (sorting %.2f ms every %d frames)%s",
+		boidCount, !sorted ? "spawn order" : pooled ? "sorted list and pool" : "sorted list", frameTime * 1000.0,
+		sortTime * 1000.0 * MORTON_SORT_INTERVAL / BENCHMARK_FRAMES, MORTON_SORT_INTERVAL,
+		pooled && sorted ? (inPlace == boidCount ? ", every boid in its list slot" : ", BOIDS OUT OF PLACE") : "");
+	Debug::Print(string(sz));
+
+	if (!pooled)
+		DeleteBoids(boids);
+}
+
+void Benchmark::FusedSteering(unsigned int boidCount)
+{
+	vector<Predator*> predators;
+
+	srand(1);
+	vecBoid separateBoids = CreateBoids(boidCount, BENCHMARK_SPACING);
+	srand(1);
+	vecBoid fusedBoids = CreateBoids(boidCount, BENCHMARK_SPACING);
+
+	SpatialGrid separateGrid(NEARBY_DISTANCE);
+	SpatialGrid fusedGrid(NEARBY_DISTANCE);
+
+	// step both flocks once and compare where every boid ended up heading
+	separateGrid.Build(separateBoids);
+	fusedGrid.Build(fusedBoids);
+	Boid::SetFusedSteering(false);
+	for (Boid* b : separateBoids)
+		b->Update(BENCHMARK_TIMESTEP, &separateBoids, &separateGrid, &predators, nullptr);
+	Boid::SetFusedSteering(true);
+	for (Boid* b : fusedBoids)
+		b->Update(BENCHMARK_TIMESTEP, &fusedBoids, &fusedGrid, &predators, nullptr);
+
+	float maxError = 0.0f;
+	unsigned int outside = 0;
+	for (unsigned int i = 0; i < boidCount; i++)
+	{
+		XMFLOAT3 a = *separateBoids[i]->GetDirection();
+		XMFLOAT3 b = *fusedBoids[i]->GetDirection();
+		float error = max(fabsf(a.x - b.x), max(fabsf(a.y - b.y), fabsf(a.z - b.z)));
+		maxError = max(maxError, error);
+		if (error > FUSED_STEERING_TOLERANCE)
+			outside++;
+	}
+
+	// then time a run of frames each way
+	double times[2];
+	for (int fused = 0; fused < 2; fused++)
+	{
+		vecBoid& boids = fused ? fusedBoids : separateBoids;
+		SpatialGrid& grid = fused ? fusedGrid : separateGrid;
+		Boid::SetFusedSteering(fused != 0);
+
+		double start = Now();
+		for (unsigned int frame = 0; frame < BENCHMARK_FRAMES; frame++)
+		{
+			grid.Build(boids);
+			for (Boid* b : boids)
+				b->Update(BENCHMARK_TIMESTEP, &boids, &grid, &predators, nullptr);
+		}
+		times[fused] = (Now() - start) / BENCHMARK_FRAMES;
+	}
+	Boid::SetFusedSteering(true);
+
+	char sz[1024] = { 0 };
+	sprintf_s(sz, "fused steering, %u boids: separate %.2f ms/frame, fused %.2f ms/frame, max direction error %g (%u over tolerance %g)",
+		boidCount, times[0] * 1000.0, times[1] * 1000.0, maxError, outside, FUSED_STEERING_TOLERANCE);
+	Debug::Print(string(sz));
+
+	DeleteBoids(separateBoids);
+	DeleteBoids(fusedBoids);
+}
+
+void Benchmark::RulePipelines(unsigned int boidCount)
+{
+	const char* names[4] = { "Boid::Update", "compile time, trait weights", "compile time, fixed weights", "runtime" };
+	float size = sqrtf((float)boidCount) * BENCHMARK_SPACING;
+
+	// the default scales, which every boid has, known when the program is built
+	typedef SteeringPipeline<Separation<FixedWeight<3, 2>>, Alignment<FixedWeight<1>>, Cohesion<FixedWeight<1>>, Flee<FixedWeight<10>>> FixedPipeline;
+	RuntimeSteeringPipeline runtime;
+	runtime.Add<Separation<>>(SEPARATIONSCALE_DEFAULT);
+	runtime.Add<Alignment<>>(ALIGNMENTSCALE_DEFAULT);
+	runtime.Add<Cohesion<>>(COHESIONSCALE_DEFAULT);
+	runtime.Add<Flee<>>(FLEESCALE_DEFAULT);
+
+	srand(1);
+	vector<Predator*> predators = CreatePredators(PIPELINE_PREDATORS, size);
+	SpatialGrid predatorGrid(FLEE_DISTANCE_MAX);
+	predatorGrid.Build(predators);
+
+	// the same flock stepped each way, every way should give the same boids in the same places
+	vecBoid flocks[4];
+	double times[4];
+	for (int way = 0; way < 4; way++)
+	{
+		srand(2);
+		flocks[way] = CreateBoids(boidCount, BENCHMARK_SPACING);
+		vecBoid& boids = flocks[way];
+		SpatialGrid grid(NEARBY_DISTANCE);
+
+		double start = Now();
+		for (unsigned int frame = 0; frame < DENSITY_FRAMES; frame++)
+		{
+			grid.Build(boids);
+			for (Boid* b : boids)
+			{
+				if (way == 0)
+					b->Update(BENCHMARK_TIMESTEP, &boids, &grid, &predators, &predatorGrid);
+				else if (way == 1)
+					FlockPipeline::Update(*b, BENCHMARK_TIMESTEP, &boids, &grid, &predators, &predatorGrid);
+				else if (way == 2)
+					FixedPipeline::Update(*b, BENCHMARK_TIMESTEP, &boids, &grid, &predators, &predatorGrid);
+				else
+					runtime.Update(*b, BENCHMARK_TIMESTEP, &boids, &grid, &predators, &predatorGrid);
+			}
+		}
+		times[way] = (Now() - start) / DENSITY_FRAMES;
+	}
+
+	for (int way = 1; way < 4; way++)
+	{
+		float maxError = 0.0f;
+		unsigned int different = 0;
+		for (unsigned int i = 0; i < boidCount; i++)
+		{
+			XMFLOAT3 a = *flocks[0][i]->getPosition();
+			XMFLOAT3 b = *flocks[way][i]->getPosition();
+			maxError = max(maxError, max(fabsf(a.x - b.x), max(fabsf(a.y - b.y), fabsf(a.z - b.z))));
+			if (flocks[0][i]->GetAlive() != flocks[way][i]->GetAlive())
+				different++;
+		}
+
+		char sz[1024] = { 0 };
+		sprintf_s(sz, "rule pipeline, %u boids: %s %.2f ms/frame against Boid::Update %.2f ms/frame (%.2fx), max position error %g, %u differ in alive",
+			boidCount, names[way], times[way] * 1000.0, times[0] * 1000.0, times[0] / times[way], maxError, different);
+		Debug::Print(string(sz));
+	}
+
+	char sz[1024] = { 0 };
+	sprintf_s(sz, "rule pipeline, %u boids: compile time fixed weights %.2fx faster than runtime",
+		boidCount, times[3] / times[2]);
+	Debug::Print(string(sz));
+
+	DeletePredators(predators);
+	for (int way = 0; way < 4; way++)
+		DeleteBoids(flocks[way]);
+}
+
+void Benchmark::TopologicalDensity(unsigned int boidCount, float spacing)
+{
+	vector<Predator*> predators;
+
+	double times[2];
+	for (int topological = 0; topological < 2; topological++)
+	{
+		srand(1);
+		vecBoid boids = CreateBoids(boidCount, spacing);
+		SpatialGrid grid(NEARBY_DISTANCE);
+		Boid::SetTopologicalNeighbours(topological ? TOPOLOGICAL_NEIGHBOURS : 0);
+
+		// let the cell size settle for this density first, as it would after a few frames in the app
+		if (topological)
+		{
+			for (int i = 0; i < 4; i++)
+			{
+				grid.Build(boids);
+				grid.FitCellSize((float)TOPOLOGICAL_NEIGHBOURS, 1.0f, NEARBY_DISTANCE * 4.0f);
+			}
+		}
+
+		double start = Now();
+		for (unsigned int frame = 0; frame < DENSITY_FRAMES; frame++)
+		{
+			grid.Build(boids);
+			if (topological)
+				grid.FitCellSize((float)TOPOLOGICAL_NEIGHBOURS, 1.0f, NEARBY_DISTANCE * 4.0f);
+			for (Boid* b : boids)
+				b->Update(BENCHMARK_TIMESTEP, &boids, &grid, &predators, nullptr);
+		}
+		times[topological] = (Now() - start) / ((double)DENSITY_FRAMES * boidCount);
+
+		DeleteBoids(boids);
+	}
+	Boid::SetTopologicalNeighbours(0);
+
+	char sz[1024] = { 0 };
+	sprintf_s(sz, "topological, %u boids %.1f apart: metric %.3f us/boid, %d nearest %.3f us/boid",
+		boidCount, spacing, times[0] * 1000000.0, TOPOLOGICAL_NEIGHBOURS, times[1] * 1000000.0);
+	Debug::Print(string(sz));
+}
+
+void Benchmark::BarnesHut(unsigned int boidCount, unsigned int predatorCount, float theta)
+{
+	srand(1);
+	vecBoid boids = CreateBoids(boidCount, BENCHMARK_SPACING);
+
+	// predators anywhere over the flock
+	vector<Predator*> predators = CreatePredators(predatorCount, sqrtf((float)boidCount) * BENCHMARK_SPACING);
+
+	SpatialGrid grid(NEARBY_DISTANCE);
+	grid.Build(boids);
+	QuadTree tree(theta);
+
+	// exact sum over every boid, the grid only supplies the packed positions
+	vector<XMFLOAT3> exact(predatorCount);
+	double start = Now();
+	for (unsigned int i = 0; i < predatorCount; i++)
+		exact[i] = predators[i]->VecToNearbyBoids(&boids, &grid, nullptr);
+	double exactTime = Now() - start;
+
+	// the tree is rebuilt every frame so its build is part of the cost
+	vector<XMFLOAT3> approx(predatorCount);
+	start = Now();
+	tree.Build(grid.GetSortedPositions());
+	double buildTime = Now() - start;
+	for (unsigned int i = 0; i < predatorCount; i++)
+		approx[i] = predators[i]->VecToNearbyBoids(&boids, &grid, &tree);
+	double treeTime = Now() - start;
+
+	// both results are unit vectors, so compare the angle between them
+	double meanError = 0.0;
+	double maxError = 0.0;
+	for (unsigned int i = 0; i < predatorCount; i++)
+	{
+		float dot = (exact[i].x * approx[i].x) + (exact[i].y * approx[i].y) + (exact[i].z * approx[i].z);
+		double error = acos(min(max(dot, -1.0f), 1.0f)) * 180.0 / XM_PI;
+		meanError += error;
+		maxError = max(maxError, error);
+	}
+	meanError /= predatorCount;
+
+	char sz[1024] = { 0 };
+	sprintf_s(sz, "barnes-hut, %u boids, %u predators, theta %.2f: exact %.3f ms, tree %.3f ms (build %.3f ms), %.1fx faster, direction error mean %.4f max %.4f degrees",
+		boidCount, predatorCount, theta, exactTime * 1000.0, treeTime * 1000.0, buildTime * 1000.0, exactTime / treeTime, meanError, maxError);
+	Debug::Print(string(sz));
+
+	DeletePredators(predators);
+	DeleteBoids(boids);
+}
+
+void Benchmark::CellAggregateFlocking(unsigned int boidCount, float spacing)
+{
+	vector<Predator*> predators;
+
+	SpatialGrid exactGrid(NEARBY_DISTANCE);
+	SpatialGrid aggregateGrid(NEARBY_DISTANCE);
+	CellAggregates aggregates;
+
+	// the error is measured on a smaller flock at the same density, warmed up the same way in exact mode
+	// so both copies are identical, then stepped once each way
+	unsigned int sample = min(boidCount, (unsigned int)AGGREGATE_ERROR_SAMPLE);
+	srand(1);
+	vecBoid exactBoids = CreateBoids(sample, spacing);
+	srand(1);
+	vecBoid aggregateBoids = CreateBoids(sample, spacing);
+	for (unsigned int frame = 0; frame < AGGREGATE_WARMUP_FRAMES; frame++)
+	{
+		exactGrid.Build(exactBoids);
+		for (Boid* b : exactBoids)
+			b->Update(BENCHMARK_TIMESTEP, &exactBoids, &exactGrid, &predators, nullptr);
+		aggregateGrid.Build(aggregateBoids);
+		for (Boid* b : aggregateBoids)
+			b->Update(BENCHMARK_TIMESTEP, &aggregateBoids, &aggregateGrid, &predators, nullptr);
+	}
+
+	exactGrid.Build(exactBoids);
+	for (Boid* b : exactBoids)
+		b->Update(BENCHMARK_TIMESTEP, &exactBoids, &exactGrid, &predators, nullptr);
+
+	Boid::SetCellAggregates(&aggregates);
+	aggregateGrid.Build(aggregateBoids);
+	aggregates.Build(aggregateBoids);
+	for (Boid* b : aggregateBoids)
+	{
+		b->Update(BENCHMARK_TIMESTEP, &aggregateBoids, &aggregateGrid, &predators, nullptr);
+		aggregates.Move(b);
+	}
+	Boid::SetCellAggregates(nullptr);
+
+	double meanError = 0.0;
+	double maxError = 0.0;
+	for (unsigned int i = 0; i < sample; i++)
+	{
+		XMFLOAT3 a = *exactBoids[i]->GetDirection();
+		XMFLOAT3 b = *aggregateBoids[i]->GetDirection();
+		float dot = (a.x * b.x) + (a.y * b.y) + (a.z * b.z);
+		double error = acos(min(max(dot, -1.0f), 1.0f)) * 180.0 / XM_PI;
+		meanError += error;
+		maxError = max(maxError, error);
+	}
+	meanError /= sample;
+
+	DeleteBoids(exactBoids);
+	DeleteBoids(aggregateBoids);
+
+	srand(1);
+	exactBoids = CreateBoids(boidCount, spacing);
+	srand(1);
+	aggregateBoids = CreateBoids(boidCount, spacing);
+
+	// then time a few frames each way, the aggregates are rebuilt every frame here so their build is counted
+	double times[2];
+	for (int approximate = 0; approximate < 2; approximate++)
+	{
+		vecBoid& boids = approximate ? aggregateBoids : exactBoids;
+		SpatialGrid& grid = approximate ? aggregateGrid : exactGrid;
+		Boid::SetCellAggregates(approximate ? &aggregates : nullptr);
+
+		double start = Now();
+		for (unsigned int frame = 0; frame < AGGREGATE_FRAMES; frame++)
+		{
+			grid.Build(boids);
+			if (approximate)
+				aggregates.Build(boids);
+
+			for (Boid* b : boids)
+			{
+				b->Update(BENCHMARK_TIMESTEP, &boids, &grid, &predators, nullptr);
+				if (approximate)
+					aggregates.Move(b);
+			}
+		}
+		times[approximate] = (Now() - start) / AGGREGATE_FRAMES;
+	}
+	Boid::SetCellAggregates(nullptr);
+
+	char sz[1024] = { 0 };
+	sprintf_s(sz, "cell aggregates, %u boids %.1f apart: exact %.2f ms/frame (%.2f M boids/s), aggregates %.2f ms/frame (%.2f M boids/s), direction error over %u boids mean %.3f max %.3f degrees",
+		boidCount, spacing, times[0] * 1000.0, boidCount / times[0] / 1000000.0, times[1] * 1000.0, boidCount / times[1] / 1000000.0, sample, meanError, maxError);
+	Debug::Print(string(sz));
+
+	DeleteBoids(exactBoids);
+	DeleteBoids(aggregateBoids);
+}
+
+void Benchmark::PredatorIndex(unsigned int boidCount, unsigned int predatorCount)
+{
+	float size = sqrtf((float)boidCount) * BENCHMARK_SPACING;
+
+	srand(1);
+	vecBoid listBoids = CreateBoids(boidCount, BENCHMARK_SPACING);
+	vector<Predator*> predators = CreatePredators(predatorCount, size);
+	srand(1);
+	vecBoid gridBoids = CreateBoids(boidCount, BENCHMARK_SPACING);
+
+	SpatialGrid listGrid(NEARBY_DISTANCE);
+	SpatialGrid gridGrid(NEARBY_DISTANCE);
+	SpatialGrid predatorGrid(FLEE_DISTANCE_MAX);
+
+	// the predators stand still, only the boids' flee and kill tests are being timed
+	double times[2];
+	for (int indexed = 0; indexed < 2; indexed++)
+	{
+		vecBoid& boids = indexed ? gridBoids : listBoids;
+		SpatialGrid& grid = indexed ? gridGrid : listGrid;
+
+		double start = Now();
+		for (unsigned int frame = 0; frame < DENSITY_FRAMES; frame++)
+		{
+			grid.Build(boids);
+			if (indexed)
+				predatorGrid.Build(predators);
+
+			for (Boid* b : boids)
+				b->Update(BENCHMARK_TIMESTEP, &boids, &grid, &predators, indexed ? &predatorGrid : nullptr);
+		}
+		times[indexed] = (Now() - start) / DENSITY_FRAMES;
+	}
+
+	// only the order the flee vectors are added in changes, so both flocks should end up in the same place
+	unsigned int different = 0;
+	unsigned int dead = 0;
+	for (unsigned int i = 0; i < boidCount; i++)
+	{
+		XMFLOAT3 a = *listBoids[i]->GetDirection();
+		XMFLOAT3 b = *gridBoids[i]->GetDirection();
+		float error = max(fabsf(a.x - b.x), max(fabsf(a.y - b.y), fabsf(a.z - b.z)));
+		if (error > FUSED_STEERING_TOLERANCE || listBoids[i]->GetAlive() != gridBoids[i]->GetAlive())
+			different++;
+		if (!gridBoids[i]->GetAlive())
+			dead++;
+	}
+
+	char sz[1024] = { 0 };
+	sprintf_s(sz, "predator index, %u boids, %u predators: predator list %.2f ms/frame, predator grid %.2f ms/frame, %.1fx faster, %u boids killed, %u boids differ",
+		boidCount, predatorCount, times[0] * 1000.0, times[1] * 1000.0, times[0] / times[1], dead, different);
+	Debug::Print(string(sz));
+
+	DeletePredators(predators);
+	DeleteBoids(listBoids);
+	DeleteBoids(gridBoids);
+}
+
+void Benchmark::PerceptionConeAgreement(unsigned int batches)
+{
+	// random cones and vectors like the ones boids test, fields of view from 45 to 269 degrees
+	srand(1);
+	Boid boid;
+	vector<float> fov(batches);
+	vector<XMFLOAT3> directions(batches);
+	vector<float> toX(batches * PERCEPTION_BATCH);
+	vector<float> toY(batches * PERCEPTION_BATCH);
+	for (unsigned int i = 0; i < batches; i++)
+	{
+		fov[i] = 45.0f + (float)(rand() % 225);
+		float angle = ((float)rand() / (float)RAND_MAX) * XM_2PI;
+		directions[i] = XMFLOAT3(cosf(angle), sinf(angle), 0);
+		for (unsigned int j = 0; j < PERCEPTION_BATCH; j++)
+		{
+			float length = 1.0f + ((float)rand() / (float)RAND_MAX) * FLEE_DISTANCE_MAX;
+			angle = ((float)rand() / (float)RAND_MAX) * XM_2PI;
+			toX[i * PERCEPTION_BATCH + j] = cosf(angle) * length;
+			toY[i * PERCEPTION_BATCH + j] = sinf(angle) * length;
+		}
+	}
+
+	// every answer checked against CompareAngle, apart from vectors right on the edge of the cone
+	unsigned int edge = 0;
+	unsigned int scalarWrong = 0;
+	unsigned int batchWrong = 0;
+	for (unsigned int i = 0; i < batches; i++)
+	{
+		XMFLOAT3 d = directions[i];
+		float cosHalf = PerceptionCone::CosHalfAngle(fov[i]);
+		unsigned int inside = PerceptionCone::InsideBatch(d.x, d.y, cosHalf, &toX[i * PERCEPTION_BATCH], &toY[i * PERCEPTION_BATCH], PERCEPTION_BATCH);
+		for (unsigned int j = 0; j < PERCEPTION_BATCH; j++)
+		{
+			double tx = toX[i * PERCEPTION_BATCH + j];
+			double ty = toY[i * PERCEPTION_BATCH + j];
+			double angle = acos(((d.x * tx) + (d.y * ty)) / sqrt((tx * tx) + (ty * ty))) * 180.0 / XM_PI;
+			if (fabs(angle - (fov[i] * 0.5)) < CONE_EDGE_TOLERANCE)
+			{
+				edge++;
+				continue;
+			}
+
+			bool expected = boid.CompareAngle(d, XMFLOAT3((float)tx, (float)ty, 0), fov[i]);
+			if (PerceptionCone::Inside(d.x, d.y, cosHalf, (float)tx, (float)ty) != expected)
+				scalarWrong++;
+			if (((inside & (1u << j)) != 0) != expected)
+				batchWrong++;
+		}
+	}
+
+	// time the same tests both ways
+	unsigned int angleCount = 0;
+	double start = Now();
+	for (unsigned int i = 0; i < batches; i++)
+	{
+		for (unsigned int j = 0; j < PERCEPTION_BATCH; j++)
+		{
+			if (boid.CompareAngle(directions[i], XMFLOAT3(toX[i * PERCEPTION_BATCH + j], toY[i * PERCEPTION_BATCH + j], 0), fov[i]))
+				angleCount++;
+		}
+	}
+	double angleTime = Now() - start;
+
+	unsigned int coneCount = 0;
+	start = Now();
+	for (unsigned int i = 0; i < batches; i++)
+	{
+		XMFLOAT3 d = directions[i];
+		unsigned int inside = PerceptionCone::InsideBatch(d.x, d.y, PerceptionCone::CosHalfAngle(fov[i]), &toX[i * PERCEPTION_BATCH], &toY[i * PERCEPTION_BATCH], PERCEPTION_BATCH);
+		for (; inside != 0; inside &= inside - 1)
+			coneCount++;
+	}
+	double coneTime = Now() - start;
+
+	char sz[1024] = { 0 };
+	sprintf_s(sz, "perception cone, %u tests: CompareAngle %.2f ns/test, cone %.2f ns/test, inside %u / %u, %u on the edge skipped, %u scalar and %u batched disagree",
+		batches * PERCEPTION_BATCH, angleTime * 1e9 / (batches * PERCEPTION_BATCH), coneTime * 1e9 / (batches * PERCEPTION_BATCH), angleCount, coneCount, edge, scalarWrong, batchWrong);
+	Debug::Print(string(sz));
+}
+
+void Benchmark::PopulationFootprint(unsigned int boidCount)
+{
+	float size = sqrtf((float)boidCount) * BENCHMARK_SPACING;
+
+	srand(1);
+	vecBoid boids = CreateBoids(boidCount, BENCHMARK_SPACING);
+	vector<Predator*> predators = CreatePredators(FOOTPRINT_PREDATORS, size);
+	BoidPopulation population;
+	population.CopyFrom(boids);
+
+	// memory touched in a frame is the distinct cache lines under everything the update and draw read or write
+	vector<uintptr_t> lines;
+	auto touch = [&](const void* p, size_t bytes)
+	{
+		for (uintptr_t line = (uintptr_t)p / CACHE_LINE_SIZE; line <= ((uintptr_t)p + bytes - 1) / CACHE_LINE_SIZE; line++)
+			lines.push_back(line);
+	};
+	auto countLines = [&]()
+	{
+		sort(lines.begin(), lines.end());
+		size_t count = unique(lines.begin(), lines.end()) - lines.begin();
+		lines.clear();
+		return count;
+	};
+
+	// the simulation on its own, then with drawing
+	double objectSimulationBytes = 0.0;
+	for (int drawing = 0; drawing < 2; drawing++)
+	{
+		touch(boids.data(), boids.size() * sizeof(Boid*));
+		for (Boid* b : boids)
+		{
+			if (drawing)
+			{
+				touch(&b->m_World, sizeof(b->m_World));
+				touch(&b->m_pTextureResourceView, sizeof(b->m_pTextureResourceView));
+				touch(&b->m_pSamplerLinear, sizeof(b->m_pSamplerLinear));
+				touch(&b->m_material, sizeof(b->m_material));
+				touch(&b->m_scale, sizeof(b->m_scale));
+			}
+
+			// the trait table is only read for a new timestep or a kill
+			touch(&b->m_position, sizeof(b->m_position));
+			touch(&b->m_direction, sizeof(b->m_direction));
+			touch(&b->m_hot, sizeof(b->m_hot));
+			touch(&b->isAlive, sizeof(b->isAlive));
+			touch(&b->spotPredator, sizeof(b->spotPredator));
+			touch(&b->m_neighbourCacheValid, sizeof(b->m_neighbourCacheValid));
+		}
+		if (!drawing)
+			objectSimulationBytes = (double)(countLines() * CACHE_LINE_SIZE) / boidCount;
+	}
+	double objectBytes = (double)(countLines() * CACHE_LINE_SIZE) / boidCount;
+
+	// the population's update and draw touch every one of its arrays
+	for (unsigned int k = 0; k < 2; k++)
+	{
+		touch(population.m_position[k].data(), boidCount * sizeof(float));
+		touch(population.m_direction[k].data(), boidCount * sizeof(float));
+	}
+	touch(population.m_speed.data(), boidCount * sizeof(float));
+	touch(population.m_cosHalfFOV.data(), boidCount * sizeof(float));
+	touch(population.m_fleeDistance.data(), boidCount * sizeof(float));
+	touch(population.m_alive.data(), boidCount * sizeof(unsigned char));
+	double populationBytes = (double)(countLines() * CACHE_LINE_SIZE) / boidCount;
+
+	// run both from the same start, dead boids are left in place in both so the indices still match afterwards
+	SpatialGrid objectGrid(NEARBY_DISTANCE);
+	SpatialGrid populationGrid(NEARBY_DISTANCE);
+	SpatialGrid predatorGrid(FLEE_DISTANCE_MAX);
+	predatorGrid.Build(predators);
+
+	double times[2];
+	for (int arrays = 0; arrays < 2; arrays++)
+	{
+		double start = Now();
+		for (unsigned int frame = 0; frame < DENSITY_FRAMES; frame++)
+		{
+			if (arrays)
+			{
+				populationGrid.Build(population.GetX(), population.GetY(), population.GetCount());
+				population.Update(BENCHMARK_TIMESTEP, &populationGrid, &predators, &predatorGrid);
+			}
+			else
+			{
+				objectGrid.Build(boids);
+				for (Boid* b : boids)
+					b->Update(BENCHMARK_TIMESTEP, &boids, &objectGrid, &predators, &predatorGrid);
+			}
+		}
+		times[arrays] = (Now() - start) / DENSITY_FRAMES;
+	}
+
+	// the population does the same float operations in the same order, so the flocks should match exactly
+	float maxError = 0.0f;
+	unsigned int different = 0;
+	unsigned int dead = 0;
+	for (unsigned int i = 0; i < boidCount; i++)
+	{
+		XMFLOAT3 a = *boids[i]->getPosition();
+		XMFLOAT3 b = population.GetPosition(i);
+		float error = max(fabsf(a.x - b.x), fabsf(a.y - b.y));
+		maxError = max(maxError, error);
+		if (boids[i]->GetAlive() != population.GetAlive(i))
+			different++;
+		if (!population.GetAlive(i))
+			dead++;
+	}
+
+	char sz[1024] = { 0 };
+	sprintf_s(sz, "population footprint, %u boids: stored %u bytes/boid as objects, %u as arrays; touched %.1f bytes/boid/frame as objects (%.1f by the simulation), %.1f as arrays (%.1fx less)",
+		boidCount, (unsigned int)(sizeof(Boid) + sizeof(Boid*) + sizeof(BoidTraits)), (unsigned int)BoidPopulation::BytesPerBoid(), objectBytes, objectSimulationBytes, populationBytes, objectBytes / populationBytes);
+	Debug::Print(string(sz));
+	sprintf_s(sz, "population footprint, %u boids: objects %.2f ms/frame, arrays %.2f ms/frame, %.1fx faster, %u boids killed, max position error %g, %u alive/dead differ",
+		boidCount, times[0] * 1000.0, times[1] * 1000.0, times[0] / times[1], dead, maxError, different);
+	Debug::Print(string(sz));
+
+	DeletePredators(predators);
+	DeleteBoids(boids);
+}
+
+void Benchmark::SteeringKernelThroughput(unsigned int boidCount)
+{
+	float size = sqrtf((float)boidCount) * BENCHMARK_SPACING;
+
+	srand(1);
+	vecBoid boids = CreateBoids(boidCount, BENCHMARK_SPACING);
+	vector<Predator*> predators = CreatePredators(FOOTPRINT_PREDATORS, size);
+
+	SpatialGrid grid(NEARBY_DISTANCE);
+	SpatialGrid predatorGrid(FLEE_DISTANCE_MAX);
+	grid.Build(boids);
+	predatorGrid.Build(predators);
+
+	// the reference is Boid::Update with each boid put back afterwards, so every boid sees the flock as it was at the start
+	vector<XMFLOAT3> expected(boidCount);
+	double start = Now();
+	for (unsigned int i = 0; i < boidCount; i++)
+	{
+		Boid* b = boids[i];
+		XMFLOAT3 position = b->m_position;
+		XMFLOAT3 direction = b->m_direction;
+		b->Update(BENCHMARK_TIMESTEP, &boids, &grid, &predators, &predatorGrid);
+		expected[i] = b->m_direction;
+		b->m_position = position;
+		b->m_direction = direction;
+	}
+	double referenceTime = Now() - start;
+
+	char sz[1024] = { 0 };
+	sprintf_s(sz, "steering kernel, %u boids: Boid::Update %.2f M boids/s", boidCount, boidCount / referenceTime / 1e6);
+	Debug::Print(string(sz));
+
+	BoidPopulation population;
+	double scalarTime = 0.0;
+	for (int level = SIMD_LEVEL_SCALAR; level < SIMD_LEVEL_COUNT; level++)
+	{
+		if (!SteeringKernel::Supported((SimdLevel)level))
+		{
+			sprintf_s(sz, "steering kernel, %u boids: %s not built or not supported on this cpu", boidCount, CpuFeatures::Name((SimdLevel)level));
+			Debug::Print(string(sz));
+			continue;
+		}
+
+		// the same flock in the same order, so the grid still matches it
+		population.CopyFrom(boids);
+		population.Steer(&grid, &predatorGrid, (SimdLevel)level);
+
+		float maxError = 0.0f;
+		unsigned int outside = 0;
+		for (unsigned int i = 0; i < boidCount; i++)
+		{
+			XMFLOAT3 a = expected[i];
+			XMFLOAT3 b = population.GetDirection(i);
+			float error = max(fabsf(a.x - b.x), fabsf(a.y - b.y));
+			maxError = max(maxError, error);
+			if (error > STEERING_KERNEL_TOLERANCE)
+				outside++;
+		}
+
+		// later passes steer from the directions the last one left, the positions stay put
+		start = Now();
+		for (unsigned int repeat = 0; repeat < STEERING_REPEATS; repeat++)
+			population.Steer(&grid, &predatorGrid, (SimdLevel)level);
+		double time = (Now() - start) / STEERING_REPEATS;
+		if (level == SIMD_LEVEL_SCALAR)
+			scalarTime = time;
+
+		sprintf_s(sz, "steering kernel, %u boids: %s %.2f M boids/s (%.1fx Boid::Update, %.1fx scalar kernel), max direction error %g (%u over tolerance %g)",
+			boidCount, CpuFeatures::Name((SimdLevel)level), boidCount / time / 1e6, referenceTime / time, scalarTime / time, maxError, outside, STEERING_KERNEL_TOLERANCE);
+		Debug::Print(string(sz));
+	}
+
+	DeletePredators(predators);
+	DeleteBoids(boids);
+}
+
+void Benchmark::DimensionSpecialisation(unsigned int boidCount)
+{
+	float size = sqrtf((float)boidCount) * BENCHMARK_SPACING;
+
+	srand(1);
+	vecBoid boids = CreateBoids(boidCount, BENCHMARK_SPACING);
+	vector<Predator*> predators = CreatePredators(FOOTPRINT_PREDATORS, size);
+	SpatialGrid predatorGrid(FLEE_DISTANCE_MAX);
+	predatorGrid.Build(predators);
+
+	// the boids all start at z = 0 and nothing pushes them off it, so the 3d flock should stay the 2d one
+	BoidPopulation flat[2];
+	BoidPopulation3D deep[2];
+	for (unsigned int i = 0; i < 2; i++)
+	{
+		flat[i].CopyFrom(boids);
+		deep[i].CopyFrom(boids);
+	}
+
+	SpatialGrid grid(NEARBY_DISTANCE);
+	SimdLevel level = SteeringKernel::Best();
+
+	// Boid::Update, then 3d and 2d arrays in place, then 3d and 2d through the steering kernel
+	double times[5];
+	for (int mode = 0; mode < 5; mode++)
+	{
+		double start = Now();
+		for (unsigned int frame = 0; frame < DENSITY_FRAMES; frame++)
+		{
+			switch (mode)
+			{
+			case 0:
+				grid.Build(boids);
+				for (Boid* b : boids)
+					b->Update(BENCHMARK_TIMESTEP, &boids, &grid, &predators, &predatorGrid);
+				break;
+			case 1:
+				grid.Build(deep[0].GetX(), deep[0].GetY(), deep[0].GetCount(), deep[0].GetZ());
+				deep[0].Update(BENCHMARK_TIMESTEP, &grid, &predators, &predatorGrid);
+				break;
+			case 2:
+				grid.Build(flat[0].GetX(), flat[0].GetY(), flat[0].GetCount(), flat[0].GetZ());
+				flat[0].Update(BENCHMARK_TIMESTEP, &grid, &predators, &predatorGrid);
+				break;
+			case 3:
+				grid.Build(deep[1].GetX(), deep[1].GetY(), deep[1].GetCount(), deep[1].GetZ());
+				deep[1].UpdateBatched(BENCHMARK_TIMESTEP, &grid, &predatorGrid, level);
+				break;
+			case 4:
+				grid.Build(flat[1].GetX(), flat[1].GetY(), flat[1].GetCount(), flat[1].GetZ());
+				flat[1].UpdateBatched(BENCHMARK_TIMESTEP, &grid, &predatorGrid, level);
+				break;
+			}
+		}
+		times[mode] = (Now() - start) / DENSITY_FRAMES;
+	}
+
+	float maxError = 0.0f;
+	for (unsigned int p = 0; p < 2; p++)
+	{
+		for (unsigned int i = 0; i < boidCount; i++)
+		{
+			XMFLOAT3 a = flat[p].GetPosition(i);
+			XMFLOAT3 b = deep[p].GetPosition(i);
+			maxError = max(maxError, max(max(fabsf(a.x - b.x), fabsf(a.y - b.y)), fabsf(b.z)));
+		}
+	}
+
+	char sz[1024] = { 0 };
+	sprintf_s(sz, "dimensions, %u boids: Boid::Update %.2f ms/frame, 3d arrays %.2f ms/frame (%u bytes/boid), 2d arrays %.2f ms/frame (%u bytes/boid), 2d %.2fx faster than 3d, %.2fx Boid::Update",
+		boidCount, times[0] * 1000.0, times[1] * 1000.0, (unsigned int)BoidPopulation3D::BytesPerBoid(), times[2] * 1000.0, (unsigned int)BoidPopulation::BytesPerBoid(), times[1] / times[2], times[0] / times[2]);
+	Debug::Print(string(sz));
+	sprintf_s(sz, "dimensions, %u boids: %s steering kernel 3d %.2f ms/frame, 2d %.2f ms/frame, 2d %.2fx faster, 2d and flat 3d max position error %g",
+		boidCount, CpuFeatures::Name(level), times[3] * 1000.0, times[4] * 1000.0, times[3] / times[4], maxError);
+	Debug::Print(string(sz));
+
+	DeletePredators(predators);
+	DeleteBoids(boids);
+}
+
+void Benchmark::QuantisedStorage(unsigned int boidCount, unsigned int steps)
+{
+	float size = sqrtf((float)boidCount) * BENCHMARK_SPACING;
+	WorldBounds bounds;
+	bounds.Set(XMFLOAT2(size * -0.5f, size * -0.5f), XMFLOAT2(size * 0.5f, size * 0.5f));
+
+	// arrays straight away, ten million Boid objects wouldn't fit
+	srand(1);
+	BoidPopulation population;
+	population.SetWorldBounds(&bounds);
+	for (unsigned int i = 0; i < boidCount; i++)
+	{
+		float x = ((float)rand() / (float)RAND_MAX) * size - (size * 0.5f);
+		float y = ((float)rand() / (float)RAND_MAX) * size - (size * 0.5f);
+		population.Add(XMFLOAT3(x, y, 0));
+	}
+	// predators still scatter the flock but can't kill, so both keep every boid and can be compared one to one
+	population.m_canDie = false;
+
+	vector<Predator*> predators = CreatePredators(FOOTPRINT_PREDATORS, size);
+	SpatialGrid predatorGrid(FLEE_DISTANCE_MAX);
+	predatorGrid.SetWorldBounds(&bounds);
+	predatorGrid.Build(predators);
+	SpatialGrid grid(NEARBY_DISTANCE);
+	grid.SetWorldBounds(&bounds);
+
+	QuantisedPopulation quantised;
+	if (!quantised.SetWorldBounds(&bounds))
+	{
+		Debug::Print("quantised: the world is too small for the cells");
+		DeletePredators(predators);
+		return;
+	}
+	quantised.CopyFrom(population);
+
+	SimdLevel level = SteeringKernel::Best();
+	char sz[1024] = { 0 };
+	sprintf_s(sz, "quantised, %u boids: float %u bytes/boid, quantised %u bytes/boid + %.2f for the cell table",
+		boidCount, (unsigned int)BoidPopulation::BytesPerBoid(), (unsigned int)QuantisedPopulation::BytesPerBoid(), (double)quantised.BytesPerCellTable() / boidCount);
+	Debug::Print(string(sz));
+
+	// the flock is chaotic, so any difference grows, this float flock starts from the quantised values
+	// and shows how much of the drift is just that rather than the rounding every frame
+	BoidPopulation rounded = population;
+	for (unsigned int i = 0; i < quantised.GetCount(); i++)
+	{
+		unsigned int id = quantised.GetId(i);
+		XMFLOAT3 p = quantised.GetPosition(i);
+		XMFLOAT3 dir = quantised.GetDirection(i);
+		rounded.m_position[0][id] = p.x;
+		rounded.m_position[1][id] = p.y;
+		rounded.m_direction[0][id] = dir.x;
+		rounded.m_direction[1][id] = dir.y;
+	}
+
+	// how far each boid has strayed from the float one, the short way round
+	auto drift = [&](unsigned int step)
+	{
+		double positionSum[2] = { 0.0, 0.0 };
+		float positionMax[2] = { 0.0f, 0.0f };
+		double angleSum = 0.0;
+		for (unsigned int i = 0; i < quantised.GetCount(); i++)
+		{
+			unsigned int id = quantised.GetId(i);
+			XMFLOAT3 b = population.GetPosition(id);
+			XMFLOAT3 a[2] = { bounds.NearestImage(quantised.GetPosition(i), b), bounds.NearestImage(rounded.GetPosition(id), b) };
+			for (unsigned int k = 0; k < 2; k++)
+			{
+				float d = sqrtf(((a[k].x - b.x) * (a[k].x - b.x)) + ((a[k].y - b.y) * (a[k].y - b.y)));
+				positionSum[k] += d;
+				positionMax[k] = max(positionMax[k], d);
+			}
+
+			XMFLOAT3 u = quantised.GetDirection(i);
+			XMFLOAT3 v = population.GetDirection(id);
+			angleSum += fabs(atan2((double)((u.x * v.y) - (u.y * v.x)), (double)((u.x * v.x) + (u.y * v.y))));
+		}
+		unsigned int count = quantised.GetCount();
+		sprintf_s(sz, "quantised, %u boids, step %u: drift from float mean %g max %g, direction mean %g degrees, float from the quantised start mean %g max %g",
+			boidCount, step, positionSum[0] / count, positionMax[0], (angleSum / count) * 180.0 / XM_PI, positionSum[1] / count, positionMax[1]);
+		Debug::Print(string(sz));
+	};
+
+	double floatTime = 0.0;
+	double quantisedTime = 0.0;
+	unsigned int report = 1;
+	drift(0);
+	for (unsigned int step = 1; step <= steps; step++)
+	{
+		// the float flock does everything the quantised one does in its update, wrap, grid and steer
+		double start = Now();
+		population.Wrap();
+		grid.Build(population.GetX(), population.GetY(), population.GetCount(), population.GetZ());
+		population.UpdateBatched(BENCHMARK_TIMESTEP, &grid, &predatorGrid, level);
+		floatTime += Now() - start;
+
+		start = Now();
+		quantised.Update(BENCHMARK_TIMESTEP, &predatorGrid, level);
+		quantisedTime += Now() - start;
+
+		rounded.Wrap();
+		grid.Build(rounded.GetX(), rounded.GetY(), rounded.GetCount(), rounded.GetZ());
+		rounded.UpdateBatched(BENCHMARK_TIMESTEP, &grid, &predatorGrid, level);
+
+		if (step == report || step == steps)
+		{
+			population.Wrap();
+			rounded.Wrap();
+			drift(step);
+			report *= 10;
+		}
+	}
+
+	sprintf_s(sz, "quantised, %u boids, %s: float %.2f M boids/s, quantised %.2f M boids/s, %.2fx",
+		boidCount, CpuFeatures::Name(level), (boidCount * steps) / floatTime / 1e6, (boidCount * steps) / quantisedTime / 1e6, floatTime / quantisedTime);
+	Debug::Print(string(sz));
+
+	DeletePredators(predators);
+}
+
+void Benchmark::LargePageArrays(unsigned int boidCount, unsigned int frames)
+{
+	float size = sqrtf((float)boidCount) * BENCHMARK_SPACING;
+	WorldBounds bounds;
+	bounds.Set(XMFLOAT2(size * -0.5f, size * -0.5f), XMFLOAT2(size * 0.5f, size * 0.5f));
+
+	bool available = LargePages::Enable();
+	bool wasEnabled = LargePages::GetEnabled();
+	char sz[1024] = { 0 };
+	sprintf_s(sz, "large pages, %u boids: %s, pages %u KB and %u KB",
+		boidCount, available ? "available" : "not available, normal pages from VirtualAlloc instead",
+		(unsigned int)(LargePages::SmallPageSize() / 1024), (unsigned int)(LargePages::LargePageSize() / 1024));
+	Debug::Print(string(sz));
+
+	srand(1);
+	vector<Predator*> predators = CreatePredators(FOOTPRINT_PREDATORS, size);
+	SpatialGrid predatorGrid(FLEE_DISTANCE_MAX);
+	predatorGrid.SetWorldBounds(&bounds);
+	predatorGrid.Build(predators);
+	SpatialGrid grid(NEARBY_DISTANCE);
+	grid.SetWorldBounds(&bounds);
+	SimdLevel level = SteeringKernel::Best();
+
+	// the same flocks in heap memory and then in pages, only the backing of their arrays changes
+	double floatTimes[2];
+	double quantisedTimes[2];
+	for (int paged = 0; paged < 2; paged++)
+	{
+		LargePages::SetEnabled(paged != 0);
+
+		srand(2);
+		BoidPopulation population;
+		population.SetWorldBounds(&bounds);
+		for (unsigned int i = 0; i < boidCount; i++)
+		{
+			float x = ((float)rand() / (float)RAND_MAX) * size - (size * 0.5f);
+			float y = ((float)rand() / (float)RAND_MAX) * size - (size * 0.5f);
+			population.Add(XMFLOAT3(x, y, 0));
+		}
+		population.m_canDie = false;
+
+		QuantisedPopulation quantised;
+		quantised.SetWorldBounds(&bounds);
+		quantised.CopyFrom(population);
+
+		double start = Now();
+		for (unsigned int frame = 0; frame < frames; frame++)
+		{
+			population.Wrap();
+			grid.Build(population.GetX(), population.GetY(), population.GetCount(), population.GetZ());
+			population.UpdateBatched(BENCHMARK_TIMESTEP, &grid, &predatorGrid, level);
+		}
+		floatTimes[paged] = (Now() - start) / frames;
+
+		start = Now();
+		for (unsigned int frame = 0; frame < frames; frame++)
+			quantised.Update(BENCHMARK_TIMESTEP, &predatorGrid, level);
+		quantisedTimes[paged] = (Now() - start) / frames;
+
+		// both flocks' arrays are still allocated here
+		LargePageStats stats = LargePages::GetStats();
+		size_t pagedBytes = stats.largeBytes + stats.smallBytes;
+		size_t pageSize = stats.largeBytes > 0 ? LargePages::LargePageSize() : LargePages::SmallPageSize();
+		sprintf_s(sz, "large pages, %u boids, %s: float %.2f ms/frame, quantised %.2f ms/frame, %.1f MB in large pages, %.1f MB in normal pages, %.1f MB on the heap, %u fallbacks, arrays span %u pages",
+			boidCount, paged ? "paged" : "heap", floatTimes[paged] * 1000.0, quantisedTimes[paged] * 1000.0, stats.largeBytes / 1e6, stats.smallBytes / 1e6, stats.heapBytes / 1e6, stats.fallbacks,
+			(unsigned int)(paged ? pagedBytes / pageSize : stats.heapBytes / LargePages::SmallPageSize()));
+		Debug::Print(string(sz));
+	}
+	LargePages::SetEnabled(wasEnabled);
+
+	sprintf_s(sz, "large pages, %u boids: paged float %.2fx, quantised %.2fx the speed of heap",
+		boidCount, floatTimes[0] / floatTimes[1], quantisedTimes[0] / quantisedTimes[1]);
+	Debug::Print(string(sz));
+
+	DeletePredators(predators);
+}
+
+void Benchmark::EntityChurn(unsigned int boidCount, unsigned int deathsPerSecond)
+{
+	float size = sqrtf((float)boidCount) * BENCHMARK_SPACING;
+	unsigned int frames = (unsigned int)(CHURN_SECONDS / BENCHMARK_TIMESTEP);
+	vector<Predator*> predators;
+
+	// the flock stays the same size, every death is followed by a spawn somewhere random
+	// there is no device here, so new/delete doesn't include the buffers, texture and sampler it would make and release
+	double churnTimes[2];
+	double frameTimes[2];
+	unsigned int churned[2];
+	for (int pooled = 0; pooled < 2; pooled++)
+	{
+		srand(1);
+		EntityPool<Boid> pool;
+		vecBoid boids;
+		if (pooled)
+		{
+			pool.Create(boidCount);
+			for (unsigned int i = 0; i < boidCount; i++)
+			{
+				Boid* b = pool.Spawn();
+				b->setPosition(XMFLOAT3(((float)rand() / (float)RAND_MAX) * size - (size * 0.5f), ((float)rand() / (float)RAND_MAX) * size - (size * 0.5f), 0));
+				boids.push_back(b);
+			}
+		}
+		else
+		{
+			boids = CreateBoids(boidCount, BENCHMARK_SPACING);
+		}
+		SpatialGrid grid(NEARBY_DISTANCE);
+
+		double churnTime = 0.0;
+		double due = 0.0;
+		churned[pooled] = 0;
+		double start = Now();
+		for (unsigned int frame = 0; frame < frames; frame++)
+		{
+			grid.Build(boids);
+			for (Boid* b : boids)
+				b->Update(BENCHMARK_TIMESTEP, &boids, &grid, &predators, nullptr);
+
+			double churnStart = Now();
+			for (due += deathsPerSecond * BENCHMARK_TIMESTEP; due >= 1.0; due -= 1.0)
+			{
+				// the same swap and pop either way, only where the boid comes from changes
+				unsigned int i = rand() % boids.size();
+				Boid* b = nullptr;
+				if (pooled)
+				{
+					pool.Despawn(boids[i]);
+					b = pool.Spawn();
+				}
+				else
+				{
+					delete boids[i];
+					b = new Boid();
+				}
+				b->setPosition(XMFLOAT3(((float)rand() / (float)RAND_MAX) * size - (size * 0.5f), ((float)rand() / (float)RAND_MAX) * size - (size * 0.5f), 0));
+				boids[i] = boids.back();
+				boids.back() = b;
+				churned[pooled]++;
+			}
+			churnTime += Now() - churnStart;
+		}
+		frameTimes[pooled] = (Now() - start) / frames;
+		churnTimes[pooled] = churnTime;
+
+		if (!pooled)
+			DeleteBoids(boids);
+	}
+
+	char sz[1024] = { 0 };
+	sprintf_s(sz, "entity churn, %u boids, %u deaths/s: new/delete %.3f us a death and spawn (%.2f ms/frame), pool %.3f us (%.2f ms/frame), %.1fx",
+		boidCount, deathsPerSecond, churnTimes[0] / churned[0] * 1e6, frameTimes[0] * 1000.0, churnTimes[1] / churned[1] * 1e6, frameTimes[1] * 1000.0, churnTimes[0] / churnTimes[1]);
+	Debug::Print(string(sz));
+}
+
+void Benchmark::FrameAllocations(unsigned int boidCount, bool neighbourLists)
+{
+#ifndef ALLOCATION_COUNTER
+	Debug::Print("frame allocations: not counted in this build, define ALLOCATION_COUNTER (or build debug) to count them");
+#else
+
+	// no predators so nothing dies and the flock stays the same size, the frames are run like UpdateBoids runs them
+	vector<Predator*> predators;
+
+	srand(1);
+	vecBoid boids = CreateBoids(boidCount, BENCHMARK_SPACING);
+	SpatialGrid grid(NEARBY_DISTANCE);
+	SpatialGrid predatorGrid(NEARBY_DISTANCE);
+	NeighbourList neighbourList(NEARBY_DISTANCE);
+
+	unsigned int frames[2] = { 0, 0 };
+	unsigned long long allocations[2] = { 0, 0 };
+	unsigned long long worstFrame = 0;
+	AllocationCounter::EndFrame();
+	for (unsigned int frame = 0; frame < ZERO_ALLOCATION_WARMUP + ALLOCATION_FRAMES; frame++)
+	{
+		// every other frame each way, so both paths are checked with the arena at its settled size
+		Boid::SetFusedSteering(frame % 2 == 1);
+
+		if (frame % MORTON_SORT_INTERVAL == 0)
+		{
+			MortonOrder::SortBoids(boids);
+			neighbourList.Invalidate();
+		}
+		grid.Build(boids);
+		predatorGrid.Build(predators);
+		if (neighbourLists)
+			neighbourList.Update(BENCHMARK_TIMESTEP, &boids, &grid);
+		for (Boid* b : boids)
+			b->Update(BENCHMARK_TIMESTEP, &boids, &grid, &predators, &predatorGrid);
+		FrameArena::Frame().Reset();
+
+		unsigned long long count = AllocationCounter::EndFrame();
+		bool settled = frame >= ZERO_ALLOCATION_WARMUP;
+		frames[settled]++;
+		allocations[settled] += count;
+		if (settled)
+			worstFrame = max(worstFrame, count);
+	}
+	Boid::SetFusedSteering(true);
+
+	char sz[1024] = { 0 };
+	sprintf_s(sz, "frame allocations, %u boids, %s: %.1f a frame while warming up, %.2f a frame after (worst %llu), arena peak %zu KB of %zu KB",
+		boidCount, neighbourLists ? "neighbour lists" : "grid", (double)allocations[0] / frames[0], (double)allocations[1] / frames[1],
+		worstFrame, FrameArena::Frame().GetPeak() / 1024, FrameArena::Frame().GetCapacity() / 1024);
+	Debug::Print(string(sz));
+
+	DeleteBoids(boids);
+#endif
+}
+
+void Benchmark::DoubleBufferedOrder(unsigned int boidCount)
+{
+	vector<Predator*> predators;
+
+	// the same flock run for the same frames, forwards through the list, backwards, and split between threads
+	// run is how, 0 forwards, 1 backwards, 2 on ORDER_THREADS threads (double buffered only, in place it would be a data race)
+	auto runFlock = [&](bool buffered, int run, double& frameTime)
+	{
+		srand(1);
+		vecBoid boids = CreateBoids(boidCount, BENCHMARK_SPACING);
+		SpatialGrid grid(NEARBY_DISTANCE);
+		Boid::SetDoubleBuffered(buffered);
+
+		auto updateRange = [&](unsigned int begin, unsigned int end)
+		{
+			for (unsigned int i = begin; i < end; i++)
+				boids[i]->Update(BENCHMARK_TIMESTEP, &boids, &grid, &predators, nullptr);
+		};
+
+		double start = Now();
+		for (unsigned int frame = 0; frame < BENCHMARK_FRAMES; frame++)
+		{
+			if (buffered)
+				Boid::SwapStates(boids);
+			grid.Build(boids);
+
+			if (run == 0)
+			{
+				updateRange(0, boidCount);
+			}
+			else if (run == 1)
+			{
+				for (unsigned int i = boidCount; i > 0; i--)
+					updateRange(i - 1, i);
+			}
+			else
+			{
+				unsigned int chunk = (boidCount + ORDER_THREADS - 1) / ORDER_THREADS;
+				vector<thread> workers;
+				for (unsigned int w = 1; w < ORDER_THREADS; w++)
+					workers.push_back(thread(updateRange, w * chunk, min(boidCount, (w + 1) * chunk)));
+				updateRange(0, min(boidCount, chunk));
+				for (thread& w : workers)
+					w.join();
+			}
+		}
+		frameTime = (Now() - start) / BENCHMARK_FRAMES;
+		Boid::SetDoubleBuffered(false);
+
+		vector<XMFLOAT3> positions(boidCount);
+		for (unsigned int i = 0; i < boidCount; i++)
+			positions[i] = *boids[i]->getPosition();
+		DeleteBoids(boids);
+		return positions;
+	};
+
+	auto maxDifference = [](const vector<XMFLOAT3>& a, const vector<XMFLOAT3>& b)
+	{
+		float difference = 0.0f;
+		for (size_t i = 0; i < a.size(); i++)
+			difference = max(difference, max(fabsf(a[i].x - b[i].x), fabsf(a[i].y - b[i].y)));
+		return difference;
+	};
+
+	double inPlaceTime, bufferedTime, backwardsTime, threadedTime;
+	vector<XMFLOAT3> inPlace = runFlock(false, 0, inPlaceTime);
+	vector<XMFLOAT3> inPlaceBackwards = runFlock(false, 1, backwardsTime);
+	vector<XMFLOAT3> buffered = runFlock(true, 0, bufferedTime);
+	vector<XMFLOAT3> bufferedBackwards = runFlock(true, 1, backwardsTime);
+	vector<XMFLOAT3> bufferedThreaded = runFlock(true, 2, threadedTime);
+
+	char sz[1024] = { 0 };
+	sprintf_s(sz, "double buffering, %u boids, %u frames: in place %.2f ms/frame, backwards ends up to %.2f away, double buffered %.2f ms/frame, backwards %g away, %d threads %g away",
+		boidCount, BENCHMARK_FRAMES, inPlaceTime * 1000.0, maxDifference(inPlace, inPlaceBackwards), bufferedTime * 1000.0,
+		maxDifference(buffered, bufferedBackwards), ORDER_THREADS, maxDifference(buffered, bufferedThreaded));
+	Debug::Print(string(sz));
+}
+
+void Benchmark::ThreadScaling(unsigned int boidCount, unsigned int frames)
+{
+	vector<Predator*> predators;
+
+	// a dense cluster costs more a boid, and after sorting it is one run of the list,
+	// so equal slices of the list are uneven work
+	srand(1);
+	vecBoid boids = CreateBoids(boidCount, BENCHMARK_SPACING);
+	for (unsigned int i = 0; i < boidCount; i += CLUSTER_FRACTION)
+	{
+		XMFLOAT3 p = *boids[i]->getPosition();
+		boids[i]->setPosition(XMFLOAT3(p.x * CLUSTER_SCALE, p.y * CLUSTER_SCALE, 0));
+	}
+	MortonOrder::SortBoids(boids);
+
+	vector<BoidState> start(boidCount);
+	for (unsigned int i = 0; i < boidCount; i++)
+		start[i] = { *boids[i]->getPosition(), *boids[i]->GetDirection() };
+
+	SpatialGrid grid(NEARBY_DISTANCE);
+	Boid::SetDoubleBuffered(true);
+
+	// the same frames from the same start for every thread count, only the boid updates are timed,
+	// the grid build and swap stay on one thread
+	// threads 0 is the comparison, equal slices on one thread per core with no stealing
+	auto runFlock = [&](unsigned int threads, unsigned long long& steals, vector<XMFLOAT3>& end)
+	{
+		for (unsigned int i = 0; i < boidCount; i++)
+		{
+			boids[i]->setPosition(start[i].position);
+			boids[i]->m_direction = start[i].direction;
+		}
+
+		JobSystem jobs;
+		jobs.Start(threads);
+		auto updateRange = [&](unsigned int begin, unsigned int end)
+		{
+			for (unsigned int i = begin; i < end; i++)
+				boids[i]->Update(BENCHMARK_TIMESTEP, &boids, &grid, &predators, nullptr);
+		};
+
+		double updateTime = 0.0;
+		for (unsigned int frame = 0; frame < frames; frame++)
+		{
+			Boid::SwapStates(boids);
+			grid.Build(boids);
+
+			double updateStart = Now();
+			if (threads > 0)
+			{
+				jobs.ParallelFor(boidCount, updateRange);
+			}
+			else
+			{
+				unsigned int cores = max(thread::hardware_concurrency(), 1u);
+				unsigned int slice = (boidCount + cores - 1) / cores;
+				vector<thread> workers;
+				for (unsigned int w = 1; w < cores; w++)
+					workers.push_back(thread(updateRange, min(boidCount, w * slice), min(boidCount, (w + 1) * slice)));
+				updateRange(0, min(boidCount, slice));
+				for (thread& w : workers)
+					w.join();
+			}
+			updateTime += Now() - updateStart;
+		}
+		steals = jobs.GetSteals();
+
+		end.resize(boidCount);
+		for (unsigned int i = 0; i < boidCount; i++)
+			end[i] = *boids[i]->getPosition();
+		return updateTime / frames;
+	};
+
+	unsigned long long steals;
+	vector<XMFLOAT3> single, end;
+	double singleTime = runFlock(1, steals, single);
+
+	char sz[1024] = { 0 };
+	unsigned int cores = max(thread::hardware_concurrency(), 1u);
+	// doubling up to one per core, and at least 2 so stealing is run even on one core
+	vector<unsigned int> threadCounts;
+	unsigned int most = max(cores, 2u);
+	for (unsigned int threads = 2; threads < most; threads *= 2)
+		threadCounts.push_back(threads);
+	threadCounts.push_back(most);
+	for (unsigned int threads : threadCounts)
+	{
+		double time = runFlock(threads, steals, end);
+		float difference = 0.0f;
+		for (unsigned int i = 0; i < boidCount; i++)
+			difference = max(difference, max(fabsf(end[i].x - single[i].x), fabsf(end[i].y - single[i].y)));
+
+		sprintf_s(sz, "thread scaling, %u boids, %u threads: %.2f ms/frame updating, %.2fx one thread, %llu steals, %g from one thread",
+			boidCount, threads, time * 1000.0, singleTime / time, steals, difference);
+		Debug::Print(string(sz));
+	}
+
+	double staticTime = runFlock(0, steals, end);
+	sprintf_s(sz, "thread scaling, %u boids: one thread %.2f ms/frame, equal slices on %u cores without stealing %.2f ms/frame",
+		boidCount, singleTime * 1000.0, cores, staticTime * 1000.0);
+	Debug::Print(string(sz));
+
+	// the population's batched update from the same start, split by whole cells, it should come out the same to the bit
+	BoidPopulation startPopulation;
+	for (unsigned int i = 0; i < boidCount; i++)
+	{
+		boids[i]->setPosition(start[i].position);
+		boids[i]->m_direction = start[i].direction;
+	}
+	startPopulation.CopyFrom(boids);
+	SimdLevel level = SteeringKernel::Best();
+	auto runPopulation = [&](unsigned int threads, BoidPopulation& population)
+	{
+		population = startPopulation;
+		JobSystem jobs;
+		jobs.Start(threads);
+		population.SetJobSystem(&jobs);
+
+		double updateTime = 0.0;
+		for (unsigned int frame = 0; frame < frames; frame++)
+		{
+			grid.Build(population.GetX(), population.GetY(), population.GetCount(), population.GetZ());
+			double updateStart = Now();
+			population.UpdateBatched(BENCHMARK_TIMESTEP, &grid, nullptr, level);
+			updateTime += Now() - updateStart;
+		}
+		population.SetJobSystem(nullptr);
+		return updateTime / frames;
+	};
+
+	BoidPopulation singlePopulation, population;
+	double singlePopulationTime = runPopulation(1, singlePopulation);
+	for (unsigned int threads : threadCounts)
+	{
+		double time = runPopulation(threads, population);
+		unsigned int different = 0;
+		for (unsigned int i = 0; i < boidCount; i++)
+		{
+			if (population.GetX()[i] != singlePopulation.GetX()[i] || population.GetY()[i] != singlePopulation.GetY()[i])
+				different++;
+		}
+
+		sprintf_s(sz, "thread scaling, %u boids, population with the %s kernel, %u threads: %.2f ms/frame, %.2fx one thread, %u boids not where one thread put them",
+			boidCount, CpuFeatures::Name(level), threads, time * 1000.0, singlePopulationTime / time, different);
+		Debug::Print(string(sz));
+	}
+
+	Boid::SetDoubleBuffered(false);
+	DeleteBoids(boids);
+}
+
+void Benchmark::PredatorContention(unsigned int boidCount, unsigned int predatorCount)
+{
+	// the boids stay still and every predator lets go of its target at the end of every frame,
+	// so every frame is every predator choosing again at once, the worst case for claiming
+	srand(1);
+	float size = sqrtf((float)boidCount) * BENCHMARK_SPACING;
+	vecBoid boids = CreateBoids(boidCount, BENCHMARK_SPACING);
+	vector<Predator*> predators = CreatePredators(predatorCount, size * CONTENTION_AREA);
+	SpatialGrid grid(NEARBY_DISTANCE);
+	grid.Build(boids);
+
+	vector<XMFLOAT3> start(predatorCount);
+	for (unsigned int i = 0; i < predatorCount; i++)
+		start[i] = *predators[i]->getPosition();
+
+	unsigned int cores = max(thread::hardware_concurrency(), 1u);
+	char sz[1024] = { 0 };
+	for (unsigned int threads : { 1u, max(cores, (unsigned int)ORDER_THREADS) })
+	{
+		for (unsigned int i = 0; i < predatorCount; i++)
+		{
+			predators[i]->setPosition(start[i]);
+			predators[i]->m_claims = 0;
+			predators[i]->m_lostClaims = 0;
+		}
+
+		JobSystem jobs;
+		jobs.Start(threads);
+		unsigned int doubleClaims = 0;
+		double time = 0.0;
+		for (unsigned int frame = 0; frame < CONTENTION_FRAMES; frame++)
+		{
+			double frameStart = Now();
+			jobs.ParallelFor(predatorCount, [&](unsigned int begin, unsigned int end)
+			{
+				for (unsigned int i = begin; i < end; i++)
+					predators[i]->Update(BENCHMARK_TIMESTEP, &boids, &grid, nullptr);
+			});
+			time += Now() - frameStart;
+
+			// every target has to be claimed by the predator chasing it and no other
+			for (Predator* p : predators)
+			{
+				if (p->GetTarget() != nullptr && p->GetTarget()->GetTargetedBy() != p)
+					doubleClaims++;
+			}
+			for (Predator* p : predators)
+				p->ReleaseTarget();
+		}
+
+		unsigned long long claims = 0;
+		unsigned long long lost = 0;
+		for (Predator* p : predators)
+		{
+			claims += p->GetClaims();
+			lost += p->GetLostClaims();
+		}
+
+		sprintf_s(sz, "predator contention, %u boids, %u predators, %u threads: %.3f ms/frame, %.1f claims a frame, %.1f lost to another predator, %u targets claimed by someone else",
+			boidCount, predatorCount, threads, time * 1000.0 / CONTENTION_FRAMES, (double)claims / CONTENTION_FRAMES, (double)lost / CONTENTION_FRAMES, doubleClaims);
+		Debug::Print(string(sz));
+	}
+
+	DeletePredators(predators);
+	DeleteBoids(boids);
+}
+
+void Benchmark::PipelinedFrames(unsigned int boidCount)
+{
+	vector<Predator*> predators;
+
+	srand(1);
+	vecBoid boids = CreateBoids(boidCount, BENCHMARK_SPACING);
+	SpatialGrid grid(NEARBY_DISTANCE);
+	Boid::SetDoubleBuffered(true);
+
+	// the flock's part of StepSimulation
+	auto step = [&](float t, SimulationSnapshot& snapshot)
+	{
+		Boid::SwapStates(boids);
+		grid.Build(boids);
+		for (Boid* b : boids)
+			b->Update(t, &boids, &grid, &predators, nullptr);
+
+		snapshot.boids.resize(boids.size());
+		for (unsigned int i = 0; i < boids.size(); i++)
+		{
+			snapshot.boids[i].previous = *boids[i]->ReadPosition();
+			snapshot.boids[i].position = *boids[i]->getPosition();
+		}
+	};
+
+	// all of drawing but the d3d calls, then waiting for the next display refresh
+	double refresh = 1.0 / PIPELINE_DISPLAY_HZ;
+	float checksum = 0.0f;
+	auto draw = [&](const SimulationSnapshot& snapshot, double frameStart)
+	{
+		float alpha = snapshot.GetAlpha(SimulationThread::Now());
+		for (const SnapshotObject& b : snapshot.boids)
+			checksum += SimulationSnapshot::Interpolate(b, alpha).x;
+		double wait = frameStart + refresh - SimulationThread::Now();
+		if (wait > 0.0)
+			this_thread::sleep_for(chrono::duration<double>(wait));
+	};
+
+	// both on this thread, as Render did
+	SimulationSnapshot serialSnapshot;
+	unsigned int serialFrames = 0;
+	double start = SimulationThread::Now();
+	while (SimulationThread::Now() - start < PIPELINE_SECONDS)
+	{
+		double frameStart = SimulationThread::Now();
+		step(BENCHMARK_TIMESTEP, serialSnapshot);
+		serialSnapshot.time = SimulationThread::Now();
+		draw(serialSnapshot, frameStart);
+		serialFrames++;
+	}
+	double serialHz = serialFrames / (SimulationThread::Now() - start);
+
+	// the simulation on its own thread at its own rate, this thread drawing whatever it last published
+	SimulationThread simulation;
+	unsigned int renderFrames = 0;
+	unsigned int freshFrames = 0;
+	simulation.Start(1.0f / BENCHMARK_TIMESTEP, step);
+	start = SimulationThread::Now();
+	while (SimulationThread::Now() - start < PIPELINE_SECONDS)
+	{
+		double frameStart = SimulationThread::Now();
+		if (simulation.Acquire())
+			freshFrames++;
+		draw(simulation.GetSnapshot(), frameStart);
+		renderFrames++;
+	}
+	double elapsed = SimulationThread::Now() - start;
+	unsigned long long steps = simulation.GetSteps();
+	simulation.Stop();
+
+	char sz[1024] = { 0 };
+	sprintf_s(sz, "pipelined frames, %u boids, %.0f Hz display: one thread %.1f Hz, simulation thread %.1f Hz (aiming for %.0f) with render %.1f Hz, %u of %u frames had a new snapshot",
+		boidCount, PIPELINE_DISPLAY_HZ, serialHz, steps / elapsed, 1.0f / BENCHMARK_TIMESTEP, renderFrames / elapsed, freshFrames, renderFrames);
+	Debug::Print(string(sz));
+
+	Boid::SetDoubleBuffered(false);
+	DeleteBoids(boids);
+}
+
+void Benchmark::MassDeath(unsigned int boidCount, unsigned int deadPercent)
+{
+	// the same boids killed for both, out of a pool like main's
+	srand(1);
+	float size = sqrtf((float)boidCount) * BENCHMARK_SPACING;
+	EntityPool<Boid> pool;
+	pool.Create(boidCount);
+	vecBoid boids;
+	for (unsigned int i = 0; i < boidCount; i++)
+	{
+		Boid* b = pool.Spawn();
+		b->setPosition(XMFLOAT3(((float)rand() / (float)RAND_MAX) * size - (size * 0.5f), ((float)rand() / (float)RAND_MAX) * size - (size * 0.5f), 0));
+		b->isAlive = (unsigned int)(rand() % 100) >= deadPercent;
+		boids.push_back(b);
+	}
+	unsigned int dead = 0;
+	vecBoid living;
+	for (Boid* b : boids)
+	{
+		if (b->isAlive)
+			living.push_back(b);
+		else
+			dead++;
+	}
+	SpatialGrid grid(NEARBY_DISTANCE);
+
+	// erase in the loop, as UpdateBoids did, on a copy so the same boids are left for the batched pass
+	// only the first few deaths are timed, each one shifts the rest of the list down (and skips the boid that lands in its slot)
+	vecBoid erased = boids;
+	double gridTime = 0.0;
+	unsigned int sampled = 0;
+	unsigned int skipped = 0;
+	double start = Now();
+	for (unsigned int i = 0; i < erased.size() && sampled < MASS_DEATH_SAMPLE; i++)
+	{
+		if (erased[i]->isAlive)
+			continue;
+		erased.erase(remove(erased.begin(), erased.end(), erased[i]), erased.end());
+		if (i < erased.size())
+			skipped++;
+		if (sampled < MASS_DEATH_GRID_SAMPLE)
+		{
+			double gridStart = Now();
+			grid.Build(erased);
+			gridTime += Now() - gridStart;
+		}
+		sampled++;
+	}
+	double eraseTime = (Now() - start - gridTime) / sampled;
+	double rebuildTime = gridTime / min(sampled, (unsigned int)MASS_DEATH_GRID_SAMPLE);
+
+	// tombstoned, then one stable pass and one grid build
+	unsigned int buried = 0;
+	start = Now();
+	unsigned int removed = Boid::RemoveDead(boids, [&](Boid* b)
+	{
+		pool.Despawn(b);
+		buried++;
+	});
+	double compactTime = Now() - start;
+	grid.Build(boids);
+	double batchedTime = Now() - start;
+
+	// the living are all there, in the order they were in
+	bool same = removed == dead && buried == dead && boids == living;
+
+	char sz[1024] = { 0 };
+	sprintf_s(sz, "mass death, %u of %u boids: erase in the loop %.3f ms a death + %.1f ms grid rebuild, ~%.1f s for all of them (%u of %u sampled deaths skipped a boid), batched %.2f ms compaction + %.2f ms one grid build, %s",
+		dead, boidCount, eraseTime * 1000.0, rebuildTime * 1000.0, (eraseTime + rebuildTime) * dead, skipped, sampled,
+		compactTime * 1000.0, (batchedTime - compactTime) * 1000.0, same ? "same living boids in the same order" : "LIVING BOIDS DIFFER");
+	Debug::Print(string(sz));
+}
+
+vecBoid Benchmark::CreateBoids(unsigned int count, float spacing)
+{
+	// spread the boids over a square that grows with the count so the density stays the same
+	float size = sqrtf((float)count) * spacing;
+
+	vecBoid boids;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		Boid* b = new Boid();
+		float x = ((float)rand() / (float)RAND_MAX) * size - (size * 0.5f);
+		float y = ((float)rand() / (float)RAND_MAX) * size - (size * 0.5f);
+		b->setPosition(XMFLOAT3(x, y, 0));
+		boids.push_back(b);
+	}
+	return boids;
+}
+
+vector<Predator*> Benchmark::CreatePredators(unsigned int count, float size)
+{
+	vector<Predator*> predators;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		Predator* p = new Predator();
+		float x = ((float)rand() / (float)RAND_MAX) * size - (size * 0.5f);
+		float y = ((float)rand() / (float)RAND_MAX) * size - (size * 0.5f);
+		p->setPosition(XMFLOAT3(x, y, 0));
+		predators.push_back(p);
+	}
+	return predators;
+}
+
+void Benchmark::DeletePredators(vector<Predator*>& predators)
+{
+	for (Predator* p : predators)
+	{
+		delete p;
+	}
+	predators.clear();
+}
+
+void Benchmark::DeleteBoids(vecBoid& boids)
+{
+	for (Boid* b : boids)
+	{
+		delete b;
+	}
+	boids.clear();
+}
+
+double Benchmark::Now()
+{
+	return chrono::duration<double>(chrono::high_resolution_clock::now().time_since_epoch()).count();
+}
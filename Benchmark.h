@@ -0,0 +1,42 @@
+#pragma once
+
+#include "Boid.h"
+#include "Predator.h"
+
+// headless timings of the simulation, run with "Boids.exe -benchmark"
+// results are written with Debug::Print so they show in the debugger output window
+class Benchmark
+{
+public:
+	static void							Run();
+
+private:
+	static void							SpatialGridVsBruteForce(unsigned int boidCount);
+	static void							NeighbourListSkin(unsigned int boidCount, float skin);
+	static void							MortonReorder(unsigned int boidCount, bool sorted, bool pooled);
+	static void							FusedSteering(unsigned int boidCount);
+	static void							RulePipelines(unsigned int boidCount);
+	static void							TopologicalDensity(unsigned int boidCount, float spacing);
+	static void							BarnesHut(unsigned int boidCount, unsigned int predatorCount, float theta);
+	static void							CellAggregateFlocking(unsigned int boidCount, float spacing);
+	static void							PredatorIndex(unsigned int boidCount, unsigned int predatorCount);
+	static void							PerceptionConeAgreement(unsigned int batches);
+	static void							PopulationFootprint(unsigned int boidCount);
+	static void							SteeringKernelThroughput(unsigned int boidCount);
+	static void							DimensionSpecialisation(unsigned int boidCount);
+	static void							QuantisedStorage(unsigned int boidCount, unsigned int steps);
+	static void							LargePageArrays(unsigned int boidCount, unsigned int frames);
+	static void							EntityChurn(unsigned int boidCount, unsigned int deathsPerSecond);
+	static void							FrameAllocations(unsigned int boidCount, bool neighbourLists);
+	static void							DoubleBufferedOrder(unsigned int boidCount);
+	static void							ThreadScaling(unsigned int boidCount, unsigned int frames);
+	static void							PredatorContention(unsigned int boidCount, unsigned int predatorCount);
+	static void							PipelinedFrames(unsigned int boidCount);
+	static void							MassDeath(unsigned int boidCount, unsigned int deadPercent);
+
+	static vecBoid						CreateBoids(unsigned int count, float spacing);
+	static vector<Predator*>			CreatePredators(unsigned int count, float size);
+	static void							DeleteBoids(vecBoid& boids);
+	static void							DeletePredators(vector<Predator*>& predators);
+	static double						Now();
+};
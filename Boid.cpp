@@ -1,30 +1,161 @@
 #include "Boid.h"
 #include "Predator.h"
 #include "Debug.h"
+#include "CellAggregates.h"
 
-#define NEARBY_DISTANCE	50.0f // how far boids can see
+bool Boid::fusedSteering = true;
+unsigned int Boid::topologicalNeighbours = 0;
+CellAggregates* Boid::cellAggregates = nullptr;
+bool Boid::flockmateFOV = false;
+const WorldBounds* Boid::worldBounds = nullptr;
+bool Boid::doubleBuffered = false;
+vector<BoidTraits> Boid::traitTable;
+vector<unsigned int> Boid::freeTraits;
 
 Boid::Boid()
 {
 	m_scale = 1.0f;
-	speed = SPEED_DEFAULT + (rand() % 100);
-	FOV += (rand() % 225);
-	fleeDistance += (rand() % 100);
+
+	if (freeTraits.empty())
+	{
+		m_traitIndex = (unsigned int)traitTable.size();
+		traitTable.push_back(BoidTraits());
+	}
+	else
+	{
+		m_traitIndex = freeTraits.back();
+		freeTraits.pop_back();
+	}
+
+	BoidTraits traits;
+	RandomTraits(traits.speed, traits.FOV, traits.fleeDistance);
+	SetTraits(traits);
+	m_random = RandomSeed();
 	CreateRandomDirection();
 }
 
 Boid::~Boid()
 {
+	freeTraits.push_back(m_traitIndex);
 }
 
-void Boid::CreateRandomDirection()
+void Boid::Respawn()
+{
+	BoidTraits traits;
+	RandomTraits(traits.speed, traits.FOV, traits.fleeDistance);
+	SetTraits(traits);
+	m_random = RandomSeed();
+	CreateRandomDirection();
+
+	isAlive = true;
+	spotPredator = false;
+	// whoever was chasing the boid in this slot let go of it when it was removed
+	targetedBy = nullptr;
+	// the cache belongs to the NeighbourList, this boid just stops pointing into it
+	m_neighbourCache = { nullptr, 0 };
+	m_neighbourCacheValid = false;
+	m_inAggregates = false;
+}
+
+void Boid::SwapState(Boid& other)
+{
+	swap(m_position, other.m_position);
+	swap(m_World, other.m_World);
+	swap(m_scale, other.m_scale);
+	swap(m_direction, other.m_direction);
+	swap(m_hot, other.m_hot);
+	swap(isAlive, other.isAlive);
+	swap(spotPredator, other.spotPredator);
+	swap(m_neighbourCacheValid, other.m_neighbourCacheValid);
+	swap(m_read, other.m_read);
+	swap(m_neighbourCache, other.m_neighbourCache);
+	swap(m_aggregatePosition, other.m_aggregatePosition);
+	swap(m_aggregateDirection, other.m_aggregateDirection);
+	swap(m_inAggregates, other.m_inAggregates);
+	swap(m_random, other.m_random);
+	swap(traitTable[m_traitIndex], traitTable[other.m_traitIndex]);
+
+	Predator* hunter = targetedBy.load(memory_order_relaxed);
+	Predator* otherHunter = other.targetedBy.load(memory_order_relaxed);
+	targetedBy.store(otherHunter, memory_order_relaxed);
+	other.targetedBy.store(hunter, memory_order_relaxed);
+	if (hunter != nullptr)
+		hunter->TargetMoved(&other);
+	if (otherHunter != nullptr)
+		otherHunter->TargetMoved(this);
+}
+
+void Boid::SwapStates(const vecBoid& boids)
+{
+	// the live state is the write buffer, it is what gets drawn and what the grid is built from,
+	// so swapping is copying it into the read buffer
+	for (Boid* b : boids)
+	{
+		b->m_read.position = b->m_position;
+		b->m_read.direction = b->m_direction;
+	}
+}
+
+void Boid::SetTraits(const BoidTraits& traits)
+{
+	traitTable[m_traitIndex] = traits;
+
+	m_hot.separationScale = traits.separationScale;
+	m_hot.alignmentScale = traits.alignmentScale;
+	m_hot.cohesionScale = traits.cohesionScale;
+	m_hot.fleeScale = traits.fleeScale;
+	m_hot.cosHalfFOV = PerceptionCone::CosHalfAngle(traits.FOV);
+	m_hot.fleeDistanceSq = traits.fleeDistance * traits.fleeDistance;
+	m_hot.killDistanceSq = traits.killDistance * traits.killDistance;
+	m_hot.predatorReach = max(traits.fleeDistance, traits.killDistance);
+	// worked out on the first Update
+	m_hot.step = 0.0f;
+	m_hot.stepTime = -1.0f;
+}
+
+void Boid::RandomTraits(float& speed, float& FOV, float& fleeDistance)
+{
+	speed = SPEED_DEFAULT + (rand() % 100);
+	FOV = FOV_DEFAULT + (rand() % 225);
+	fleeDistance = FLEE_DISTANCE_MIN + (rand() % 100);
+}
+
+XMFLOAT3 Boid::RandomDirection()
 {
 	float x = (float)(rand() % 10);
 	x -= 5;
 	float y = (float)(rand() % 10);
 	y -= 5;
 	float z = 0;
-	SetDirection(XMFLOAT3(x, y, z));
+	return XMFLOAT3(x, y, z);
+}
+
+XMFLOAT3 Boid::RandomDirection(unsigned int& stream)
+{
+	float x = (float)(NextRandom(stream) % 10);
+	x -= 5;
+	float y = (float)(NextRandom(stream) % 10);
+	y -= 5;
+	float z = 0;
+	return XMFLOAT3(x, y, z);
+}
+
+unsigned int Boid::NextRandom(unsigned int& stream)
+{
+	// step an lcg and hash its state, the low bits of a bare lcg repeat too quickly for % 10
+	stream = stream * 1664525u + 1013904223u;
+	unsigned int x = stream;
+	x ^= x >> 16;
+	x *= 0x7feb352du;
+	x ^= x >> 15;
+	x *= 0x846ca68bu;
+	x ^= x >> 16;
+	return x;
+}
+
+void Boid::CreateRandomDirection()
+{
+	SetDirection(RandomDirection(m_random));
 }
 
 void Boid::SetDirection(XMFLOAT3 direction)
@@ -34,22 +165,41 @@ void Boid::SetDirection(XMFLOAT3 direction)
 	XMStoreFloat3(&m_direction, v);
 }
 
-void Boid::Update(float t, vecBoid* boidList, vector<Predator*> predatorList)
+void Boid::Update(float t, vecBoid* boidList, SpatialGrid* grid, vector<Predator*>* predatorList, SpatialGrid* predatorGrid)
 {
-	// create a list of nearby boids
-	vecBoid nearBoids = NearbyBoids(boidList);
+	XMFLOAT3  vSeparation;
+	XMFLOAT3  vAlignment;
+	XMFLOAT3  vCohesion;
+	Boid* nearest = nullptr;
 
 	// NOTE these functions should always return a normalised vector
-	XMFLOAT3  vSeparation = CalculateSeparationVector(&nearBoids); // vector away from nearby boids
-	XMFLOAT3  vAlignment = CalculateAlignmentVector(&nearBoids); // average direction of nearby boids
-	XMFLOAT3  vCohesion = CalculateCohesionVector(&nearBoids); // vector towards average position of nearby boids
-	XMFLOAT3  vFlee = CalculateFleeVector(predatorList); // vector away from nearby predators
+	if (cellAggregates != nullptr)
+	{
+		// exact separation, alignment and cohesion approximated from the cell sums
+		CalculateAggregateVectors(boidList, grid, vSeparation, vAlignment, vCohesion, nearest);
+	}
+	else if (fusedSteering)
+	{
+		// one pass over the nearby boids for all three rules
+		CalculateFlockingVectors(boidList, grid, vSeparation, vAlignment, vCohesion, nearest);
+	}
+	else
+	{
+		// create a list of nearby boids, it only has to last until the rules have read it
+		ArenaScope scope(FrameArena::Frame());
+		BoidSpan nearBoids = NearbyBoids(boidList, grid, FrameArena::Frame());
+
+		vSeparation = CalculateSeparationVector(nearBoids); // vector away from nearby boids
+		vAlignment = CalculateAlignmentVector(nearBoids); // average direction of nearby boids
+		vCohesion = CalculateCohesionVector(nearBoids); // vector towards average position of nearby boids
+	}
+	XMFLOAT3  vFlee = CalculateFleeVector(predatorList, predatorGrid); // vector away from nearby predators
 
 	// multiply each vector by a scale to make some more important than others
-	vSeparation = MultiplyFloat3(vSeparation, separationScale);
-	vAlignment = MultiplyFloat3(vAlignment, alignmentScale);
-	vCohesion = MultiplyFloat3(vCohesion, cohesionScale);
-	vFlee = MultiplyFloat3(vFlee, fleeScale);
+	vSeparation = MultiplyFloat3(vSeparation, m_hot.separationScale);
+	vAlignment = MultiplyFloat3(vAlignment, m_hot.alignmentScale);
+	vCohesion = MultiplyFloat3(vCohesion, m_hot.cohesionScale);
+	vFlee = MultiplyFloat3(vFlee, m_hot.fleeScale);
 
 	// add all four together and normalise
 	XMFLOAT3 forces = XMFLOAT3(0.0f, 0.0f, 0.0f);
@@ -57,20 +207,38 @@ void Boid::Update(float t, vecBoid* boidList, vector<Predator*> predatorList)
 	forces = AddFloat3(forces, vAlignment);
 	forces = AddFloat3(forces, vCohesion);
 	forces = AddFloat3(forces, vFlee);
+	ApplyForces(t, forces, nearest, boidList, grid);
+}
+
+void Boid::ApplyForces(float t, XMFLOAT3& forces, Boid* nearest, vecBoid* boidList, SpatialGrid* grid)
+{
 	m_direction = AddFloat3(m_direction, forces);
 	if (MagnitudeFloat3(m_direction) != 0)
 	{
 		m_direction = NormaliseFloat3(m_direction);
 	}
+	else if (nearest != nullptr)
+	{
+		// the flocking pass already found the nearest boid
+		XMFLOAT3 directionNearest = NearestImage(*nearest->ReadPosition());
+		directionNearest = SubtractFloat3(directionNearest, m_position);
+		m_direction = NormaliseFloat3(directionNearest);
+	}
 	else
 	{
-		m_direction = VecToNearbyBoids(boidList); // if no direction, go to the nearest boid
+		m_direction = VecToNearbyBoids(boidList, grid); // if no direction, go to the nearest boid
 
 		if (MagnitudeFloat3(m_direction) == 0) // if still no direction (no nearby boids), create random direction
 			CreateRandomDirection();
 	}
 
-	XMFLOAT3 dir = MultiplyFloat3(m_direction, t * speed);
+	// the timestep is usually the same every frame, so the speed only has to be read when it isn't
+	if (t != m_hot.stepTime)
+	{
+		m_hot.step = t * GetTraits().speed;
+		m_hot.stepTime = t;
+	}
+	XMFLOAT3 dir = MultiplyFloat3(m_direction, m_hot.step);
 	m_position = AddFloat3(m_position, dir);
 
 	m_position.z = 0;
@@ -79,24 +247,21 @@ void Boid::Update(float t, vecBoid* boidList, vector<Predator*> predatorList)
 	DrawableGameObject::update(t);
 }
 
-XMFLOAT3 Boid::CalculateSeparationVector(vecBoid* boidList)
+XMFLOAT3 Boid::CalculateSeparationVector(BoidSpan boids)
 {
-	if (boidList == nullptr)
-		return XMFLOAT3(0, 0, 0);
-
-	float desiredSeparation = 12.5f;
+	float desiredSeparation = SEPARATION_DISTANCE;
 	XMFLOAT3 nearby = XMFLOAT3(0, 0, 0);
 	int count = 0;
 
-	for (Boid* b : *boidList)
+	for (Boid* b : boids)
 	{
 		// find the distance between boids
-		XMFLOAT3 vB = *(b->getPosition());
+		XMFLOAT3 vB = NearestImage(*b->ReadPosition());
 		XMFLOAT3 vDiff = SubtractFloat3(m_position, vB);
 		float l = MagnitudeFloat3(vDiff);
 
-		// ignore self (distance of 0 could only be self)
-		if (l < 0)
+		// a boid exactly on top of this one gives no direction to separate in (and would divide by 0)
+		if (l <= 0)
 		{
 			continue;
 		}
@@ -122,49 +287,255 @@ XMFLOAT3 Boid::CalculateSeparationVector(vecBoid* boidList)
 	return m_direction;
 }
 
-XMFLOAT3 Boid::CalculateAlignmentVector(vecBoid* boidList)
+void Boid::CalculateFlockingVectors(vecBoid* boidList, SpatialGrid* grid, XMFLOAT3& separation, XMFLOAT3& alignment, XMFLOAT3& cohesion, Boid*& nearest)
 {
-	XMFLOAT3 nearby = XMFLOAT3(0, 0, 0);
-	if (boidList == nullptr)
-		return nearby;
+	// same maths as the separation, alignment and cohesion functions but gathered in one pass
+	// squared distances are compared and the square root is only taken for boids close enough to separate from
+	const float nearbySq = NEARBY_DISTANCE * NEARBY_DISTANCE;
+	const float separationSq = SEPARATION_DISTANCE * SEPARATION_DISTANCE;
+
+	XMFLOAT3 separationSum = XMFLOAT3(0, 0, 0);
+	XMFLOAT3 directionSum = XMFLOAT3(0, 0, 0);
+	XMFLOAT3 positionSum = XMFLOAT3(0, 0, 0);
+	int separationCount = 0;
+	int count = 0;
+	float nearestSq = FLT_MAX;
+	nearest = nullptr;
 
-	for (Boid* b : *boidList)
+	auto accumulate = [&](Boid* b, XMFLOAT3& vB, XMFLOAT3& vDiff, float lSq)
+	{
+		// a boid exactly on top of this one gives no direction to separate in (and would divide by 0)
+		if (lSq < separationSq && lSq > 0.0f)
+		{
+			float l = sqrt(lSq);
+			XMFLOAT3 dif = DivideFloat3(vDiff, l);
+			dif = DivideFloat3(dif, l); // closer boids will have a greater weight
+			separationSum = AddFloat3(separationSum, dif);
+			separationCount++;
+		}
+
+		directionSum = AddFloat3(*b->ReadDirection(), directionSum);
+		positionSum = AddFloat3(vB, positionSum);
+		count++;
+
+		if (lSq < nearestSq)
+		{
+			nearestSq = lSq;
+			nearest = b;
+		}
+	};
+
+	// with a limited field of view, flockmates in range wait to be tested against the cone a batch at a time
+	Boid* waitingBoid[PERCEPTION_BATCH];
+	XMFLOAT3 waitingPosition[PERCEPTION_BATCH];
+	XMFLOAT3 waitingDiff[PERCEPTION_BATCH];
+	float waitingLSq[PERCEPTION_BATCH];
+	float toX[PERCEPTION_BATCH];
+	float toY[PERCEPTION_BATCH];
+	unsigned int waiting = 0;
+
+	auto flush = [&]()
 	{
-		nearby = AddFloat3(*b->GetDirection(), nearby);
+		unsigned int inside = PerceptionCone::InsideBatch(m_direction.x, m_direction.y, m_hot.cosHalfFOV, toX, toY, waiting);
+		for (unsigned int i = 0; i < waiting; i++)
+		{
+			if (inside & (1u << i))
+				accumulate(waitingBoid[i], waitingPosition[i], waitingDiff[i], waitingLSq[i]);
+		}
+		waiting = 0;
+	};
+
+	auto visit = [&](Boid* b, bool checkRange)
+	{
+		if (b == this)
+			return;
+
+		XMFLOAT3 vB = NearestImage(*b->ReadPosition());
+		XMFLOAT3 vDiff = SubtractFloat3(m_position, vB);
+		float lSq = (vDiff.x * vDiff.x) + (vDiff.y * vDiff.y) + (vDiff.z * vDiff.z);
+		if (checkRange && lSq >= nearbySq)
+			return;
+
+		if (flockmateFOV)
+		{
+			waitingBoid[waiting] = b;
+			waitingPosition[waiting] = vB;
+			waitingDiff[waiting] = vDiff;
+			waitingLSq[waiting] = lSq;
+			toX[waiting] = -vDiff.x;
+			toY[waiting] = -vDiff.y;
+			if (++waiting == PERCEPTION_BATCH)
+				flush();
+			return;
+		}
+
+		accumulate(b, vB, vDiff, lSq);
+	};
+
+	if (topologicalNeighbours > 0)
+	{
+		// the k nearest at any distance, so the cost doesn't grow with how crowded the flock is
+		pair<float, unsigned int> heap[TOPOLOGICAL_MAX_NEIGHBOURS];
+		unsigned int found = NearestBoids(boidList, grid, heap);
+		for (unsigned int i = 0; i < found; i++)
+			visit((*boidList)[heap[i].second], false);
+	}
+	else if (m_neighbourCacheValid)
+	{
+		for (Boid* b : m_neighbourCache)
+			visit(b, true);
+	}
+	else if (grid != nullptr)
+	{
+		// the grid has already checked the range
+		grid->ForEachInRadius(m_position, NEARBY_DISTANCE, [&](unsigned int i) { visit((*boidList)[i], false); });
+	}
+	else
+	{
+		for (Boid* b : *boidList)
+			visit(b, true);
 	}
-	if (boidList->size() > 0)
+	if (waiting > 0)
+		flush();
+
+	separation = m_direction;
+	if (MagnitudeFloat3(separationSum) > 0)
 	{
-		nearby = DivideFloat3(nearby, boidList->size());
+		separationSum = DivideFloat3(separationSum, separationCount);
+		separation = NormaliseFloat3(separationSum);
+	}
 
-		return NormaliseFloat3(nearby); // return the normalised (average) direction of nearby drawables
+	alignment = m_direction;
+	cohesion = m_direction;
+	if (count > 0)
+	{
+		// neighbours heading opposite ways, or centred right on this boid, give nothing to go on either
+		directionSum = DivideFloat3(directionSum, count);
+		if (MagnitudeFloat3(directionSum) > 0)
+			alignment = NormaliseFloat3(directionSum);
+
+		positionSum = DivideFloat3(positionSum, count);
+		positionSum = SubtractFloat3(positionSum, m_position);
+		if (MagnitudeFloat3(positionSum) > 0)
+			cohesion = NormaliseFloat3(positionSum);
 	}
-	return m_direction;
 }
 
-XMFLOAT3 Boid::CalculateCohesionVector(vecBoid* boidList)
+void Boid::CalculateAggregateVectors(vecBoid* boidList, SpatialGrid* grid, XMFLOAT3& separation, XMFLOAT3& alignment, XMFLOAT3& cohesion, Boid*& nearest)
+{
+	// separation still looks at each boid, but only the few inside SEPARATION_DISTANCE
+	const float separationSq = SEPARATION_DISTANCE * SEPARATION_DISTANCE;
+
+	XMFLOAT3 separationSum = XMFLOAT3(0, 0, 0);
+	int separationCount = 0;
+	float nearestSq = FLT_MAX;
+	nearest = nullptr;
+
+	auto visit = [&](Boid* b)
+	{
+		if (b == this)
+			return;
+
+		XMFLOAT3 vB = NearestImage(*b->ReadPosition());
+		XMFLOAT3 vDiff = SubtractFloat3(m_position, vB);
+		float lSq = (vDiff.x * vDiff.x) + (vDiff.y * vDiff.y) + (vDiff.z * vDiff.z);
+		// a boid exactly on top of this one gives no direction to separate in (and would divide by 0)
+		if (lSq >= separationSq || lSq <= 0.0f)
+			return;
+
+		float l = sqrt(lSq);
+		XMFLOAT3 dif = DivideFloat3(vDiff, l);
+		dif = DivideFloat3(dif, l); // closer boids will have a greater weight
+		separationSum = AddFloat3(separationSum, dif);
+		separationCount++;
+
+		if (lSq < nearestSq)
+		{
+			nearestSq = lSq;
+			nearest = b;
+		}
+	};
+
+	if (grid != nullptr)
+	{
+		grid->ForEachInRadius(m_position, SEPARATION_DISTANCE, [&](unsigned int i) { visit((*boidList)[i]); });
+	}
+	else
+	{
+		for (Boid* b : *boidList)
+			visit(b);
+	}
+
+	separation = m_direction;
+	if (MagnitudeFloat3(separationSum) > 0)
+	{
+		separationSum = DivideFloat3(separationSum, separationCount);
+		separation = NormaliseFloat3(separationSum);
+	}
+
+	// alignment and cohesion from the cells around this boid
+	XMFLOAT3 positionSum;
+	XMFLOAT3 directionSum;
+	float count;
+	cellAggregates->Gather(this, NEARBY_DISTANCE, positionSum, directionSum, count);
+
+	alignment = m_direction;
+	cohesion = m_direction;
+	if (count > 0.0f)
+	{
+		directionSum = DivideFloat3(directionSum, count);
+		if (MagnitudeFloat3(directionSum) > 0)
+			alignment = NormaliseFloat3(directionSum);
+
+		positionSum = DivideFloat3(positionSum, count);
+		positionSum = SubtractFloat3(positionSum, m_position);
+		if (MagnitudeFloat3(positionSum) > 0)
+			cohesion = NormaliseFloat3(positionSum);
+	}
+}
+
+XMFLOAT3 Boid::CalculateAlignmentVector(BoidSpan boids)
 {
 	XMFLOAT3 nearby = XMFLOAT3(0, 0, 0);
+	for (Boid* b : boids)
+	{
+		nearby = AddFloat3(*b->ReadDirection(), nearby);
+	}
+	if (boids.size() > 0)
+	{
+		nearby = DivideFloat3(nearby, boids.size());
 
-	if (boidList == nullptr)
-		return nearby;
+		// neighbours heading opposite ways give nothing to go on
+		if (MagnitudeFloat3(nearby) > 0)
+			return NormaliseFloat3(nearby); // return the normalised (average) direction of nearby drawables
+	}
+	return m_direction;
+}
+
+XMFLOAT3 Boid::CalculateCohesionVector(BoidSpan boids)
+{
+	XMFLOAT3 nearby = XMFLOAT3(0, 0, 0);
 
 	// calculate average position of nearby
-	for (Boid* boid : *boidList) 
+	for (Boid* boid : boids) 
 	{
-		nearby = AddFloat3(*boid->getPosition(), nearby);
+		XMFLOAT3 vB = NearestImage(*boid->ReadPosition());
+		nearby = AddFloat3(vB, nearby);
 	}
-	if (boidList->size() > 0)
+	if (boids.size() > 0)
 	{
-		nearby = DivideFloat3(nearby, boidList->size()); // this is the avg position
+		nearby = DivideFloat3(nearby, boids.size()); // this is the avg position
 
 		nearby = SubtractFloat3(nearby, m_position); // this gets the direction to the avg position
 
-		return NormaliseFloat3(nearby); // nearby is the direction to where the other drawables are
+		// neighbours centred right on this boid give nothing to go on
+		if (MagnitudeFloat3(nearby) > 0)
+			return NormaliseFloat3(nearby); // nearby is the direction to where the other drawables are
 	}
 	return m_direction;
 }
 
-XMFLOAT3 Boid::VecToNearbyBoids(vecBoid* boidList)
+XMFLOAT3 Boid::VecToNearbyBoids(vecBoid* boidList, SpatialGrid* grid)
 {
 	if (boidList == nullptr)
 		return XMFLOAT3(0, 0, 0);
@@ -174,6 +545,18 @@ XMFLOAT3 Boid::VecToNearbyBoids(vecBoid* boidList)
 	XMFLOAT3 directionNearest;
 	float shortestDistance = FLT_MAX;
 
+	if (grid != nullptr)
+	{
+		// search the grid outwards from this boid instead of checking the whole list
+		int index = grid->Nearest(m_position, [&](unsigned int i) { return (*boidList)[i] == this; });
+		if (index == -1)
+			return m_direction;
+
+		directionNearest = NearestImage(*(*boidList)[index]->ReadPosition());
+		directionNearest = SubtractFloat3(directionNearest, m_position);
+		return NormaliseFloat3(directionNearest);
+	}
+
 	for (Boid* b : *boidList)
 	{
 		// ignore self
@@ -187,7 +570,7 @@ XMFLOAT3 Boid::VecToNearbyBoids(vecBoid* boidList)
 		else
 		{
 			// calculate the distance to each boid and find the shortest
-			XMFLOAT3 vB = *(b->getPosition());
+			XMFLOAT3 vB = NearestImage(*b->ReadPosition());
 			XMFLOAT3 vDiff = SubtractFloat3(m_position, vB);
 			float l = MagnitudeFloat3(vDiff);
 			if (l < shortestDistance)
@@ -201,7 +584,8 @@ XMFLOAT3 Boid::VecToNearbyBoids(vecBoid* boidList)
 	if (nearest != nullptr)
 	{
 		// get the direction from nearest boid to current boid
-		directionNearest = SubtractFloat3(*nearest->getPosition(), m_position);
+		directionNearest = NearestImage(*nearest->ReadPosition());
+		directionNearest = SubtractFloat3(directionNearest, m_position);
 		return NormaliseFloat3(directionNearest);
 	}
 
@@ -209,51 +593,81 @@ XMFLOAT3 Boid::VecToNearbyBoids(vecBoid* boidList)
 	return m_direction;
 }
 
-XMFLOAT3 Boid::CalculateFleeVector(vector<Predator*> predatorList)
+XMFLOAT3 Boid::CalculateFleeVector(vector<Predator*>* predatorList, SpatialGrid* predatorGrid)
 {
-	if (predatorList.empty())
+	if (predatorList == nullptr || predatorList->empty())
 		return XMFLOAT3(0, 0, 0);
 
 	XMFLOAT3 dir = XMFLOAT3(0, 0, 0);
+	spotPredator = false;
 
-	for (Predator* p : predatorList)
+	// predators in flee range wait here to be tested against the field of view a batch at a time
+	XMFLOAT3 waitingDiff[PERCEPTION_BATCH];
+	float toX[PERCEPTION_BATCH];
+	float toY[PERCEPTION_BATCH];
+	unsigned int waiting = 0;
+
+	auto flush = [&]()
 	{
-		// calculate the distance to each predator and flee if too close
-		XMFLOAT3 vP = *(p->getPosition());
-		XMFLOAT3 vDiff = SubtractFloat3(m_position, vP);
-		
-		float l = MagnitudeFloat3(vDiff);
-		if (l > killDistance)
+		unsigned int inside = PerceptionCone::InsideBatch(m_direction.x, m_direction.y, m_hot.cosHalfFOV, toX, toY, waiting);
+		for (unsigned int i = 0; i < waiting; i++)
 		{
-			spotPredator = false;
-			if (l < fleeDistance)
+			if (inside & (1u << i))
 			{
-				XMFLOAT3 toPredator = SubtractFloat3(vP, m_position);
-				if (CompareAngle(m_direction, toPredator, FOV))
-				{
-					spotPredator = true;
-				}
+				spotPredator = true;
+				dir = AddFloat3(dir, waitingDiff[i]);
 			}
+		}
+		waiting = 0;
+	};
 
-			if (spotPredator)
+	auto check = [&](Predator* p)
+	{
+		// calculate the distance to each predator and flee if too close
+		XMFLOAT3 vP = NearestImage(*p->getPosition());
+		XMFLOAT3 vDiff = SubtractFloat3(m_position, vP);
+		
+		float lSq = (vDiff.x * vDiff.x) + (vDiff.y * vDiff.y) + (vDiff.z * vDiff.z);
+		if (lSq > m_hot.killDistanceSq)
+		{
+			if (lSq < m_hot.fleeDistanceSq)
 			{
-				dir = AddFloat3(dir, vDiff);
+				waitingDiff[waiting] = vDiff;
+				toX[waiting] = -vDiff.x;
+				toY[waiting] = -vDiff.y;
+				if (++waiting == PERCEPTION_BATCH)
+					flush();
 			}
 		}
 		else
 		{
-			if (canDie)
+			if (GetTraits().canDie)
 				isAlive = false;
 			else
 				dir = AddFloat3(dir, vDiff);
 		}
+	};
+
+	if (predatorGrid != nullptr)
+	{
+		// predators further away than fleeDistance are ignored anyway, so only the cells in range are checked
+		predatorGrid->ForEachInRadius(m_position, m_hot.predatorReach, [&](unsigned int i) { check((*predatorList)[i]); });
 	}
+	else
+	{
+		for (Predator* p : *predatorList)
+			check(p);
+	}
+	if (waiting > 0)
+		flush();
+
 	if(MagnitudeFloat3(dir) > 0)
 		return dir;
 	
 	return m_direction;
 }
 
+// no longer used for flee tests (see PerceptionCone), kept as the reference the benchmark checks against
 bool Boid::CompareAngle(XMFLOAT3 pos1, XMFLOAT3 pos2, float range)
 {
 	// get angle in degrees from vectors
@@ -370,74 +784,94 @@ XMFLOAT3 Boid::NormaliseFloat3(XMFLOAT3& f1)
 	return f1;
 }
 
-vecBoid Boid::NearbyBoids(vecBoid* boidList)
+unsigned int Boid::NearestBoids(vecBoid* boidList, SpatialGrid* grid, pair<float, unsigned int>* heap)
 {
-	vecBoid nearBoids;
+	auto isSelf = [&](unsigned int i) { return (*boidList)[i] == this; };
+
+	if (grid != nullptr)
+		return grid->NearestK(m_position, topologicalNeighbours, isSelf, heap);
+
+	// no grid - keep the k nearest of the whole list in a bounded max heap
+	unsigned int found = 0;
+	for (unsigned int i = 0; i < boidList->size(); i++)
+	{
+		XMFLOAT3 vB = NearestImage(*(*boidList)[i]->ReadPosition());
+		XMFLOAT3 vDiff = SubtractFloat3(m_position, vB);
+		float lSq = (vDiff.x * vDiff.x) + (vDiff.y * vDiff.y) + (vDiff.z * vDiff.z);
+		if ((found == topologicalNeighbours && lSq >= heap[0].first) || isSelf(i))
+			continue;
+
+		if (found == topologicalNeighbours)
+		{
+			pop_heap(heap, heap + found);
+			found--;
+		}
+		heap[found++] = make_pair(lSq, i);
+		push_heap(heap, heap + found);
+	}
+	return found;
+}
+
+BoidSpan Boid::NearbyBoids(vecBoid* boidList, SpatialGrid* grid, FrameArena& arena)
+{
+	BoidSpan nearBoids = { nullptr, 0 };
 	if (boidList->size() == 0)
 		return nearBoids;
 
+	// room for the most there could be, nothing is written past the ones found
+	size_t most = m_neighbourCacheValid && topologicalNeighbours == 0 ? m_neighbourCache.size() : boidList->size();
+	Boid** nearby = arena.Allocate<Boid*>(most);
+	nearBoids.data = nearby;
+
+	if (topologicalNeighbours > 0)
+	{
+		pair<float, unsigned int> heap[TOPOLOGICAL_MAX_NEIGHBOURS];
+		unsigned int found = NearestBoids(boidList, grid, heap);
+		for (unsigned int i = 0; i < found; i++)
+			nearby[nearBoids.count++] = (*boidList)[heap[i].second];
+		return nearBoids;
+	}
+
+	if (m_neighbourCacheValid)
+	{
+		// the cache has every boid that could be in range, only the distances need checking
+		for (Boid* boid : m_neighbourCache)
+		{
+			XMFLOAT3 vB = NearestImage(*boid->ReadPosition());
+			XMFLOAT3 vDiff = SubtractFloat3(m_position, vB);
+			float l = MagnitudeFloat3(vDiff);
+			if (l < NEARBY_DISTANCE) {
+				nearby[nearBoids.count++] = boid;
+			}
+		}
+		return nearBoids;
+	}
+
+	if (grid != nullptr)
+	{
+		// only the cells around this boid need checking
+		grid->ForEachInRadius(m_position, NEARBY_DISTANCE, [&](unsigned int i)
+		{
+			Boid* boid = (*boidList)[i];
+			if (boid != this)
+				nearby[nearBoids.count++] = boid;
+		});
+		return nearBoids;
+	}
+
 	for (Boid* boid : *boidList) {
 		// ignore self
 		if (boid == this)
 			continue;
 
 		// get the distance between the two
-		XMFLOAT3 vB = *(boid->getPosition());
+		XMFLOAT3 vB = NearestImage(*boid->ReadPosition());
 		XMFLOAT3 vDiff = SubtractFloat3(m_position, vB);
 		float l = MagnitudeFloat3(vDiff);
 		if (l < NEARBY_DISTANCE) {
-			nearBoids.push_back(boid);
+			nearby[nearBoids.count++] = boid;
 		}
 	}
 
 	return nearBoids;
 }
-
-void Boid::CheckIsOnScreenAndFix(const XMMATRIX&  view, const XMMATRIX&  proj)
-{
-	XMFLOAT4 v4;
-	v4.x = m_position.x;
-	v4.y = m_position.y;
-	v4.z = m_position.z;
-	v4.w = 1.0f;
-
-	XMVECTOR vScreenSpace = XMLoadFloat4(&v4);
-	XMVECTOR vScreenSpace2 = XMVector4Transform(vScreenSpace, view);
-	XMVECTOR vScreenSpace3 = XMVector4Transform(vScreenSpace2, proj);
-
-	XMFLOAT4 v;
-	XMStoreFloat4(&v, vScreenSpace3);
-	v.x /= v.w;
-	v.y /= v.w;
-	v.z /= v.w;
-	v.w /= v.w;
-
-	float fOffset = 10; // a suitable distance to rectify position within clip space
-	if (v.x < -1 || v.x > 1 || v.y < -1 || v.y > 1)
-	{
-		if (v.x < -1 || v.x > 1) {
-			v4.x = -v4.x + (fOffset * v.x);
-		}
-		else if (v.y < -1 || v.y > 1) {
-			v4.y = -v4.y + (fOffset * v.y);
-		}
-
-		// throw a bit of randomness into the mix
-		//createRandomDirection();
-	}
-
-	// method 1 - appear on the other side
-	m_position.x = v4.x;
-	m_position.y = v4.y;
-	m_position.z = v4.z;
-
-
-	// method2 - bounce off sides and head to centre
-	//if (v.x < -1 || v.x > 1 || v.y < -1 || v.y > 1)
-	//{
-	//	m_direction = multiplyFloat3(m_direction, -1);
-	//	m_direction = normaliseFloat3(m_direction);
-	//}
-
-	return;
-}
\ No newline at end of file
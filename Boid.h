@@ -2,6 +2,11 @@
 
 #include "DrawableGameObject.h"
 #include "Timer.h"
+#include "SpatialGrid.h"
+#include "PerceptionCone.h"
+#include "FrameArena.h"
+
+#include <atomic>
 
 // default scales for the forces applied to boids
 #define SEPARATIONSCALE_DEFAULT	1.5f
@@ -10,37 +15,173 @@
 #define FLEESCALE_DEFAULT		10.0f
 
 #define SPEED_DEFAULT			100.0f
+#define FOV_DEFAULT				45.0f // degrees
+#define FLEE_DISTANCE_MIN		10.0f
+#define KILL_DISTANCE_DEFAULT	2.0f
+
+#define NEARBY_DISTANCE			50.0f // how far boids can see, also the cell size of the boid grid
+#define SEPARATION_DISTANCE		12.5f // boids closer than this push each other away
+#define FLEE_DISTANCE_MAX		110.0f // boids see predators from 10 to 109 away, also the cell size of the predator grid
+
+// the fused steering pass does the same float operations in the same order as the separate functions,
+// results only differ when the compiler contracts multiply-adds or a distance rounds across a radius
+#define FUSED_STEERING_TOLERANCE	1e-5f
+
+// topological mode - boids flock with their k nearest boids at any distance instead of everything inside NEARBY_DISTANCE
+#define TOPOLOGICAL_NEIGHBOURS		7	// starlings watch about 7 others
+#define TOPOLOGICAL_MAX_NEIGHBOURS	32
 
 class Predator;
+class CellAggregates;
+
+// what a boid is, picked when it is made, Update never reads these (see BoidHotTraits)
+struct BoidTraits
+{
+	float								speed = SPEED_DEFAULT;
+	float								FOV = FOV_DEFAULT; // degrees
+	float								fleeDistance = FLEE_DISTANCE_MIN;
+	float								killDistance = KILL_DISTANCE_DEFAULT;
+	float								separationScale = SEPARATIONSCALE_DEFAULT;
+	float								alignmentScale = ALIGNMENTSCALE_DEFAULT;
+	float								cohesionScale = COHESIONSCALE_DEFAULT;
+	float								fleeScale = FLEESCALE_DEFAULT;
+	bool								canDie = true;
+};
+
+// the traits in the form Update uses them, worked out once when they are set instead of every frame
+struct BoidHotTraits
+{
+	float								separationScale;
+	float								alignmentScale;
+	float								cohesionScale;
+	float								fleeScale;
+	float								cosHalfFOV;		// for PerceptionCone
+	float								fleeDistanceSq;
+	float								killDistanceSq;
+	float								predatorReach;	// the furthest a predator can be and still matter
+	float								step;			// speed * stepTime, only redone when the timestep changes
+	float								stepTime;
+};
+
+// what other boids see of a boid while the state is double buffered, see Boid::SwapStates
+struct BoidState
+{
+	XMFLOAT3							position;
+	XMFLOAT3							direction;
+};
 
 class Boid : public DrawableGameObject
 {
+	friend class CellAggregates;
+	template<unsigned int D> friend class BoidPopulationT;
+	friend class Benchmark;
+	friend class RulePipeline;
+
 public:
 	Boid();
 	~Boid();
+	// each boid owns a row of the trait table
+	Boid(const Boid&) = delete;
+	Boid&								operator=(const Boid&) = delete;
 
 	XMFLOAT3*							GetDirection() { return &m_direction; }
-	void								CheckIsOnScreenAndFix(const XMMATRIX&  view, const XMMATRIX&  proj);
-	void								Update(float t, vecBoid* boidList, vector<Predator*> predatorList);
+	// what another boid's update reads, the state from the last SwapStates while double buffered, otherwise the live one
+	XMFLOAT3*							ReadPosition() { return doubleBuffered ? &m_read.position : &m_position; }
+	XMFLOAT3*							ReadDirection() { return doubleBuffered ? &m_read.direction : &m_direction; }
+	void								Update(float t, vecBoid* boidList, SpatialGrid* grid, vector<Predator*>* predatorList, SpatialGrid* predatorGrid);
 
 	bool								GetAlive() { return isAlive; }
 	
-	bool								GetTargeted() { return targeted; }
-	void								SetTargeted(bool target) { targeted = target; }
+	// a predator claims a boid before chasing it so no two chase the same one, the claim is a compare and swap
+	// so predators updating on different threads can't both get it
+	bool								TryClaim(Predator* hunter) { Predator* none = nullptr; return targetedBy.compare_exchange_strong(none, hunter, memory_order_acq_rel); }
+	// only lets go if hunter still has the claim
+	void								ReleaseClaim(Predator* hunter) { targetedBy.compare_exchange_strong(hunter, nullptr, memory_order_acq_rel); }
+	Predator*							GetTargetedBy() const { return targetedBy.load(memory_order_acquire); }
+	bool								GetTargeted() const { return GetTargetedBy() != nullptr; }
+
+	float								GetSpeed() { return GetTraits().speed; }
+	const BoidTraits&					GetTraits() const { return traitTable[m_traitIndex]; }
+	void								SetTraits(const BoidTraits& traits);
+	// a new boid in this one's place for EntityPool, fresh traits and direction, keeping the mesh and trait row
+	void								Respawn();
+	// swap everything but the mesh and trait row with other, for EntityPool::Arrange, the traits are swapped
+	// between the rows and a predator chasing either boid is pointed at where its target went
+	void								SwapState(Boid& other);
+
+	// switch between the single fused neighbour pass (default) and the separate rule functions
+	static void							SetFusedSteering(bool fused) { fusedSteering = fused; }
+	// 0 uses every boid inside NEARBY_DISTANCE, otherwise only the k nearest
+	static void							SetTopologicalNeighbours(unsigned int k) { topologicalNeighbours = min(k, (unsigned int)TOPOLOGICAL_MAX_NEIGHBOURS); }
+	static unsigned int					GetTopologicalNeighbours() { return topologicalNeighbours; }
+	// ignore flockmates outside each boid's field of view, only in the fused pass
+	static void							SetFlockmateFOV(bool limited) { flockmateFOV = limited; }
+	// boids see each other across the edges of these bounds, nullptr for an open plane
+	static void							SetWorldBounds(const WorldBounds* bounds) { worldBounds = bounds; }
+	// approximate alignment and cohesion from per cell sums, nullptr for the exact rules
+	static void							SetCellAggregates(CellAggregates* aggregates) { cellAggregates = aggregates; }
+	// every Update reads the other boids as they were at the last SwapStates and only writes its own boid,
+	// so the boids can be updated in any order, on any number of threads, with the same result
+	// not with cell aggregates, whose sums are moved as each boid is updated
+	static void							SetDoubleBuffered(bool buffered) { doubleBuffered = buffered; }
+	static bool							GetDoubleBuffered() { return doubleBuffered; }
+	// the frame boundary, what each boid wrote (its live state) becomes what the next frame reads
+	// call it before the grid is built, so the grid and the read state agree
+	static void							SwapStates(const vecBoid& boids);
+	// takes the dead out of boids in one pass once the frame is done, the living keep their order (and so
+	// their Morton order), bury(b) is called on each dead boid to let go of it, returns how many there were
+	template<class F>
+	static unsigned int					RemoveDead(vecBoid& boids, const F& bury)
+	{
+		unsigned int kept = 0;
+		for (Boid* b : boids)
+		{
+			if (b->isAlive)
+				boids[kept++] = b;
+			else
+				bury(b);
+		}
+		unsigned int dead = (unsigned int)boids.size() - kept;
+		boids.erase(boids.begin() + kept, boids.end());
+		return dead;
+	}
+
+	// the random traits and (not normalised) direction each new boid gets, shared with BoidPopulation
+	static void							RandomTraits(float& speed, float& FOV, float& fleeDistance);
+	static XMFLOAT3						RandomDirection();
+	// the same from a stream of its own, for anything picked during an update, rand's state is per thread so
+	// an update that used it would depend on which worker ran it, each boid and predator keeps its own stream
+	static XMFLOAT3						RandomDirection(unsigned int& stream);
+	static unsigned int					NextRandom(unsigned int& stream);
+	// a new stream, seeded from rand while spawning
+	static unsigned int					RandomSeed() { return ((unsigned int)rand() << 16) ^ (unsigned int)rand(); }
+
+	// set by NeighbourList to a slice of its own array, NearbyBoids only checks these boids while the cache is valid
+	void								SetNeighbourCache(BoidSpan cache) { m_neighbourCache = cache; }
+	void								SetNeighbourCacheValid(bool valid) { m_neighbourCacheValid = valid; }
 
 protected:
 	void								SetDirection(XMFLOAT3 direction);
 
-	vecBoid								NearbyBoids(vecBoid* boidList);
-	XMFLOAT3							CalculateSeparationVector(vecBoid* boidList);
-	XMFLOAT3							CalculateAlignmentVector(vecBoid* boidList);
-	XMFLOAT3							CalculateCohesionVector(vecBoid* boidList);
-	XMFLOAT3							VecToNearbyBoids(vecBoid* boidList);
-	XMFLOAT3							CalculateFleeVector(vector<Predator*> predatorList);
+	// the list is allocated from arena, it lasts until the arena is released past it
+	BoidSpan							NearbyBoids(vecBoid* boidList, SpatialGrid* grid, FrameArena& arena);
+	unsigned int						NearestBoids(vecBoid* boidList, SpatialGrid* grid, pair<float, unsigned int>* heap);
+	XMFLOAT3							CalculateSeparationVector(BoidSpan boids);
+	XMFLOAT3							CalculateAlignmentVector(BoidSpan boids);
+	XMFLOAT3							CalculateCohesionVector(BoidSpan boids);
+	XMFLOAT3							VecToNearbyBoids(vecBoid* boidList, SpatialGrid* grid);
+	XMFLOAT3							CalculateFleeVector(vector<Predator*>* predatorList, SpatialGrid* predatorGrid);
+	void								CalculateFlockingVectors(vecBoid* boidList, SpatialGrid* grid, XMFLOAT3& separation, XMFLOAT3& alignment, XMFLOAT3& cohesion, Boid*& nearest);
+	void								CalculateAggregateVectors(vecBoid* boidList, SpatialGrid* grid, XMFLOAT3& separation, XMFLOAT3& alignment, XMFLOAT3& cohesion, Boid*& nearest);
 	void								CreateRandomDirection();
+	// turn by the sum of the rules' forces and move, turning to nearest (or finding the nearest) if they cancel out
+	void								ApplyForces(float t, XMFLOAT3& forces, Boid* nearest, vecBoid* boidList, SpatialGrid* grid);
 
 	bool								CompareAngle(XMFLOAT3 pos1, XMFLOAT3 pos2, float range);
 
+	// the copy of another object's position closest to this boid when the world wraps
+	XMFLOAT3							NearestImage(const XMFLOAT3& position) { return worldBounds != nullptr ? worldBounds->NearestImage(position, m_position) : position; }
+
 	XMFLOAT3							AddFloat3(XMFLOAT3& f1, XMFLOAT3& f2);
 	XMFLOAT3							SubtractFloat3(XMFLOAT3& f1, XMFLOAT3& f2);
 	XMFLOAT3							NormaliseFloat3(XMFLOAT3& f1);
@@ -48,25 +189,38 @@ protected:
 	XMFLOAT3							MultiplyFloat3(XMFLOAT3& f1, const float scalar);
 	XMFLOAT3							DivideFloat3(XMFLOAT3& f1, const float scalar);
 
+	// everything Update reads or writes every frame, kept together straight after m_position
 	XMFLOAT3							m_direction;
+	BoidHotTraits						m_hot;
+	bool								isAlive = true;
+	bool								spotPredator = false;
+	bool								m_neighbourCacheValid = false;
+	BoidState							m_read;
 
 	//unsigned int*						m_nearbyDrawables;
+	BoidSpan							m_neighbourCache = { nullptr, 0 };
+	unsigned int						m_traitIndex; // this boid's row in traitTable
+	unsigned int						m_random; // this boid's random stream, see RandomDirection
 
-	float								separationScale = SEPARATIONSCALE_DEFAULT;
-	float								alignmentScale = ALIGNMENTSCALE_DEFAULT;
-	float								cohesionScale = COHESIONSCALE_DEFAULT;
-	float								fleeScale = FLEESCALE_DEFAULT;
-	float								fleeDistance = 10.0f;
-	float								killDistance = 2.0f;
-	bool								isAlive = true;
-
-	float								speed = SPEED_DEFAULT;
-	float								FOV = 45.0f;
-	bool								spotPredator = false;
-	const bool							canDie = true;
+	// what this boid last added to the cell aggregates, so it can be taken out again
+	XMFLOAT3							m_aggregatePosition;
+	XMFLOAT3							m_aggregateDirection;
+	bool								m_inAggregates = false;
 
 	//Timer*								_timer;
+
+	static bool							fusedSteering;
+	static unsigned int					topologicalNeighbours;
+	static CellAggregates*				cellAggregates;
+	static bool							flockmateFOV;
+	static const WorldBounds*			worldBounds;
+	static bool							doubleBuffered;
+
+	// every boid's traits, away from the boids so they don't share the cache lines Update reads
+	// rows are reused as boids are deleted and made
+	static vector<BoidTraits>			traitTable;
+	static vector<unsigned int>			freeTraits;
 private:
-	bool								targeted = false; // used by predators to avoid multiple predators targeting the same boid
+	atomic<Predator*>					targetedBy{ nullptr }; // used by predators to avoid multiple predators targeting the same boid
 };
 
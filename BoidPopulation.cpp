@@ -0,0 +1,650 @@
+#include "BoidPopulation.h"
+#include "Predator.h"
+#include "MortonOrder.h"
+#include "FrameArena.h"
+
+// the first D components of v
+template<unsigned int D>
+static void FromFloat3(const XMFLOAT3& v, float* axes)
+{
+	axes[0] = v.x;
+	axes[1] = v.y;
+	if (D == 3)
+		axes[D - 1] = v.z;
+}
+
+template<unsigned int D>
+static float Length(const float* v)
+{
+	float lengthSq = 0.0f;
+	for (unsigned int k = 0; k < D; k++)
+		lengthSq += v[k] * v[k];
+	return sqrt(lengthSq);
+}
+
+template<unsigned int D>
+BoidPopulationT<D>::BoidPopulationT()
+{
+}
+
+template<unsigned int D>
+BoidPopulationT<D>::~BoidPopulationT()
+{
+}
+
+template<unsigned int D>
+unsigned int BoidPopulationT<D>::Add(const XMFLOAT3& position)
+{
+	float speed;
+	float FOV;
+	float fleeDistance;
+	Boid::RandomTraits(speed, FOV, fleeDistance);
+
+	float p[D];
+	FromFloat3<D>(position, p);
+	for (unsigned int k = 0; k < D; k++)
+	{
+		m_position[k].push_back(p[k]);
+		m_direction[k].push_back(0.0f);
+	}
+	m_speed.push_back(speed);
+	m_cosHalfFOV.push_back(PerceptionCone::CosHalfAngle(FOV));
+	m_fleeDistance.push_back(fleeDistance);
+	m_alive.push_back(1);
+	m_random.push_back(Boid::RandomSeed());
+
+	unsigned int i = GetCount() - 1;
+	CreateRandomDirection(i);
+	return i;
+}
+
+template<unsigned int D>
+void BoidPopulationT<D>::CopyFrom(const vecBoid& boids)
+{
+	Clear();
+	for (Boid* b : boids)
+	{
+		float p[D];
+		float dir[D];
+		FromFloat3<D>(b->m_position, p);
+		FromFloat3<D>(b->m_direction, dir);
+		for (unsigned int k = 0; k < D; k++)
+		{
+			m_position[k].push_back(p[k]);
+			m_direction[k].push_back(dir[k]);
+		}
+		m_speed.push_back(b->GetTraits().speed);
+		m_cosHalfFOV.push_back(b->m_hot.cosHalfFOV);
+		m_fleeDistance.push_back(b->GetTraits().fleeDistance);
+		m_alive.push_back(b->isAlive ? 1 : 0);
+		m_random.push_back(b->m_random);
+	}
+}
+
+template<unsigned int D>
+void BoidPopulationT<D>::Clear()
+{
+	for (unsigned int k = 0; k < D; k++)
+	{
+		m_position[k].clear();
+		m_direction[k].clear();
+	}
+	m_speed.clear();
+	m_cosHalfFOV.clear();
+	m_fleeDistance.clear();
+	m_alive.clear();
+	m_random.clear();
+}
+
+template<unsigned int D>
+size_t BoidPopulationT<D>::BytesPerBoid()
+{
+	return (((2 * D) + 3) * sizeof(float)) + sizeof(unsigned char) + sizeof(unsigned int);
+}
+
+template<unsigned int D>
+void BoidPopulationT<D>::CreateRandomDirection(unsigned int i)
+{
+	XMFLOAT3 direction = Boid::RandomDirection(m_random[i]);
+	if (D == 3)
+		direction.z = (float)(Boid::NextRandom(m_random[i]) % 10) - 5; // the same spread as x and y
+	XMStoreFloat3(&direction, XMVector3Normalize(XMLoadFloat3(&direction)));
+
+	float dir[D];
+	FromFloat3<D>(direction, dir);
+	for (unsigned int k = 0; k < D; k++)
+		m_direction[k][i] = dir[k];
+}
+
+template<unsigned int D>
+void BoidPopulationT<D>::Update(float t, SpatialGrid* grid, vector<Predator*>* predatorList, SpatialGrid* predatorGrid)
+{
+	// in place and in order, so like the Boid objects each boid sees the ones before it where they have moved to
+	unsigned int count = GetCount();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		UpdateBoid(i, t, grid, predatorList, predatorGrid);
+	}
+}
+
+template<unsigned int D>
+void BoidPopulationT<D>::UpdateBoid(unsigned int i, float t, SpatialGrid* grid, vector<Predator*>* predatorList, SpatialGrid* predatorGrid)
+{
+	const float separationSq = SEPARATION_DISTANCE * SEPARATION_DISTANCE;
+
+	float p[D];
+	float dir[D];
+	for (unsigned int k = 0; k < D; k++)
+	{
+		p[k] = m_position[k][i];
+		dir[k] = m_direction[k][i];
+	}
+
+	// the fused pass from Boid::CalculateFlockingVectors, the same float operations in the same order
+	float separation[D] = {};
+	float direction[D] = {};
+	float position[D] = {};
+	int separationCount = 0;
+	int count = 0;
+	float nearestSq = FLT_MAX;
+	int nearest = -1;
+
+	grid->ForEachInRadius(GetPosition(i), NEARBY_DISTANCE, [&](unsigned int j)
+	{
+		if (j == i)
+			return;
+
+		float b[D];
+		for (unsigned int k = 0; k < D; k++)
+			b[k] = m_position[k][j];
+		NearestImage(p, b);
+
+		float d[D];
+		float lSq = 0.0f; // the grid has already checked the range
+		for (unsigned int k = 0; k < D; k++)
+		{
+			d[k] = p[k] - b[k];
+			lSq += d[k] * d[k];
+		}
+
+		if (lSq < separationSq && lSq > 0.0f) // one exactly on top gives no direction to separate in
+		{
+			float l = sqrt(lSq);
+			for (unsigned int k = 0; k < D; k++)
+				separation[k] += (d[k] / l) / l; // closer boids will have a greater weight
+			separationCount++;
+		}
+
+		for (unsigned int k = 0; k < D; k++)
+		{
+			direction[k] = m_direction[k][j] + direction[k];
+			position[k] = b[k] + position[k];
+		}
+		count++;
+
+		if (lSq < nearestSq)
+		{
+			nearestSq = lSq;
+			nearest = (int)j;
+		}
+	});
+
+	float vSeparation[D];
+	float vAlignment[D];
+	float vCohesion[D];
+	for (unsigned int k = 0; k < D; k++)
+	{
+		vSeparation[k] = dir[k];
+		vAlignment[k] = dir[k];
+		vCohesion[k] = dir[k];
+	}
+
+	if (Length<D>(separation) > 0)
+	{
+		for (unsigned int k = 0; k < D; k++)
+			separation[k] /= (float)separationCount;
+		float length = Length<D>(separation);
+		for (unsigned int k = 0; k < D; k++)
+			vSeparation[k] = separation[k] / length;
+	}
+
+	if (count > 0)
+	{
+		for (unsigned int k = 0; k < D; k++)
+			direction[k] /= (float)count;
+		float length = Length<D>(direction);
+		for (unsigned int k = 0; k < D && length > 0; k++)
+			vAlignment[k] = direction[k] / length;
+
+		for (unsigned int k = 0; k < D; k++)
+			position[k] = (position[k] / (float)count) - p[k];
+		length = Length<D>(position);
+		for (unsigned int k = 0; k < D && length > 0; k++)
+			vCohesion[k] = position[k] / length;
+	}
+
+	float vFlee[D];
+	CalculateFleeVector(i, predatorList, predatorGrid, vFlee);
+
+	// scale and add the four together
+	for (unsigned int k = 0; k < D; k++)
+		dir[k] += (vSeparation[k] * m_separationScale) + (vAlignment[k] * m_alignmentScale) + (vCohesion[k] * m_cohesionScale) + (vFlee[k] * m_fleeScale);
+
+	float length = Length<D>(dir);
+	if (length != 0)
+	{
+		for (unsigned int k = 0; k < D; k++)
+			dir[k] /= length;
+	}
+	else
+	{
+		// no direction, head for the nearest boid, or anywhere if there isn't one
+		if (nearest == -1)
+			nearest = grid->Nearest(GetPosition(i), [&](unsigned int j) { return j == i; });
+
+		if (nearest != -1)
+		{
+			float b[D];
+			for (unsigned int k = 0; k < D; k++)
+				b[k] = m_position[k][nearest];
+			NearestImage(p, b);
+			for (unsigned int k = 0; k < D; k++)
+				dir[k] = b[k] - p[k];
+			length = Length<D>(dir);
+			for (unsigned int k = 0; k < D; k++)
+				dir[k] /= length;
+		}
+		else
+		{
+			CreateRandomDirection(i);
+			for (unsigned int k = 0; k < D; k++)
+				dir[k] = m_direction[k][i];
+		}
+	}
+
+	float step = t * m_speed[i];
+	for (unsigned int k = 0; k < D; k++)
+	{
+		m_position[k][i] = p[k] + (dir[k] * step);
+		m_direction[k][i] = dir[k];
+	}
+}
+
+template<unsigned int D>
+void BoidPopulationT<D>::UpdateBatched(float t, SpatialGrid* grid, SpatialGrid* predatorGrid, SimdLevel level)
+{
+	Steer(grid, predatorGrid, level);
+	Move(t);
+}
+
+template<unsigned int D>
+void BoidPopulationT<D>::Steer(SpatialGrid* grid, SpatialGrid* predatorGrid, SimdLevel level)
+{
+	unsigned int count = GetCount();
+	// a batch can start at the last boid and still read a whole register
+	unsigned int padded = count + SIMD_MAX_WIDTH - 1;
+	for (unsigned int k = 0; k < D; k++)
+	{
+		m_sortedPosition[k].resize(padded, 0.0f);
+		m_sortedDirection[k].resize(padded, 0.0f);
+		m_newDirection[k].resize(padded);
+	}
+	m_sortedCosHalfFOV.resize(padded, 0.0f);
+	m_sortedFleeDistance.resize(padded, 0.0f);
+	m_caught.resize(padded);
+
+	// a batch is boids that are next to each other in the grid's cells, so they can share one set of neighbours
+	const vector<unsigned int>& sorted = grid->GetSortedIndices();
+	ParallelFor(count, [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int s = begin; s < end; s++)
+		{
+			unsigned int i = sorted[s];
+			for (unsigned int k = 0; k < D; k++)
+			{
+				m_sortedPosition[k][s] = m_position[k][i];
+				m_sortedDirection[k][s] = m_direction[k][i];
+			}
+			m_sortedCosHalfFOV[s] = m_cosHalfFOV[i];
+			m_sortedFleeDistance[s] = m_fleeDistance[i];
+		}
+	});
+
+	SteeringFrame frame;
+	frame.dimensions = D;
+	for (unsigned int k = 0; k < D; k++)
+	{
+		frame.position[k] = m_sortedPosition[k].data();
+		frame.direction[k] = m_sortedDirection[k].data();
+		frame.newDirection[k] = m_newDirection[k].data();
+	}
+	frame.cosHalfFOV = m_sortedCosHalfFOV.data();
+	frame.fleeDistance = m_sortedFleeDistance.data();
+	frame.invCellSize = 1.0f / grid->GetCellSize();
+	frame.search = SteeringKernel::Search;
+	frame.grid = grid;
+	frame.predatorGrid = predatorGrid;
+	frame.predatorPosition = predatorGrid != nullptr && predatorGrid->GetCount() > 0 ? &predatorGrid->GetSortedPositions()[0].x : nullptr;
+	frame.predatorCount = predatorGrid != nullptr ? predatorGrid->GetCount() : 0;
+	frame.worldSize[0] = m_bounds != nullptr ? m_bounds->GetSize().x : 0.0f;
+	frame.worldSize[1] = m_bounds != nullptr ? m_bounds->GetSize().y : 0.0f;
+	frame.nearbyDistance = NEARBY_DISTANCE;
+	frame.separationDistance = SEPARATION_DISTANCE;
+	frame.separationScale = m_separationScale;
+	frame.alignmentScale = m_alignmentScale;
+	frame.cohesionScale = m_cohesionScale;
+	frame.fleeScale = m_fleeScale;
+	frame.killDistance = m_killDistance;
+	frame.canDie = m_canDie;
+	frame.caught = m_caught.data();
+
+	// each range is moved out to the start of a cell and another range ends there, so none is left out or done twice
+	const float* x = m_sortedPosition[0].data();
+	const float* y = m_sortedPosition[1].data();
+	auto cellStart = [&](unsigned int s)
+	{
+		while (s > 0 && s < count && grid->SameCell(x[s - 1], y[s - 1], x[s], y[s]))
+			s++;
+		return s;
+	};
+	ParallelFor(count, [&](unsigned int begin, unsigned int end)
+	{
+		SteeringFrame range = frame;
+		range.begin = cellStart(begin);
+		range.end = cellStart(end);
+		if (range.begin < range.end)
+			SteeringKernel::Run(range, level);
+	});
+
+	// only the boid's own arrays are written, and a direction picked at random comes from its own stream
+	ParallelFor(count, [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int s = begin; s < end; s++)
+		{
+			unsigned int i = sorted[s];
+			if (m_caught[s])
+				m_alive[i] = 0;
+
+			bool moving = false;
+			for (unsigned int k = 0; k < D; k++)
+				moving = moving || m_newDirection[k][s] != 0.0f;
+			if (moving)
+			{
+				for (unsigned int k = 0; k < D; k++)
+					m_direction[k][i] = m_newDirection[k][s];
+				continue;
+			}
+
+			// the forces cancelled out, head for the nearest boid, or anywhere if there isn't one
+			int nearest = grid->Nearest(GetPosition(i), [&](unsigned int j) { return j == i; });
+			if (nearest == -1)
+			{
+				CreateRandomDirection(i);
+				continue;
+			}
+
+			float p[D];
+			float b[D];
+			float dir[D];
+			for (unsigned int k = 0; k < D; k++)
+			{
+				p[k] = m_position[k][i];
+				b[k] = m_position[k][nearest];
+			}
+			NearestImage(p, b);
+			for (unsigned int k = 0; k < D; k++)
+				dir[k] = b[k] - p[k];
+			float length = Length<D>(dir);
+			for (unsigned int k = 0; k < D; k++)
+				m_direction[k][i] = dir[k] / length;
+		}
+	});
+}
+
+template<unsigned int D>
+void BoidPopulationT<D>::Move(float t)
+{
+	ParallelFor(GetCount(), [&](unsigned int begin, unsigned int end)
+	{
+		for (unsigned int i = begin; i < end; i++)
+		{
+			float step = t * m_speed[i];
+			for (unsigned int k = 0; k < D; k++)
+				m_position[k][i] += m_direction[k][i] * step;
+		}
+	});
+}
+
+template<unsigned int D>
+void BoidPopulationT<D>::CalculateFleeVector(unsigned int i, vector<Predator*>* predatorList, SpatialGrid* predatorGrid, float* flee)
+{
+	for (unsigned int k = 0; k < D; k++)
+		flee[k] = 0.0f;
+	if (predatorList == nullptr || predatorList->empty())
+		return;
+
+	float p[D];
+	float dir[D];
+	for (unsigned int k = 0; k < D; k++)
+	{
+		p[k] = m_position[k][i];
+		dir[k] = m_direction[k][i];
+	}
+	float fleeDistance = m_fleeDistance[i];
+
+	// predators in flee range are tested against the field of view a batch at a time, as in Boid
+	float diff[D][PERCEPTION_BATCH];
+	float to[D][PERCEPTION_BATCH];
+	unsigned int waiting = 0;
+
+	auto flush = [&]()
+	{
+		unsigned int inside = 0;
+		if (D == 2)
+		{
+			inside = PerceptionCone::InsideBatch(dir[0], dir[1], m_cosHalfFOV[i], to[0], to[1], waiting);
+		}
+		else
+		{
+			for (unsigned int w = 0; w < waiting; w++)
+			{
+				if (PerceptionCone::Inside(dir[0], dir[1], dir[D - 1], m_cosHalfFOV[i], to[0][w], to[1][w], to[D - 1][w]))
+					inside |= 1u << w;
+			}
+		}
+
+		for (unsigned int w = 0; w < waiting; w++)
+		{
+			if (inside & (1u << w))
+			{
+				for (unsigned int k = 0; k < D; k++)
+					flee[k] += diff[k][w];
+			}
+		}
+		waiting = 0;
+	};
+
+	auto check = [&](Predator* predator)
+	{
+		float v[D];
+		FromFloat3<D>(*predator->getPosition(), v);
+		NearestImage(p, v);
+
+		float d[D];
+		for (unsigned int k = 0; k < D; k++)
+			d[k] = p[k] - v[k];
+
+		// squared, as Boid compares them
+		float lSq = 0.0f;
+		for (unsigned int k = 0; k < D; k++)
+			lSq += d[k] * d[k];
+		if (lSq > m_killDistance * m_killDistance)
+		{
+			if (lSq < fleeDistance * fleeDistance)
+			{
+				for (unsigned int k = 0; k < D; k++)
+				{
+					diff[k][waiting] = d[k];
+					to[k][waiting] = -d[k];
+				}
+				if (++waiting == PERCEPTION_BATCH)
+					flush();
+			}
+		}
+		else
+		{
+			if (m_canDie)
+				m_alive[i] = 0;
+			else
+			{
+				for (unsigned int k = 0; k < D; k++)
+					flee[k] += d[k];
+			}
+		}
+	};
+
+	if (predatorGrid != nullptr)
+	{
+		predatorGrid->ForEachInRadius(GetPosition(i), max(fleeDistance, m_killDistance), [&](unsigned int index) { check((*predatorList)[index]); });
+	}
+	else
+	{
+		for (Predator* predator : *predatorList)
+			check(predator);
+	}
+	if (waiting > 0)
+		flush();
+
+	if (Length<D>(flee) > 0)
+		return;
+
+	for (unsigned int k = 0; k < D; k++)
+		flee[k] = dir[k];
+}
+
+template<unsigned int D>
+void BoidPopulationT<D>::Wrap()
+{
+	unsigned int count = GetCount();
+	if (m_bounds != nullptr)
+		m_bounds->Wrap(m_position[0].data(), m_position[1].data(), count);
+
+	// anything past x and y turns back at the faces of the slab
+	const float half = FLOCK_DEPTH * 0.5f;
+	for (unsigned int k = 2; k < D; k++)
+	{
+		for (unsigned int i = 0; i < count; i++)
+		{
+			float z = m_position[k][i];
+			float dirZ = m_direction[k][i];
+			if ((z > half && dirZ > 0.0f) || (z < -half && dirZ < 0.0f))
+				m_direction[k][i] = -dirZ;
+		}
+	}
+}
+
+template<unsigned int D>
+unsigned int BoidPopulationT<D>::RemoveDead()
+{
+	unsigned int count = GetCount();
+	unsigned int kept = 0;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (!m_alive[i])
+			continue;
+
+		if (kept != i)
+		{
+			for (unsigned int k = 0; k < D; k++)
+			{
+				m_position[k][kept] = m_position[k][i];
+				m_direction[k][kept] = m_direction[k][i];
+			}
+			m_speed[kept] = m_speed[i];
+			m_cosHalfFOV[kept] = m_cosHalfFOV[i];
+			m_fleeDistance[kept] = m_fleeDistance[i];
+			m_alive[kept] = 1;
+			m_random[kept] = m_random[i];
+		}
+		kept++;
+	}
+
+	for (unsigned int k = 0; k < D; k++)
+	{
+		m_position[k].resize(kept);
+		m_direction[k].resize(kept);
+	}
+	m_speed.resize(kept);
+	m_cosHalfFOV.resize(kept);
+	m_fleeDistance.resize(kept);
+	m_alive.resize(kept);
+	m_random.resize(kept);
+	return count - kept;
+}
+
+template<unsigned int D>
+void BoidPopulationT<D>::SortMorton()
+{
+	unsigned int count = GetCount();
+	if (count < 2)
+		return;
+
+	// along x and y only, the grid is columns in 3d
+	const float* x = GetX();
+	const float* y = GetY();
+	float lowerX = x[0], lowerY = y[0];
+	float upperX = lowerX, upperY = lowerY;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		lowerX = min(lowerX, x[i]);
+		lowerY = min(lowerY, y[i]);
+		upperX = max(upperX, x[i]);
+		upperY = max(upperY, y[i]);
+	}
+	float scaleX = 65535.0f / max(upperX - lowerX, 1.0f);
+	float scaleY = 65535.0f / max(upperY - lowerY, 1.0f);
+
+	// the keys and the order only last until the arrays are put back in order
+	FrameArena& arena = FrameArena::Frame();
+	ArenaScope scope(arena);
+	unsigned int* keys = arena.Allocate<unsigned int>(count);
+	unsigned int* order = arena.Allocate<unsigned int>(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		keys[i] = MortonOrder::Encode((unsigned int)((x[i] - lowerX) * scaleX), (unsigned int)((y[i] - lowerY) * scaleY));
+		order[i] = i;
+	}
+
+	MortonOrder::RadixSort(keys, order, count, arena);
+	Reorder(order, count);
+}
+
+template<unsigned int D>
+void BoidPopulationT<D>::Reorder(const unsigned int* order, unsigned int count)
+{
+	// one array at a time, so only one extra array is needed, and it comes from the arena so a sort doesn't touch the heap
+	FrameArena& arena = FrameArena::Frame();
+	auto reorder = [&](auto& values)
+	{
+		typedef typename remove_reference<decltype(values)>::type::value_type Value;
+		ArenaScope scope(arena);
+		Value* sorted = arena.Allocate<Value>(count);
+		for (unsigned int i = 0; i < count; i++)
+			sorted[i] = values[order[i]];
+		copy(sorted, sorted + count, values.begin());
+	};
+
+	for (unsigned int k = 0; k < D; k++)
+	{
+		reorder(m_position[k]);
+		reorder(m_direction[k]);
+	}
+	reorder(m_speed);
+	reorder(m_cosHalfFOV);
+	reorder(m_fleeDistance);
+	reorder(m_alive);
+	reorder(m_random);
+}
+
+template class BoidPopulationT<2>;
+template class BoidPopulationT<3>;
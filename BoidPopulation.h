@@ -0,0 +1,148 @@
+#pragma once
+
+#include "Boid.h"
+#include "LargePages.h"
+#include "SteeringKernel.h"
+#include "JobSystem.h"
+
+class Predator;
+
+// cache line aligned, and in large pages when LargePages is enabled and the array is big enough
+typedef vector<float, LargePageAllocator<float>>				vecAlignedFloat;
+typedef vector<unsigned char, LargePageAllocator<unsigned char>>	vecAlignedByte;
+typedef vector<unsigned int, LargePageAllocator<unsigned int>>	vecAlignedUInt;
+
+#define FLOCK_DEPTH				200.0f // 3d flocks stay in a slab this deep around z = 0, turning back at the faces
+
+/*
+ the whole flock stored as one array per value instead of one Boid object per boid
+ a boid is just an index, reading a neighbour touches 16 bytes of position and direction (24 in 3d)
+ instead of a Boid with its world matrix, material and d3d pointers
+ the rules are the same as Boid::Update's fused pass over everything inside NEARBY_DISTANCE plus flee,
+ nothing is kept for drawing, world matrices are made from the positions at draw time
+ the scales and kill distance are the same for every boid so they are stored once, not per boid
+
+ D is the number of dimensions, fixed at compile time so every loop over the axes unrolls
+ 2 stores and computes only x and y, 3 flocks in a slab FLOCK_DEPTH deep
+ the world only wraps in x and y, the grid is 2d columns that are searched in 3d
+*/
+
+template<unsigned int D>
+class BoidPopulationT
+{
+	friend class Benchmark;
+	friend class QuantisedPopulation;
+
+public:
+	BoidPopulationT();
+	~BoidPopulationT();
+
+	// a boid at position with the same random traits and direction a new Boid gets, returns its index
+	unsigned int						Add(const XMFLOAT3& position);
+	// start again from copies of these boids, so both ways of storing the flock can be run from the same start
+	void								CopyFrom(const vecBoid& boids);
+	void								Clear();
+
+	// step every boid once, grid must have been built from this population's positions this frame
+	// boids that get caught are only marked dead, RemoveDead takes them out once the frame is done
+	// always on the calling thread, the boids are moved in place and in order so each one depends on the last
+	void								Update(float t, SpatialGrid* grid, vector<Predator*>* predatorList, SpatialGrid* predatorGrid);
+	// the same rules a batch of boids at a time with SteeringKernel, every boid steers from where the flock
+	// was at the start of the frame and then they all move, so the result doesn't depend on the order
+	// and the flock is split over the job system, whole cells of the grid to a range
+	void								UpdateBatched(float t, SpatialGrid* grid, SpatialGrid* predatorGrid, SimdLevel level);
+	// the two halves of UpdateBatched, new directions from the current positions and then move along them
+	void								Steer(SpatialGrid* grid, SpatialGrid* predatorGrid, SimdLevel level);
+	void								Move(float t);
+	// bring anything that went off one edge back on the other, and turn 3d boids back into the slab
+	void								Wrap();
+	// drop the boids that died, keeping the rest in order, returns how many went
+	unsigned int						RemoveDead();
+	// re-sort along a z-order curve, the same as MortonOrder::SortBoids
+	void								SortMorton();
+
+	// boids see each other across the edges of these bounds, nullptr (the default) for an open plane
+	void								SetWorldBounds(const WorldBounds* bounds) { m_bounds = bounds; }
+	// split UpdateBatched across these threads, nullptr (the default) runs it all on the calling thread
+	void								SetJobSystem(JobSystem* jobs) { m_jobs = jobs; }
+
+	unsigned int						GetCount() const { return (unsigned int)m_position[0].size(); }
+	const float*						GetX() const { return m_position[0].data(); }
+	const float*						GetY() const { return m_position[1].data(); }
+	// nullptr in 2d, so SpatialGrid::Build(GetX(), GetY(), GetCount(), GetZ()) suits both
+	const float*						GetZ() const { return D == 3 ? m_position[D - 1].data() : nullptr; }
+	XMFLOAT3							GetPosition(unsigned int i) const { return ToFloat3(m_position, i); }
+	XMFLOAT3							GetDirection(unsigned int i) const { return ToFloat3(m_direction, i); }
+	bool								GetAlive(unsigned int i) const { return m_alive[i] != 0; }
+
+	// bytes stored for each boid across all of the arrays
+	static size_t						BytesPerBoid();
+
+protected:
+	void								UpdateBoid(unsigned int i, float t, SpatialGrid* grid, vector<Predator*>* predatorList, SpatialGrid* predatorGrid);
+	void								CalculateFleeVector(unsigned int i, vector<Predator*>* predatorList, SpatialGrid* predatorGrid, float* flee);
+	void								CreateRandomDirection(unsigned int i);
+	// put the boids in order[0], order[1], ... order, the scratch comes from the frame arena
+	void								Reorder(const unsigned int* order, unsigned int count);
+
+	// body(begin, end) over 0 to count, on m_jobs when there is one
+	template<class F>
+	void								ParallelFor(unsigned int count, const F& body)
+	{
+		if (m_jobs != nullptr)
+			m_jobs->ParallelFor(count, body);
+		else
+			body(0, count);
+	}
+
+	// the copy of p closest to the boid at reference when the world wraps, only x and y wrap
+	void								NearestImage(const float* reference, float* p) const
+	{
+		if (m_bounds == nullptr)
+			return;
+		XMFLOAT3 image = m_bounds->NearestImage(XMFLOAT3(p[0], p[1], 0.0f), XMFLOAT3(reference[0], reference[1], 0.0f));
+		p[0] = image.x;
+		p[1] = image.y;
+	}
+
+	static XMFLOAT3						ToFloat3(const vecAlignedFloat* axes, unsigned int i)
+	{
+		float v[3] = { 0.0f, 0.0f, 0.0f };
+		for (unsigned int k = 0; k < D; k++)
+			v[k] = axes[k][i];
+		return XMFLOAT3(v[0], v[1], v[2]);
+	}
+
+	const WorldBounds*					m_bounds = nullptr;
+	JobSystem*							m_jobs = nullptr;
+
+	// read for every neighbour, one array per axis
+	vecAlignedFloat						m_position[D];
+	vecAlignedFloat						m_direction[D];
+
+	// only read for the boid being updated
+	vecAlignedFloat						m_speed;
+	vecAlignedFloat						m_cosHalfFOV;
+	vecAlignedFloat						m_fleeDistance;
+	vecAlignedByte						m_alive;
+	vecAlignedUInt						m_random;		// each boid's random stream, so directions can be picked on any thread
+
+	// the batched update's copies of the arrays in grid order, padded for whole batches
+	vecAlignedFloat						m_sortedPosition[D];
+	vecAlignedFloat						m_sortedDirection[D];
+	vecAlignedFloat						m_sortedCosHalfFOV;
+	vecAlignedFloat						m_sortedFleeDistance;
+	vecAlignedFloat						m_newDirection[D];
+	vecAlignedByte						m_caught;
+
+	// the same for every boid
+	float								m_separationScale = SEPARATIONSCALE_DEFAULT;
+	float								m_alignmentScale = ALIGNMENTSCALE_DEFAULT;
+	float								m_cohesionScale = COHESIONSCALE_DEFAULT;
+	float								m_fleeScale = FLEESCALE_DEFAULT;
+	float								m_killDistance = KILL_DISTANCE_DEFAULT;
+	bool								m_canDie = true;
+};
+
+typedef BoidPopulationT<2>				BoidPopulation;
+typedef BoidPopulationT<3>				BoidPopulation3D;
@@ -0,0 +1,187 @@
+#include "CellAggregates.h"
+
+#define MIN_AGGREGATE_TABLE_SIZE	64
+
+CellAggregates::CellAggregates(float cellSize)
+{
+	m_cellSize = cellSize;
+	m_invCellSize = 1.0f / cellSize;
+	Resize(MIN_AGGREGATE_TABLE_SIZE);
+}
+
+CellAggregates::~CellAggregates()
+{
+}
+
+void CellAggregates::Resize(unsigned int tableSize)
+{
+	vector<CellAggregate> old;
+	old.swap(m_cells);
+
+	CellAggregate empty = {};
+	m_cells.assign(tableSize, empty);
+	m_tableMask = tableSize - 1;
+	m_usedCells = 0;
+
+	// empty cells are dropped on the way across
+	for (const CellAggregate& cell : old)
+	{
+		if (cell.used && cell.count > 0)
+			*FindCell(cell.x, cell.y, true) = cell;
+	}
+}
+
+CellAggregate* CellAggregates::FindCell(int x, int y, bool create)
+{
+	unsigned int slot = HashCell(x, y);
+	while (m_cells[slot].used)
+	{
+		if (m_cells[slot].x == x && m_cells[slot].y == y)
+			return &m_cells[slot];
+		slot = (slot + 1) & m_tableMask;
+	}
+
+	if (!create)
+		return nullptr;
+
+	// keep the table under half full so the probes stay short
+	if ((m_usedCells + 1) * 2 > m_cells.size())
+	{
+		Resize((unsigned int)m_cells.size() * 2);
+		return FindCell(x, y, true);
+	}
+
+	CellAggregate& cell = m_cells[slot];
+	cell = {};
+	cell.x = x;
+	cell.y = y;
+	cell.used = true;
+	m_usedCells++;
+	return &cell;
+}
+
+void CellAggregates::Build(const vecBoid& boids)
+{
+	unsigned int tableSize = MIN_AGGREGATE_TABLE_SIZE;
+	while (tableSize < boids.size() * 2)
+		tableSize *= 2;
+
+	CellAggregate empty = {};
+	m_cells.assign(tableSize, empty);
+	m_tableMask = tableSize - 1;
+	m_usedCells = 0;
+
+	for (Boid* b : boids)
+	{
+		b->m_inAggregates = false;
+		Add(b, 1);
+	}
+}
+
+void CellAggregates::Add(Boid* boid, int sign)
+{
+	// sign is 1 to record the boid as it is now, -1 to take out what was recorded
+	XMFLOAT3 position = sign > 0 ? *boid->getPosition() : boid->m_aggregatePosition;
+	XMFLOAT3 direction = sign > 0 ? *boid->GetDirection() : boid->m_aggregateDirection;
+
+	CellAggregate* cell = FindCell(CellCoord(position.x), CellCoord(position.y), true);
+	if (sign > 0)
+		cell->count++;
+	else
+		cell->count--;
+	cell->positionSum.x += sign * position.x;
+	cell->positionSum.y += sign * position.y;
+	cell->positionSum.z += sign * position.z;
+	cell->directionSum.x += sign * direction.x;
+	cell->directionSum.y += sign * direction.y;
+	cell->directionSum.z += sign * direction.z;
+
+	boid->m_aggregatePosition = position;
+	boid->m_aggregateDirection = direction;
+	boid->m_inAggregates = sign > 0;
+}
+
+void CellAggregates::Move(Boid* boid)
+{
+	if (boid->m_inAggregates)
+		Add(boid, -1);
+	Add(boid, 1);
+}
+
+void CellAggregates::Remove(Boid* boid)
+{
+	if (boid->m_inAggregates)
+		Add(boid, -1);
+}
+
+void CellAggregates::Gather(Boid* boid, float radius, XMFLOAT3& positionSum, XMFLOAT3& directionSum, float& count)
+{
+	positionSum = XMFLOAT3(0, 0, 0);
+	directionSum = XMFLOAT3(0, 0, 0);
+	count = 0.0f;
+
+	// cells up to half a cell outside the radius can still partly overlap it
+	XMFLOAT3 position = *boid->getPosition();
+	float reach = radius + (m_cellSize * 0.5f);
+	float reachSq = reach * reach;
+	float inside = max(radius - (m_cellSize * 0.5f), 0.0f);
+	float insideSq = inside * inside;
+
+	// on a torus the cells over an edge are read from a copy of the position, and their positions moved back to this side
+	XMFLOAT2 offsets[4] = { XMFLOAT2(0, 0) };
+	unsigned int images = m_bounds != nullptr ? m_bounds->Images(position, reach, offsets) : 1;
+	for (unsigned int image = 0; image < images; image++)
+	{
+		XMFLOAT3 p = XMFLOAT3(position.x + offsets[image].x, position.y + offsets[image].y, position.z);
+		int minX = CellCoord(p.x - reach);
+		int maxX = CellCoord(p.x + reach);
+		int minY = CellCoord(p.y - reach);
+		int maxY = CellCoord(p.y + reach);
+
+		for (int y = minY; y <= maxY; y++)
+		{
+			for (int x = minX; x <= maxX; x++)
+			{
+				// weight each cell by roughly how much of it is inside the radius, going from 1 to 0 over a cell width
+				float dx = ((float)x + 0.5f) * m_cellSize - p.x;
+				float dy = ((float)y + 0.5f) * m_cellSize - p.y;
+				float lSq = (dx * dx) + (dy * dy);
+				if (lSq >= reachSq)
+					continue;
+				float weight = 1.0f;
+				if (lSq > insideSq)
+					weight = (radius - sqrtf(lSq)) * m_invCellSize + 0.5f;
+
+				CellAggregate* cell = FindCell(x, y, false);
+				if (cell == nullptr || cell->count == 0)
+					continue;
+
+				XMFLOAT3 cellPosition = cell->positionSum;
+				XMFLOAT3 cellDirection = cell->directionSum;
+				float cellCount = (float)cell->count;
+				cellPosition.x -= offsets[image].x * cellCount;
+				cellPosition.y -= offsets[image].y * cellCount;
+
+				// the boid asking is in one of these cells, don't let it flock with itself
+				if (boid->m_inAggregates && x == CellCoord(boid->m_aggregatePosition.x) && y == CellCoord(boid->m_aggregatePosition.y))
+				{
+					cellPosition.x -= boid->m_aggregatePosition.x;
+					cellPosition.y -= boid->m_aggregatePosition.y;
+					cellPosition.z -= boid->m_aggregatePosition.z;
+					cellDirection.x -= boid->m_aggregateDirection.x;
+					cellDirection.y -= boid->m_aggregateDirection.y;
+					cellDirection.z -= boid->m_aggregateDirection.z;
+					cellCount -= 1.0f;
+				}
+
+				positionSum.x += cellPosition.x * weight;
+				positionSum.y += cellPosition.y * weight;
+				positionSum.z += cellPosition.z * weight;
+				directionSum.x += cellDirection.x * weight;
+				directionSum.y += cellDirection.y * weight;
+				directionSum.z += cellDirection.z * weight;
+				count += cellCount * weight;
+			}
+		}
+	}
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "Boid.h"
+
+#define AGGREGATE_CELL_SIZE			(NEARBY_DISTANCE * 0.5f)
+#define AGGREGATE_REBUILD_INTERVAL	60		// frames between full rebuilds, clears float drift from the running sums and empty cells
+
+/*
+ approximate flocking for very large flocks
+ every cell keeps the sum of the positions and directions of the boids in it and how many there are
+ alignment and cohesion then read a handful of cells instead of every nearby boid, so the cost per boid
+ doesn't grow with how crowded the flock is
+ the sums are kept up to date as each boid moves, so boids later in the update see the ones before them
+ in the same way as the exact mode
+*/
+
+struct CellAggregate
+{
+	int									x;
+	int									y;
+	bool								used;
+	unsigned int						count;
+	XMFLOAT3							positionSum;
+	XMFLOAT3							directionSum;
+};
+
+class CellAggregates
+{
+public:
+	CellAggregates(float cellSize = AGGREGATE_CELL_SIZE);
+	~CellAggregates();
+
+	// start again from the current positions and directions of every boid
+	void								Build(const vecBoid& boids);
+	// take out what the boid added last time and add where it is now
+	void								Move(Boid* boid);
+	// take the boid out completely, e.g. before it is deleted
+	void								Remove(Boid* boid);
+
+	// sums over the cells within radius of the boid, weighted by how much of each cell is inside, leaving out the boid asking
+	void								Gather(Boid* boid, float radius, XMFLOAT3& positionSum, XMFLOAT3& directionSum, float& count);
+
+	// read cells over the edges of these bounds too, nullptr for an open plane
+	void								SetWorldBounds(const WorldBounds* bounds) { m_bounds = bounds; }
+
+	float								GetCellSize() { return m_cellSize; }
+	unsigned int						GetUsedCellCount() { return m_usedCells; }
+
+protected:
+	CellAggregate*						FindCell(int x, int y, bool create);
+	void								Add(Boid* boid, int sign);
+	void								Resize(unsigned int tableSize);
+
+	int									CellCoord(float v) const { return (int)floorf(v * m_invCellSize); }
+	unsigned int						HashCell(int x, int y) const { return (((unsigned int)x * 73856093u) ^ ((unsigned int)y * 19349663u)) & m_tableMask; }
+
+	float								m_cellSize;
+	float								m_invCellSize;
+	const WorldBounds*					m_bounds = nullptr;
+	unsigned int						m_tableMask = 0;
+	unsigned int						m_usedCells = 0;
+
+	vector<CellAggregate>				m_cells;		// open addressing, cells are only removed by a rebuild
+};
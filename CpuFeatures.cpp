@@ -0,0 +1,118 @@
+#include "CpuFeatures.h"
+
+#include <intrin.h>
+#include <immintrin.h>
+#include <string.h>
+
+bool CpuFeatures::detected = false;
+bool CpuFeatures::sse2 = false;
+bool CpuFeatures::sse41 = false;
+bool CpuFeatures::avx = false;
+bool CpuFeatures::avx2 = false;
+bool CpuFeatures::fma = false;
+bool CpuFeatures::avx512f = false;
+
+bool CpuFeatures::levelChosen = false;
+bool CpuFeatures::levelForced = false;
+SimdLevel CpuFeatures::level = SIMD_LEVEL_SCALAR;
+
+void CpuFeatures::Detect()
+{
+	if (detected)
+		return;
+	detected = true;
+
+	int info[4];
+	__cpuid(info, 0);
+	int highest = info[0];
+
+	__cpuid(info, 1);
+	sse2 = (info[3] & (1 << 26)) != 0;
+	sse41 = (info[2] & (1 << 19)) != 0;
+	fma = (info[2] & (1 << 12)) != 0;
+
+	// avx also needs the os to save the upper halves of the registers on a context switch, avx-512 the mask and upper 16 registers too
+	bool osSavesAVX = false;
+	bool osSavesAVX512 = false;
+	if ((info[2] & (1 << 27)) != 0) // osxsave
+	{
+		unsigned long long xcr0 = _xgetbv(0);
+		osSavesAVX = (xcr0 & 0x6) == 0x6;
+		osSavesAVX512 = (xcr0 & 0xe6) == 0xe6;
+	}
+	avx = osSavesAVX && (info[2] & (1 << 28)) != 0;
+	fma = fma && avx;
+
+	if (highest >= 7)
+	{
+		__cpuidex(info, 7, 0);
+		avx2 = avx && (info[1] & (1 << 5)) != 0;
+		avx512f = avx2 && osSavesAVX512 && (info[1] & (1 << 16)) != 0;
+	}
+}
+
+bool CpuFeatures::Supports(SimdLevel level)
+{
+	switch (level)
+	{
+	case SIMD_LEVEL_SCALAR:
+		return true;
+	case SIMD_LEVEL_SSE41:
+		return HasSSE41();
+	case SIMD_LEVEL_AVX2:
+		return HasAVX2();
+	case SIMD_LEVEL_AVX512:
+		return HasAVX512F();
+	default:
+		return false;
+	}
+}
+
+SimdLevel CpuFeatures::Level()
+{
+	if (!levelChosen)
+	{
+		levelChosen = true;
+		level = SIMD_LEVEL_SCALAR;
+		for (int i = SIMD_LEVEL_SCALAR; i < SIMD_LEVEL_COUNT; i++)
+		{
+			if (Supports((SimdLevel)i))
+				level = (SimdLevel)i;
+		}
+	}
+	return level;
+}
+
+bool CpuFeatures::ForceLevel(const char* name)
+{
+	for (int i = SIMD_LEVEL_SCALAR; i < SIMD_LEVEL_COUNT; i++)
+	{
+		if (_stricmp(name, Name((SimdLevel)i)) != 0)
+			continue;
+		if (!Supports((SimdLevel)i))
+			return false;
+
+		levelChosen = true;
+		levelForced = true;
+		level = (SimdLevel)i;
+		return true;
+	}
+	return false;
+}
+
+const char* CpuFeatures::Name(SimdLevel level)
+{
+	switch (level)
+	{
+	case SIMD_LEVEL_SCALAR:
+		return "scalar";
+	case SIMD_LEVEL_SSE41:
+		return "sse4.1";
+	case SIMD_LEVEL_AVX2:
+		return "avx2";
+	case SIMD_LEVEL_AVX512:
+		return "avx512";
+	default:
+		return "unknown";
+	}
+}
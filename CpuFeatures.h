@@ -0,0 +1,53 @@
+#pragma once
+
+// the instruction sets the batched kernels are built for, each one a superset of the one before
+enum SimdLevel
+{
+	SIMD_LEVEL_SCALAR,
+	SIMD_LEVEL_SSE41,
+	SIMD_LEVEL_AVX2,
+	SIMD_LEVEL_AVX512,
+	SIMD_LEVEL_COUNT
+};
+
+/*
+ which instruction sets this cpu (and the os) can run, read once with cpuid
+ kernels built for more than one instruction set use this to skip the ones that would fault
+ Level is picked once, the best the cpu can run unless ForceLevel was called first
+ (main calls it for "-simd=avx2" on the command line or the BOIDS_SIMD environment variable)
+*/
+
+class CpuFeatures
+{
+public:
+	static bool							HasSSE2() { Detect(); return sse2; }
+	static bool							HasSSE41() { Detect(); return sse41; }
+	static bool							HasAVX() { Detect(); return avx; }
+	static bool							HasAVX2() { Detect(); return avx2; }
+	static bool							HasFMA() { Detect(); return fma; }
+	static bool							HasAVX512F() { Detect(); return avx512f; }
+
+	static bool							Supports(SimdLevel level);
+	// the level kernels should run at
+	static SimdLevel					Level();
+	// run every kernel at the level called name ("scalar", "sse4.1", "avx2" or "avx512") from now on,
+	// false if the name isn't one of those or this cpu can't run it
+	static bool							ForceLevel(const char* name);
+	static bool							LevelForced() { return levelForced; }
+	static const char*					Name(SimdLevel level);
+
+private:
+	static void							Detect();
+
+	static bool							detected;
+	static bool							sse2;
+	static bool							sse41;
+	static bool							avx;
+	static bool							avx2;
+	static bool							fma;
+	static bool							avx512f;
+
+	static bool							levelChosen;
+	static bool							levelForced;
+	static SimdLevel					level;
+};
@@ -4,6 +4,12 @@ void Debug::Print(std::string output)
 {
 	OutputDebugStringA((output + "\n").c_str());
 }
+void Debug::Print(const char* output)
+{
+	// no string to build, so printing doesn't touch the heap
+	OutputDebugStringA(output);
+	OutputDebugStringA("\n");
+}
 void Debug::Print(int output)
 {
 	char sz[1024] = { 0 };
@@ -9,6 +9,7 @@ class Debug
 public:
 	Debug() {};
 	static void Print(std::string output);
+	static void Print(const char* output);
 	static void Print(int output);
 	static void Print(float output);
 	static void Print(DirectX::XMFLOAT3 output);
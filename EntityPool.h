@@ -0,0 +1,130 @@
+#pragma once
+
+#include <d3d11_1.h>
+#include <memory>
+#include <vector>
+
+#include "FrameArena.h"
+
+using namespace std;
+
+/*
+ a fixed number of entity slots made up front instead of a new Boid or Predator for each one
+ Spawn hands out a free slot and Despawn gives it back, both O(1) off a free list and neither allocates,
+ a slot keeps its vertex and index buffers, texture and sampler for whoever has it next
+ T needs a default constructor and Respawn(), which turns whatever was in the slot into a fresh entity
+ the entities are only destroyed with the pool (or Clear), so pointers to a slot stay valid while it is reused
+ Arrange moves the live entities into slot order to match a list (e.g. sorted by position), which also
+ needs T::SwapState(T&), it moves an entity to a different slot so pointers to it have to be updated
+*/
+
+template<class T>
+class EntityPool
+{
+public:
+	EntityPool() {}
+	~EntityPool() { Clear(); }
+	EntityPool(const EntityPool&) = delete;
+	EntityPool&							operator=(const EntityPool&) = delete;
+
+	// make capacity entities, every slot free, anything the pool had goes
+	void								Create(unsigned int capacity)
+	{
+		Clear();
+		m_slots.reset(new T[capacity]);
+		m_capacity = capacity;
+		m_live.assign(capacity, 0);
+		// so slots are handed out from the front
+		m_free.reserve(capacity);
+		for (unsigned int i = capacity; i > 0; i--)
+			m_free.push_back(i - 1);
+	}
+
+	// the d3d resources for every slot, once, instead of on every spawn
+	HRESULT								InitMeshes(ID3D11Device* pd3dDevice, ID3D11DeviceContext* pContext)
+	{
+		for (unsigned int i = 0; i < m_capacity; i++)
+		{
+			HRESULT hr = m_slots[i].initMesh(pd3dDevice, pContext);
+			if (FAILED(hr))
+				return hr;
+		}
+		return S_OK;
+	}
+
+	void								Clear()
+	{
+		m_slots.reset();
+		m_capacity = 0;
+		m_free.clear();
+		m_live.clear();
+	}
+
+	// nullptr when every slot is taken
+	T*									Spawn()
+	{
+		if (m_free.empty())
+			return nullptr;
+
+		unsigned int i = m_free.back();
+		m_free.pop_back();
+		m_live[i] = 1;
+		m_slots[i].Respawn();
+		return &m_slots[i];
+	}
+
+	void								Despawn(T* entity)
+	{
+		unsigned int i = (unsigned int)(entity - m_slots.get());
+		if (i >= m_capacity || !m_live[i])
+			return;
+
+		m_live[i] = 0;
+		m_free.push_back(i);
+	}
+
+	// move the live entities into the first slots in the order of entities, which has to hold every live one once,
+	// and point entities at their new slots, nothing is allocated
+	void								Arrange(vector<T*>& entities)
+	{
+		FrameArena& arena = FrameArena::Frame();
+		ArenaScope scope(arena);
+		unsigned int* slotOf = arena.Allocate<unsigned int>(m_capacity);	// where what started in a slot is now
+		unsigned int* heldBy = arena.Allocate<unsigned int>(m_capacity);	// and what each slot holds now
+		for (unsigned int i = 0; i < m_capacity; i++)
+			slotOf[i] = heldBy[i] = i;
+
+		unsigned int count = (unsigned int)entities.size();
+		for (unsigned int k = 0; k < count; k++)
+		{
+			unsigned int start = (unsigned int)(entities[k] - m_slots.get());
+			unsigned int from = slotOf[start];
+			if (from != k)
+			{
+				m_slots[k].SwapState(m_slots[from]);
+				unsigned int displaced = heldBy[k];
+				heldBy[k] = start;
+				heldBy[from] = displaced;
+				slotOf[start] = k;
+				slotOf[displaced] = from;
+			}
+			entities[k] = &m_slots[k];
+		}
+
+		// the live ones are now the first count slots
+		fill(m_live.begin(), m_live.begin() + count, (unsigned char)1);
+		fill(m_live.begin() + count, m_live.end(), (unsigned char)0);
+		m_free.clear();
+		for (unsigned int i = m_capacity; i > count; i--)
+			m_free.push_back(i - 1);
+	}
+
+	unsigned int						GetCapacity() const { return m_capacity; }
+	unsigned int						GetLive() const { return m_capacity - (unsigned int)m_free.size(); }
+
+private:
+	unique_ptr<T[]>						m_slots;
+	unsigned int						m_capacity = 0;
+	vector<unsigned int>				m_free;		// reserved for every slot, so giving one back never allocates
+	vector<unsigned char>				m_live;		// so a slot given back twice isn't handed out twice
+};
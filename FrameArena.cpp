@@ -0,0 +1,89 @@
+#include "FrameArena.h"
+
+#include <new>
+#include <algorithm>
+
+#define FRAME_ARENA_MAX_BLOCKS	64
+
+FrameArena::FrameArena(size_t blockSize)
+{
+	m_blocks.reserve(FRAME_ARENA_MAX_BLOCKS);
+	AddBlock(blockSize);
+}
+
+FrameArena::~FrameArena()
+{
+	for (Block& block : m_blocks)
+		::operator delete(block.memory);
+}
+
+FrameArena& FrameArena::Frame()
+{
+	thread_local FrameArena arena;
+	return arena;
+}
+
+void* FrameArena::Allocate(size_t bytes, size_t alignment)
+{
+	while (true)
+	{
+		Block& block = m_blocks[m_current];
+		size_t address = (size_t)(block.memory + m_offset);
+		size_t padding = ((address + alignment - 1) & ~(alignment - 1)) - address;
+		if (m_offset + padding + bytes <= block.size)
+		{
+			void* p = block.memory + m_offset + padding;
+			m_offset += padding + bytes;
+			m_used += padding + bytes;
+			m_peak = max(m_peak, m_used);
+			return p;
+		}
+
+		// skip what is left of this block and go on to the next, making one if there isn't one
+		m_used += block.size - m_offset;
+		if (m_current + 1 == m_blocks.size())
+			AddBlock(max(bytes + alignment, m_capacity));
+		m_current++;
+		m_offset = 0;
+		m_blocks[m_current].start = m_used;
+	}
+}
+
+void FrameArena::Release(size_t mark)
+{
+	if (mark >= m_used)
+		return;
+
+	while (m_current > 0 && m_blocks[m_current].start > mark)
+		m_current--;
+	m_offset = mark - m_blocks[m_current].start;
+	m_used = mark;
+}
+
+void FrameArena::Reset()
+{
+	if (m_blocks.size() > 1)
+	{
+		// one block that would have held the whole frame
+		size_t size = max(m_capacity, m_peak);
+		for (Block& block : m_blocks)
+			::operator delete(block.memory);
+		m_blocks.clear();
+		m_capacity = 0;
+		AddBlock(size);
+	}
+
+	m_current = 0;
+	m_offset = 0;
+	m_used = 0;
+}
+
+void FrameArena::AddBlock(size_t bytes)
+{
+	Block block;
+	block.memory = (char*)::operator new(bytes);
+	block.size = bytes;
+	block.start = m_used;
+	m_blocks.push_back(block);
+	m_capacity += bytes;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+#define FRAME_ARENA_BLOCK		(256 * 1024) // the first block, more are added while a frame needs more
+
+/*
+ bump allocator for the temporaries a frame needs, neighbour lists, sort keys and the like
+ allocating is moving a pointer, nothing is freed on its own, ArenaScope hands back everything allocated
+ inside it when it ends and Reset hands back everything (main calls it at the end of every frame)
+ a frame that overflows the blocks gets new ones from the heap, and the next Reset swaps them all for
+ one block big enough for the whole frame, so once the frames stop growing the arena never touches the heap
+ not thread safe, each thread needs its own (Frame gives each thread its own)
+*/
+
+class FrameArena
+{
+public:
+	FrameArena(size_t blockSize = FRAME_ARENA_BLOCK);
+	~FrameArena();
+	FrameArena(const FrameArena&) = delete;
+	FrameArena&							operator=(const FrameArena&) = delete;
+
+	void*								Allocate(size_t bytes, size_t alignment = alignof(max_align_t));
+	// uninitialised room for count Ts, only for types that don't need destroying
+	template<class T>
+	T*									Allocate(size_t count) { return (T*)Allocate(count * sizeof(T), alignof(T)); }
+
+	// a point to go back to, everything allocated after it is handed back by Release
+	size_t								Mark() const { return m_used; }
+	void								Release(size_t mark);
+	void								Reset();
+
+	size_t								GetUsed() const { return m_used; }
+	size_t								GetCapacity() const { return m_capacity; }
+	size_t								GetPeak() const { return m_peak; }
+
+	// the calling thread's arena, main resets the main thread's at the end of the frame,
+	// other threads have to release what they allocate (ArenaScope)
+	static FrameArena&					Frame();
+
+private:
+	struct Block
+	{
+		char*							memory;
+		size_t							size;
+		size_t							start; // m_used when the block was started
+	};
+
+	void								AddBlock(size_t bytes);
+
+	vector<Block>						m_blocks;	// reserved, so adding a block only allocates the block
+	size_t								m_current = 0;
+	size_t								m_offset = 0;	// in the current block
+	size_t								m_used = 0;		// across every block, including what was skipped for alignment
+	size_t								m_capacity = 0;
+	size_t								m_peak = 0;
+};
+
+// everything allocated from the arena while this is alive is handed back when it goes
+class ArenaScope
+{
+public:
+	ArenaScope(FrameArena& arena) : m_arena(arena), m_mark(arena.Mark()) {}
+	~ArenaScope() { m_arena.Release(m_mark); }
+	ArenaScope(const ArenaScope&) = delete;
+	ArenaScope&							operator=(const ArenaScope&) = delete;
+
+private:
+	FrameArena&							m_arena;
+	size_t								m_mark;
+};
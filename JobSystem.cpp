@@ -0,0 +1,157 @@
+#include "JobSystem.h"
+
+#include <algorithm>
+
+void JobSystem::Start(unsigned int threadCount)
+{
+	Stop();
+
+	if (threadCount == 0)
+		threadCount = max(thread::hardware_concurrency(), 1u);
+	m_threadCount = threadCount;
+	m_workers.reset(new Worker[threadCount]);
+	m_quit = false;
+	m_steals = 0;
+
+	// worker 0 is whoever calls ParallelFor
+	for (unsigned int i = 1; i < threadCount; i++)
+		m_threads.push_back(thread(&JobSystem::WorkerLoop, this, i));
+}
+
+void JobSystem::Stop()
+{
+	{
+		lock_guard<mutex> guard(m_wakeLock);
+		m_quit = true;
+	}
+	m_wake.notify_all();
+	for (thread& t : m_threads)
+		t.join();
+	m_threads.clear();
+	m_workers.reset();
+	m_threadCount = 1;
+}
+
+void JobSystem::Run(unsigned int count, JobFunction function, const void* context)
+{
+	if (count == 0)
+		return;
+
+	unsigned int grain = max(count / (m_threadCount * JOB_SPLITS_PER_THREAD), (unsigned int)JOB_MIN_GRAIN);
+	if (m_threadCount == 1 || count <= grain)
+	{
+		function(context, 0, count);
+		return;
+	}
+
+	m_function = function;
+	m_context = context;
+	m_grain = grain;
+	m_remaining.store(count, memory_order_release);
+
+	// an equal slice each, so nothing needs stealing while the work is even
+	unsigned int slice = (count + m_threadCount - 1) / m_threadCount;
+	for (unsigned int i = 0; i < m_threadCount && i * slice < count; i++)
+	{
+		JobRange range = { i * slice, min(count, (i + 1) * slice) };
+		Push(i, range);
+	}
+
+	{
+		lock_guard<mutex> guard(m_wakeLock);
+		m_generation++;
+	}
+	m_wake.notify_all();
+
+	Work(0);
+}
+
+void JobSystem::WorkerLoop(unsigned int index)
+{
+	unsigned int generation = 0;
+	while (true)
+	{
+		{
+			unique_lock<mutex> lock(m_wakeLock);
+			m_wake.wait(lock, [&]() { return m_quit || m_generation != generation; });
+			if (m_quit)
+				return;
+			generation = m_generation;
+		}
+		Work(index);
+	}
+}
+
+void JobSystem::Work(unsigned int index)
+{
+	JobRange range;
+	while (m_remaining.load(memory_order_acquire) > 0)
+	{
+		if (!Pop(index, range) && !Steal(index, range))
+		{
+			// the last ranges are being run by other workers
+			this_thread::yield();
+			continue;
+		}
+
+		// leave the far half for anyone who runs out, until what is left is small enough to run
+		while (range.end - range.begin > m_grain)
+		{
+			unsigned int middle = range.begin + (range.end - range.begin) / 2;
+			JobRange upper = { middle, range.end };
+			if (!Push(index, upper))
+				break;
+			range.end = middle;
+		}
+
+		m_function(m_context, range.begin, range.end);
+		m_remaining.fetch_sub(range.end - range.begin, memory_order_acq_rel);
+	}
+}
+
+bool JobSystem::Push(unsigned int index, JobRange range)
+{
+	Worker& w = m_workers[index];
+	lock_guard<mutex> guard(w.lock);
+	if (w.bottom == JOB_QUEUE_SIZE)
+	{
+		// thieves have emptied the top, move what is left down
+		if (w.top == 0)
+			return false;
+		copy(w.ranges + w.top, w.ranges + w.bottom, w.ranges);
+		w.bottom -= w.top;
+		w.top = 0;
+	}
+	w.ranges[w.bottom++] = range;
+	return true;
+}
+
+bool JobSystem::Pop(unsigned int index, JobRange& range)
+{
+	Worker& w = m_workers[index];
+	lock_guard<mutex> guard(w.lock);
+	if (w.top == w.bottom)
+		return false;
+	range = w.ranges[--w.bottom];
+	if (w.top == w.bottom)
+		w.top = w.bottom = 0;
+	return true;
+}
+
+bool JobSystem::Steal(unsigned int thief, JobRange& range)
+{
+	// the next worker along first, so thieves don't all go for the same one
+	for (unsigned int i = 1; i < m_threadCount; i++)
+	{
+		Worker& w = m_workers[(thief + i) % m_threadCount];
+		lock_guard<mutex> guard(w.lock);
+		if (w.top == w.bottom)
+			continue;
+		range = w.ranges[w.top++];
+		if (w.top == w.bottom)
+			w.top = w.bottom = 0;
+		m_steals.fetch_add(1, memory_order_relaxed);
+		return true;
+	}
+	return false;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+#define JOB_QUEUE_SIZE			64	// ranges one worker's deque holds, halving a range only ever leaves about log2 of it queued
+#define JOB_SPLITS_PER_THREAD	8	// ranges are halved down to count / (threads * this)
+#define JOB_MIN_GRAIN			32	// items, smaller ranges cost more to hand out than to run
+
+/*
+ work stealing thread pool for loops whose items can run in any order (the boid and predator updates)
+ ParallelFor gives every worker an equal slice of the loop in its own deque, a worker takes a range off
+ the bottom of its deque and keeps halving it, pushing the far half back, until it is down to the grain,
+ a worker with nothing left steals the biggest range from the top of another worker's deque
+ so while the work is even each worker runs its own slice in order, and where it isn't (a dense part of
+ the flock) the ranges there end up split finely and spread over whoever is free
+ the thread calling ParallelFor works too and returns once every item is done, nothing is allocated
+ per call, Start makes the threads and Stop (or the destructor) joins them, without Start loops run inline
+ only one thread at a time may call ParallelFor (the render thread, or the simulation thread when there is one)
+*/
+
+class JobSystem
+{
+public:
+	JobSystem() {}
+	~JobSystem() { Stop(); }
+	JobSystem(const JobSystem&) = delete;
+	JobSystem&							operator=(const JobSystem&) = delete;
+
+	// threadCount includes the calling thread, 0 for one per core
+	void								Start(unsigned int threadCount = 0);
+	void								Stop();
+	unsigned int						GetThreadCount() const { return m_threadCount; }
+
+	// body(begin, end) for ranges covering 0 to count, called from several threads at once
+	template<class F>
+	void								ParallelFor(unsigned int count, const F& body)
+	{
+		Run(count, [](const void* context, unsigned int begin, unsigned int end) { (*(const F*)context)(begin, end); }, &body);
+	}
+
+	// ranges taken from another worker's deque since Start, to see how uneven the work was
+	unsigned long long					GetSteals() const { return m_steals.load(memory_order_relaxed); }
+
+private:
+	typedef void						(*JobFunction)(const void* context, unsigned int begin, unsigned int end);
+
+	struct JobRange
+	{
+		unsigned int					begin;
+		unsigned int					end;
+	};
+
+	// the owner pushes and pops at the bottom, thieves take from the top
+	// the ranges keep one worker's lock and indices well away from the next worker's
+	struct Worker
+	{
+		mutex							lock;
+		unsigned int					top = 0;
+		unsigned int					bottom = 0;
+		JobRange						ranges[JOB_QUEUE_SIZE];
+	};
+
+	void								Run(unsigned int count, JobFunction function, const void* context);
+	void								WorkerLoop(unsigned int index);
+	// run ranges until every item of the current loop is done
+	void								Work(unsigned int index);
+	bool								Push(unsigned int index, JobRange range);
+	bool								Pop(unsigned int index, JobRange& range);
+	bool								Steal(unsigned int thief, JobRange& range);
+
+	unsigned int						m_threadCount = 1;
+	unique_ptr<Worker[]>				m_workers;
+	vector<thread>						m_threads;
+
+	mutex								m_wakeLock;
+	condition_variable					m_wake;
+	unsigned int						m_generation = 0;	// one more for every loop, so sleeping workers know there is a new one
+	bool								m_quit = false;
+
+	// the loop being run, written before its ranges are pushed
+	JobFunction							m_function = nullptr;
+	const void*							m_context = nullptr;
+	unsigned int						m_grain = JOB_MIN_GRAIN;
+
+	atomic<unsigned int>				m_remaining{ 0 };	// items not finished yet
+	atomic<unsigned long long>			m_steals{ 0 };
+};
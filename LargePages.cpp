@@ -0,0 +1,110 @@
+#include "LargePages.h"
+
+#include <windows.h>
+#include <mutex>
+
+#define PAGED_BLOCK_MIN			(2 * 1024 * 1024) // smaller blocks stay on the heap, a large page is 2MB on x64
+
+bool LargePages::available = false;
+bool LargePages::enabled = false;
+LargePageStats LargePages::stats;
+vector<LargePages::Block> LargePages::blocks;
+
+static mutex blockLock;
+
+bool LargePages::Enable()
+{
+	HANDLE token;
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token))
+		return false;
+
+	TOKEN_PRIVILEGES privileges;
+	privileges.PrivilegeCount = 1;
+	privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	// AdjustTokenPrivileges succeeds without the privilege, it only says so through GetLastError
+	available = LookupPrivilegeValue(nullptr, SE_LOCK_MEMORY_NAME, &privileges.Privileges[0].Luid)
+		&& AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr)
+		&& GetLastError() == ERROR_SUCCESS
+		&& LargePageSize() != 0;
+	CloseHandle(token);
+	return available;
+}
+
+size_t LargePages::LargePageSize()
+{
+	return GetLargePageMinimum();
+}
+
+size_t LargePages::SmallPageSize()
+{
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwPageSize;
+}
+
+void* LargePages::Allocate(size_t bytes)
+{
+	if (!enabled || bytes < PAGED_BLOCK_MIN)
+	{
+		void* p = _aligned_malloc(bytes, CACHE_LINE_SIZE);
+		if (p == nullptr)
+			throw std::bad_alloc();
+		lock_guard<mutex> guard(blockLock);
+		stats.heapBytes += bytes;
+		return p;
+	}
+
+	Block block;
+	void* p = available ? AllocateLarge(bytes, block) : nullptr;
+	bool fellBack = available && p == nullptr;
+	if (p == nullptr)
+		p = AllocateSmall(bytes, block);
+	if (p == nullptr)
+		throw std::bad_alloc();
+
+	lock_guard<mutex> guard(blockLock);
+	(block.large ? stats.largeBytes : stats.smallBytes) += bytes;
+	if (fellBack)
+		stats.fallbacks++;
+	blocks.push_back(block);
+	return p;
+}
+
+void LargePages::Free(void* p, size_t bytes)
+{
+	if (p == nullptr)
+		return;
+
+	{
+		lock_guard<mutex> guard(blockLock);
+		for (size_t i = 0; i < blocks.size(); i++)
+		{
+			if (blocks[i].p != p)
+				continue;
+
+			VirtualFree(p, 0, MEM_RELEASE);
+			(blocks[i].large ? stats.largeBytes : stats.smallBytes) -= bytes;
+			blocks[i] = blocks.back();
+			blocks.pop_back();
+			return;
+		}
+		stats.heapBytes -= bytes;
+	}
+	_aligned_free(p);
+}
+
+void* LargePages::AllocateLarge(size_t bytes, Block& block)
+{
+	size_t pageSize = LargePageSize();
+	size_t size = ((bytes + pageSize - 1) / pageSize) * pageSize;
+	block.large = true;
+	block.p = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+	return block.p;
+}
+
+void* LargePages::AllocateSmall(size_t bytes, Block& block)
+{
+	block.large = false;
+	block.p = VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	return block.p;
+}
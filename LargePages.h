@@ -0,0 +1,84 @@
+#pragma once
+
+#include "AlignedAllocator.h"
+
+#include <vector>
+
+using namespace std;
+
+/*
+ backing for the simulation's big arrays (BoidPopulation, QuantisedPopulation)
+ blocks of at least a large page are taken straight from VirtualAlloc instead of the heap:
+ - with large pages (Enable succeeded and SetEnabled(true)) each 2MB page needs one TLB entry instead of 512
+ - without, normal pages straight from VirtualAlloc
+ pages are left where windows puts them, nothing that reads the arrays is split by NUMA node,
+ so placing each node's share on that node wouldn't bring any of the reads closer
+ smaller blocks, and everything while disabled, come from _aligned_malloc as before
+*/
+
+struct LargePageStats
+{
+	size_t								largeBytes = 0;		// in large pages
+	size_t								smallBytes = 0;		// taken from VirtualAlloc, but in normal pages
+	size_t								heapBytes = 0;		// too small, or disabled
+	unsigned int						fallbacks = 0;		// blocks that wanted large pages and didn't get them
+};
+
+class LargePages
+{
+public:
+	// ask for the lock pages in memory privilege, which large pages need, false if the account doesn't have it
+	// it can be given with secpol.msc, Local Policies, User Rights Assignment, "Lock pages in memory"
+	static bool							Enable();
+	static bool							Available() { return available; }
+	// blocks allocated after this use the paged backing or not, blocks already allocated keep theirs
+	static void							SetEnabled(bool enabled) { LargePages::enabled = enabled; }
+	static bool							GetEnabled() { return enabled; }
+
+	static void*						Allocate(size_t bytes);
+	static void							Free(void* p, size_t bytes);
+
+	// 0 if the cpu or os has no large pages
+	static size_t						LargePageSize();
+	static size_t						SmallPageSize();
+
+	static LargePageStats				GetStats() { return stats; }
+
+private:
+	struct Block
+	{
+		void*							p;
+		bool							large;
+	};
+
+	static void*						AllocateLarge(size_t bytes, Block& block);
+	static void*						AllocateSmall(size_t bytes, Block& block);
+
+	static bool							available;
+	static bool							enabled;
+	static LargePageStats				stats;
+	static vector<Block>				blocks;
+};
+
+// AlignedAllocator for arrays big enough to be worth it, everything comes out at least cache line aligned
+template<class T>
+class LargePageAllocator
+{
+public:
+	typedef T							value_type;
+
+	template<class U>
+	struct rebind { typedef LargePageAllocator<U> other; };
+
+	LargePageAllocator() {}
+	template<class U>
+	LargePageAllocator(const LargePageAllocator<U>&) {}
+
+	T*									allocate(size_t count) { return (T*)LargePages::Allocate(count * sizeof(T)); }
+	void								deallocate(T* p, size_t count) { LargePages::Free(p, count * sizeof(T)); }
+
+	template<class U>
+	bool								operator==(const LargePageAllocator<U>&) const { return true; }
+	template<class U>
+	bool								operator!=(const LargePageAllocator<U>&) const { return false; }
+};
@@ -0,0 +1,155 @@
+#include "MortonOrder.h"
+
+#include <algorithm>
+
+#define RADIX_BITS		8
+#define RADIX_BUCKETS	(1 << RADIX_BITS)
+#define RADIX_PASSES	(32 / RADIX_BITS)
+
+JobSystem* MortonOrder::jobSystem = nullptr;
+
+void MortonOrder::SortBoids(vecBoid& boids, EntityPool<Boid>* pool)
+{
+	unsigned int count = (unsigned int)boids.size();
+	if (count < 2)
+		return;
+
+	// find the area the boids cover so the positions can be scaled to 16 bits
+	XMFLOAT3 lower = *boids[0]->getPosition();
+	XMFLOAT3 upper = lower;
+	for (Boid* b : boids)
+	{
+		XMFLOAT3 p = *b->getPosition();
+		lower.x = min(lower.x, p.x);
+		lower.y = min(lower.y, p.y);
+		upper.x = max(upper.x, p.x);
+		upper.y = max(upper.y, p.y);
+	}
+	float scaleX = 65535.0f / max(upper.x - lower.x, 1.0f);
+	float scaleY = 65535.0f / max(upper.y - lower.y, 1.0f);
+
+	// the keys, the order and the sorted list only last until the boids are put back in order
+	FrameArena& arena = FrameArena::Frame();
+	ArenaScope scope(arena);
+	unsigned int* keys = arena.Allocate<unsigned int>(count);
+	unsigned int* order = arena.Allocate<unsigned int>(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		XMFLOAT3 p = *boids[i]->getPosition();
+		unsigned int x = (unsigned int)((p.x - lower.x) * scaleX);
+		unsigned int y = (unsigned int)((p.y - lower.y) * scaleY);
+		keys[i] = Encode(x, y);
+		order[i] = i;
+	}
+
+	RadixSort(keys, order, count, arena);
+
+	Boid** sorted = arena.Allocate<Boid*>(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		sorted[i] = boids[order[i]];
+	}
+	copy(sorted, sorted + count, boids.begin());
+
+	if (pool != nullptr)
+		pool->Arrange(boids);
+}
+
+unsigned int MortonOrder::SpreadBits(unsigned int v)
+{
+	// put a zero bit between each of the low 16 bits
+	v &= 0x0000ffff;
+	v = (v | (v << 8)) & 0x00ff00ff;
+	v = (v | (v << 4)) & 0x0f0f0f0f;
+	v = (v | (v << 2)) & 0x33333333;
+	v = (v | (v << 1)) & 0x55555555;
+	return v;
+}
+
+unsigned int MortonOrder::Encode(unsigned int x, unsigned int y)
+{
+	return SpreadBits(x) | (SpreadBits(y) << 1);
+}
+
+void MortonOrder::RadixSort(vector<unsigned int>& keys, vector<unsigned int>& values)
+{
+	ArenaScope scope(FrameArena::Frame());
+	RadixSort(keys.data(), values.data(), (unsigned int)keys.size(), FrameArena::Frame());
+}
+
+void MortonOrder::RadixSort(unsigned int* keys, unsigned int* values, unsigned int count, FrameArena& arena)
+{
+	// the pool's threads are already running, so a parallel sort costs no thread launches or allocations
+	unsigned int chunkCount = 1;
+	if (count >= MORTON_PARALLEL_MIN && jobSystem != nullptr && jobSystem->GetThreadCount() > 1)
+		chunkCount = MORTON_CHUNKS;
+
+	// an even number of passes, so the last one writes back into keys and values
+	static_assert(RADIX_PASSES % 2 == 0, "the sorted keys would be left in the temporary arrays");
+	unsigned int* tempKeys = arena.Allocate<unsigned int>(count);
+	unsigned int* tempValues = arena.Allocate<unsigned int>(count);
+
+	// each chunk is counted and scattered on its own, so every pass is split between the threads
+	// offsets go digit first then chunk, which keeps the sort stable
+	unsigned int* histograms = arena.Allocate<unsigned int>(chunkCount * RADIX_BUCKETS);
+	unsigned int chunk = (count + chunkCount - 1) / chunkCount;
+
+	for (unsigned int pass = 0; pass < RADIX_PASSES; pass++)
+	{
+		unsigned int shift = pass * RADIX_BITS;
+
+		auto countDigits = [&](unsigned int begin, unsigned int end)
+		{
+			for (unsigned int c = begin; c < end; c++)
+			{
+				unsigned int* histogram = &histograms[c * RADIX_BUCKETS];
+				fill(histogram, histogram + RADIX_BUCKETS, 0);
+				unsigned int last = min(count, (c + 1) * chunk);
+				for (unsigned int i = c * chunk; i < last; i++)
+				{
+					histogram[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+				}
+			}
+		};
+
+		auto scatter = [&](unsigned int begin, unsigned int end)
+		{
+			for (unsigned int c = begin; c < end; c++)
+			{
+				unsigned int* offsets = &histograms[c * RADIX_BUCKETS];
+				unsigned int last = min(count, (c + 1) * chunk);
+				for (unsigned int i = c * chunk; i < last; i++)
+				{
+					unsigned int slot = offsets[(keys[i] >> shift) & (RADIX_BUCKETS - 1)]++;
+					tempKeys[slot] = keys[i];
+					tempValues[slot] = values[i];
+				}
+			}
+		};
+
+		if (chunkCount > 1)
+			jobSystem->ParallelFor(chunkCount, countDigits);
+		else
+			countDigits(0, 1);
+
+		// turn the counts into where each chunk starts writing each digit
+		unsigned int offset = 0;
+		for (unsigned int digit = 0; digit < RADIX_BUCKETS; digit++)
+		{
+			for (unsigned int c = 0; c < chunkCount; c++)
+			{
+				unsigned int n = histograms[c * RADIX_BUCKETS + digit];
+				histograms[c * RADIX_BUCKETS + digit] = offset;
+				offset += n;
+			}
+		}
+
+		if (chunkCount > 1)
+			jobSystem->ParallelFor(chunkCount, scatter);
+		else
+			scatter(0, 1);
+
+		swap(keys, tempKeys);
+		swap(values, tempValues);
+	}
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Boid.h"
+#include "FrameArena.h"
+#include "JobSystem.h"
+#include "EntityPool.h"
+
+#define MORTON_SORT_INTERVAL	30		// frames between re-sorting the boids
+#define MORTON_PARALLEL_MIN		65536	// below this many boids the sort runs on one thread
+#define MORTON_CHUNKS			256		// the parallel passes are split into this many chunks for the job system to share out
+
+/*
+ orders boids along a z-order (morton) curve of their 2D position, so boids that are
+ close in the world are also close together in the list
+ given the pool the boids live in, the boids themselves are moved into its slots in that order,
+ so updating the list in order means the neighbours a boid reads were mostly just read by
+ the boid before it and are still in cache, without the pool only the list of pointers is
+ sorted and the boids stay wherever they were made
+*/
+
+class MortonOrder
+{
+public:
+	// re-sort the list by the morton code of each boid's position, and the boids in pool to match
+	// pool has to hold exactly the boids in the list, the boids change address so only predators' targets
+	// (which are moved along) may be kept across the sort
+	static void							SortBoids(vecBoid& boids, EntityPool<Boid>* pool = nullptr);
+
+	// interleave the bits of two 16 bit coordinates into a 32 bit code
+	static unsigned int					Encode(unsigned int x, unsigned int y);
+
+	// stable LSD radix sort of keys, values are moved along with their keys
+	static void							RadixSort(vector<unsigned int>& keys, vector<unsigned int>& values);
+	// the same on plain arrays, the temporaries come from arena and are left allocated in it
+	static void							RadixSort(unsigned int* keys, unsigned int* values, unsigned int count, FrameArena& arena);
+
+	// big sorts are split across these threads, nullptr (the default) sorts on the calling thread
+	// sorting then has to stay on the one thread that calls its ParallelFor
+	static void							SetJobSystem(JobSystem* jobs) { jobSystem = jobs; }
+
+private:
+	static unsigned int					SpreadBits(unsigned int v);
+
+	static JobSystem*					jobSystem;
+};
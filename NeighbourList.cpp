@@ -0,0 +1,77 @@
+#include "NeighbourList.h"
+
+NeighbourList::NeighbourList(float radius, float skin)
+{
+	m_radius = radius;
+	m_skin = skin;
+}
+
+NeighbourList::~NeighbourList()
+{
+}
+
+void NeighbourList::Update(float t, vecBoid* boidList, SpatialGrid* grid)
+{
+	m_updateCount++;
+
+	if (NeedsRebuild(t, boidList, grid))
+		Rebuild(boidList, grid);
+}
+
+bool NeighbourList::NeedsRebuild(float t, vecBoid* boidList, SpatialGrid* grid)
+{
+	if (!m_valid || m_buildPositions.size() != boidList->size())
+		return true;
+
+	// boids update in place, so a boid can still move another speed * t before the end of this frame
+	// on a torus a boid that wrapped has only moved a little, not across the world
+	float halfSkin = m_skin * 0.5f;
+	const WorldBounds* bounds = grid->GetWorldBounds();
+	for (unsigned int i = 0; i < boidList->size(); i++)
+	{
+		Boid* b = (*boidList)[i];
+		XMFLOAT3 p = *b->getPosition();
+		if (bounds != nullptr)
+			p = bounds->NearestImage(p, m_buildPositions[i]);
+		float dx = p.x - m_buildPositions[i].x;
+		float dy = p.y - m_buildPositions[i].y;
+		float dz = p.z - m_buildPositions[i].z;
+		float moved = sqrtf((dx * dx) + (dy * dy) + (dz * dz)) + b->GetSpeed() * t;
+		if (moved >= halfSkin)
+			return true;
+	}
+
+	return false;
+}
+
+void NeighbourList::Rebuild(vecBoid* boidList, SpatialGrid* grid)
+{
+	m_rebuildCount++;
+
+	unsigned int count = (unsigned int)boidList->size();
+	m_buildPositions.resize(count);
+	m_starts.resize(count + 1);
+	m_neighbours.clear();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		Boid* b = (*boidList)[i];
+		m_buildPositions[i] = *b->getPosition();
+		m_starts[i] = (unsigned int)m_neighbours.size();
+		grid->ForEachInRadius(m_buildPositions[i], m_radius + m_skin, [&](unsigned int j)
+		{
+			if ((*boidList)[j] != b)
+				m_neighbours.push_back((*boidList)[j]);
+		});
+	}
+	m_starts[count] = (unsigned int)m_neighbours.size();
+
+	// only once the array has stopped moving
+	for (unsigned int i = 0; i < count; i++)
+	{
+		BoidSpan cache = { m_neighbours.data() + m_starts[i], m_starts[i + 1] - m_starts[i] };
+		(*boidList)[i]->SetNeighbourCache(cache);
+		(*boidList)[i]->SetNeighbourCacheValid(true);
+	}
+
+	m_valid = true;
+}
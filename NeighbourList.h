@@ -0,0 +1,50 @@
+#pragma once
+
+#include "Boid.h"
+#include "SpatialGrid.h"
+
+#define NEIGHBOUR_SKIN_DEFAULT	20.0f
+
+/*
+ verlet style neighbour lists
+ every boid keeps a list of the boids within NEARBY_DISTANCE + skin, built from the grid
+ the lists are only rebuilt once a boid could have moved more than half the skin since the last build,
+ until then NearbyBoids just filters its own short list
+ the lists are kept end to end in one array and each boid gets a span of it, so a rebuild only
+ allocates when the lists together outgrow every earlier rebuild
+*/
+
+class NeighbourList
+{
+public:
+	NeighbourList(float radius, float skin = NEIGHBOUR_SKIN_DEFAULT);
+	~NeighbourList();
+
+	// call once per frame after the grid has been built, rebuilds the lists if they could be out of date by the end of the frame
+	void								Update(float t, vecBoid* boidList, SpatialGrid* grid);
+	// force a rebuild on the next update, e.g. after a boid has been removed
+	void								Invalidate() { m_valid = false; }
+
+	float								GetSkin() { return m_skin; }
+	void								SetSkin(float skin) { m_skin = skin; m_valid = false; }
+
+	// how often the lists are rebuilt, for tuning the skin
+	unsigned int						GetRebuildCount() { return m_rebuildCount; }
+	unsigned int						GetUpdateCount() { return m_updateCount; }
+	void								ResetCounters() { m_rebuildCount = 0; m_updateCount = 0; }
+
+protected:
+	bool								NeedsRebuild(float t, vecBoid* boidList, SpatialGrid* grid);
+	void								Rebuild(vecBoid* boidList, SpatialGrid* grid);
+
+	float								m_radius;
+	float								m_skin;
+	bool								m_valid = false;
+
+	unsigned int						m_rebuildCount = 0;
+	unsigned int						m_updateCount = 0;
+
+	vector<XMFLOAT3>					m_buildPositions; // where each boid was when the lists were last built
+	vector<Boid*>						m_neighbours; // every boid's list, in boid list order
+	vector<unsigned int>				m_starts; // where each boid's list starts in m_neighbours, with one past the end
+};
@@ -0,0 +1,78 @@
+#include "PerceptionCone.h"
+
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define PERCEPTION_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define PERCEPTION_SSE
+#endif
+
+float PerceptionCone::CosHalfAngle(float fovDegrees)
+{
+	return cosf(fovDegrees * 0.5f * XM_PI / 180.0f);
+}
+
+bool PerceptionCone::Inside(float dirX, float dirY, float cosHalfAngle, float toX, float toY)
+{
+	// dot = |dir| |to| cos(angle), so compare against |dir| |to| cos(fov / 2)
+	float dot = (dirX * toX) + (dirY * toY);
+	float lengths = sqrtf(((dirX * dirX) + (dirY * dirY)) * ((toX * toX) + (toY * toY)));
+	return dot >= cosHalfAngle * lengths;
+}
+
+bool PerceptionCone::Inside(float dirX, float dirY, float dirZ, float cosHalfAngle, float toX, float toY, float toZ)
+{
+	float dot = (dirX * toX) + (dirY * toY) + (dirZ * toZ);
+	float lengths = sqrtf(((dirX * dirX) + (dirY * dirY) + (dirZ * dirZ)) * ((toX * toX) + (toY * toY) + (toZ * toZ)));
+	return dot >= cosHalfAngle * lengths;
+}
+
+unsigned int PerceptionCone::InsideBatch(float dirX, float dirY, float cosHalfAngle, const float* toX, const float* toY, unsigned int count)
+{
+	unsigned int inside = 0;
+	unsigned int i = 0;
+
+#if defined(PERCEPTION_AVX)
+	__m256 dx = _mm256_set1_ps(dirX);
+	__m256 dy = _mm256_set1_ps(dirY);
+	__m256 dirLengthSq = _mm256_set1_ps((dirX * dirX) + (dirY * dirY));
+	__m256 cosHalf = _mm256_set1_ps(cosHalfAngle);
+	for (; i + 8 <= count; i += 8)
+	{
+		__m256 tx = _mm256_loadu_ps(toX + i);
+		__m256 ty = _mm256_loadu_ps(toY + i);
+		__m256 dot = _mm256_add_ps(_mm256_mul_ps(dx, tx), _mm256_mul_ps(dy, ty));
+		__m256 toLengthSq = _mm256_add_ps(_mm256_mul_ps(tx, tx), _mm256_mul_ps(ty, ty));
+		__m256 lengths = _mm256_sqrt_ps(_mm256_mul_ps(dirLengthSq, toLengthSq));
+		__m256 result = _mm256_cmp_ps(dot, _mm256_mul_ps(cosHalf, lengths), _CMP_GE_OQ);
+		inside |= (unsigned int)_mm256_movemask_ps(result) << i;
+	}
+#elif defined(PERCEPTION_SSE)
+	__m128 dx = _mm_set1_ps(dirX);
+	__m128 dy = _mm_set1_ps(dirY);
+	__m128 dirLengthSq = _mm_set1_ps((dirX * dirX) + (dirY * dirY));
+	__m128 cosHalf = _mm_set1_ps(cosHalfAngle);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 tx = _mm_loadu_ps(toX + i);
+		__m128 ty = _mm_loadu_ps(toY + i);
+		__m128 dot = _mm_add_ps(_mm_mul_ps(dx, tx), _mm_mul_ps(dy, ty));
+		__m128 toLengthSq = _mm_add_ps(_mm_mul_ps(tx, tx), _mm_mul_ps(ty, ty));
+		__m128 lengths = _mm_sqrt_ps(_mm_mul_ps(dirLengthSq, toLengthSq));
+		__m128 result = _mm_cmpge_ps(dot, _mm_mul_ps(cosHalf, lengths));
+		inside |= (unsigned int)_mm_movemask_ps(result) << i;
+	}
+#endif
+
+	// whatever doesn't fill a register, or everything without SSE
+	for (; i < count; i++)
+	{
+		if (Inside(dirX, dirY, cosHalfAngle, toX[i], toY[i]))
+			inside |= 1u << i;
+	}
+
+	return inside;
+}
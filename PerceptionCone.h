@@ -0,0 +1,29 @@
+#pragma once
+
+#include <DirectXMath.h>
+
+using namespace DirectX;
+
+#define PERCEPTION_BATCH	8	// vectors tested together, one AVX register or two SSE ones
+
+/*
+ field of view test with a dot product instead of angles
+ a vector is inside the cone when the cosine of its angle to the direction is at least
+ cos(fov / 2), which each boid works out once, so there is no trigonometry per test
+ gives the same answer as Boid::CompareAngle except right on the edge of the cone
+*/
+
+class PerceptionCone
+{
+public:
+	// cosine of half a field of view given in degrees
+	static float						CosHalfAngle(float fovDegrees);
+
+	// is (toX, toY) within the cone around (dirX, dirY)
+	static bool							Inside(float dirX, float dirY, float cosHalfAngle, float toX, float toY);
+	// the same in 3d, where the field of view is a real cone
+	static bool							Inside(float dirX, float dirY, float dirZ, float cosHalfAngle, float toX, float toY, float toZ);
+
+	// tests count vectors (up to 32) against one cone, bit i of the result is set if vector i is inside
+	static unsigned int					InsideBatch(float dirX, float dirY, float cosHalfAngle, const float* toX, const float* toY, unsigned int count);
+};
@@ -1,25 +1,32 @@
 #include "Predator.h"
 #include "Boid.h"
 
+const WorldBounds* Predator::worldBounds = nullptr;
+
 Predator::Predator()
 {
 	m_scale = 3.0f;
+	m_random = Boid::RandomSeed();
 	CreateRandomDirection();
 }
 
 Predator::~Predator()
 {
-	if (targetedBoid != nullptr) targetedBoid = nullptr; delete targetedBoid;
+	// the boid would be left claimed by a deleted predator
+	ReleaseTarget();
+}
+
+void Predator::Respawn()
+{
+	m_random = Boid::RandomSeed();
+	CreateRandomDirection();
+	ReleaseTarget();
+	speed = PREDATOR_SPEED_DEFAULT;
 }
 
 void Predator::CreateRandomDirection()
 {
-	float x = (float)(rand() % 10);
-	x -= 5;
-	float y = (float)(rand() % 10);
-	y -= 5;
-	float z = 0;
-	SetDirection(XMFLOAT3(x, y, z));
+	SetDirection(Boid::RandomDirection(m_random));
 }
 
 void Predator::SetDirection(XMFLOAT3 direction)
@@ -29,9 +36,21 @@ void Predator::SetDirection(XMFLOAT3 direction)
 	XMStoreFloat3(&m_direction, v);
 }
 
-void Predator::Update(float t, vecBoid* boidList)
+void Predator::Update(float t, vecBoid* boidList, SpatialGrid* grid, QuadTree* tree)
 {
-	XMFLOAT3 nearbyBoidsVec = VecToNearbyBoids(boidList);
+	// chase one boid once there is one in sight, otherwise head for the flock
+	// a BoidPopulation has no boids to claim
+	XMFLOAT3 nearbyBoidsVec;
+	if (boidList != nullptr && grid != nullptr && (KeepTarget() || ChooseTarget(boidList, grid)))
+	{
+		nearbyBoidsVec = NearestImage(*targetedBoid->getPosition());
+		nearbyBoidsVec = SubtractFloat3(nearbyBoidsVec, m_position);
+		nearbyBoidsVec = NormaliseFloat3(nearbyBoidsVec);
+	}
+	else
+	{
+		nearbyBoidsVec = VecToNearbyBoids(boidList, grid, tree);
+	}
 	m_direction = AddFloat3(m_direction, nearbyBoidsVec);
 	//m_direction = VecToNearbyBoids(boidList);
 
@@ -53,24 +72,109 @@ void Predator::Update(float t, vecBoid* boidList)
 	DrawableGameObject::update(t);
 }
 
-XMFLOAT3 Predator::VecToNearbyBoids(vecBoid* boidList)
+void Predator::ReleaseTarget()
 {
-	XMFLOAT3 nearby = XMFLOAT3(0, 0, 0);
+	if (targetedBoid != nullptr)
+		targetedBoid->ReleaseClaim(this);
+	targetedBoid = nullptr;
+}
 
-	for (Boid* b : *boidList)
+bool Predator::KeepTarget()
+{
+	if (targetedBoid == nullptr)
+		return false;
+
+	XMFLOAT3 vB = NearestImage(*targetedBoid->getPosition());
+	XMFLOAT3 vDiff = SubtractFloat3(vB, m_position);
+	float lSq = (vDiff.x * vDiff.x) + (vDiff.y * vDiff.y) + (vDiff.z * vDiff.z);
+	if (targetedBoid->GetAlive() && targetedBoid->GetTargetedBy() == this && lSq < PREDATOR_SIGHT_DISTANCE * PREDATOR_SIGHT_DISTANCE)
+		return true;
+
+	ReleaseTarget();
+	return false;
+}
+
+bool Predator::ChooseTarget(vecBoid* boidList, SpatialGrid* grid)
+{
+	// the nearest few that were free when they were looked at, nearest first
+	pair<float, Boid*> candidates[PREDATOR_CANDIDATES];
+	unsigned int count = 0;
+	grid->ForEachInRadius(m_position, PREDATOR_SIGHT_DISTANCE, [&](unsigned int i)
 	{
-		XMFLOAT3 vB = *(b->getPosition());
+		Boid* b = (*boidList)[i];
+		if (!b->GetAlive() || b->GetTargeted())
+			return;
+
+		XMFLOAT3 vB = NearestImage(*b->getPosition());
 		XMFLOAT3 vDiff = SubtractFloat3(vB, m_position);
-		float l = MagnitudeFloat3(vDiff);
+		float lSq = (vDiff.x * vDiff.x) + (vDiff.y * vDiff.y) + (vDiff.z * vDiff.z);
+		if (count == PREDATOR_CANDIDATES && lSq >= candidates[count - 1].first)
+			return;
+
+		unsigned int slot = min(count, (unsigned int)PREDATOR_CANDIDATES - 1);
+		for (; slot > 0 && candidates[slot - 1].first > lSq; slot--)
+			candidates[slot] = candidates[slot - 1];
+		candidates[slot] = make_pair(lSq, b);
+		count = min(count + 1, (unsigned int)PREDATOR_CANDIDATES);
+	});
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (candidates[i].second->TryClaim(this))
+		{
+			targetedBoid = candidates[i].second;
+			m_claims++;
+			return true;
+		}
+		m_lostClaims++;
+	}
+	return false;
+}
 
-		vDiff = NormaliseFloat3(vDiff);
-		vDiff = DivideFloat3(vDiff, l); // closer boids will have a greater weight
-		nearby = AddFloat3(nearby, vDiff);
+XMFLOAT3 Predator::VecToNearbyBoids(vecBoid* boidList, SpatialGrid* grid, QuadTree* tree)
+{
+	XMFLOAT3 nearby = XMFLOAT3(0, 0, 0);
+
+	// with a BoidPopulation there is no list, the grid (and tree) are built from its arrays instead
+	unsigned int boidCount = boidList != nullptr ? (unsigned int)boidList->size() : grid->GetCount();
+
+	if (tree != nullptr)
+	{
+		// barnes-hut, distant groups of boids are summed as one
+		// the tree doesn't wrap, on a torus boids over an edge pull from the far side
+		nearby = tree->InverseDistanceSum(m_position);
+	}
+	else if (grid != nullptr)
+	{
+		// every boid pulls on the predator, read them from the grid's packed positions instead of through each boid
+		for (const XMFLOAT3& p : grid->GetSortedPositions())
+		{
+			XMFLOAT3 vB = NearestImage(p);
+			XMFLOAT3 vDiff = SubtractFloat3(vB, m_position);
+			float l = MagnitudeFloat3(vDiff);
+
+			vDiff = NormaliseFloat3(vDiff);
+			vDiff = DivideFloat3(vDiff, l); // closer boids will have a greater weight
+			nearby = AddFloat3(nearby, vDiff);
+		}
+	}
+	else if (boidList != nullptr)
+	{
+		for (Boid* b : *boidList)
+		{
+			XMFLOAT3 vB = NearestImage(*b->getPosition());
+			XMFLOAT3 vDiff = SubtractFloat3(vB, m_position);
+			float l = MagnitudeFloat3(vDiff);
+
+			vDiff = NormaliseFloat3(vDiff);
+			vDiff = DivideFloat3(vDiff, l); // closer boids will have a greater weight
+			nearby = AddFloat3(nearby, vDiff);
+		}
 	}
 
 	if (MagnitudeFloat3(nearby) > 0)
 	{
-		nearby = DivideFloat3(nearby, boidList->size());
+		nearby = DivideFloat3(nearby, (float)boidCount);
 		nearby = NormaliseFloat3(nearby);
 	}
 
@@ -132,40 +236,3 @@ XMFLOAT3 Predator::NormaliseFloat3(XMFLOAT3& f1)
 
 	return f1;
 }
-
-void Predator::CheckIsOnScreenAndFix(const XMMATRIX& view, const XMMATRIX& proj)
-{
-	XMFLOAT4 v4;
-	v4.x = m_position.x;
-	v4.y = m_position.y;
-	v4.z = m_position.z;
-	v4.w = 1.0f;
-
-	XMVECTOR vScreenSpace = XMLoadFloat4(&v4);
-	XMVECTOR vScreenSpace2 = XMVector4Transform(vScreenSpace, view);
-	XMVECTOR vScreenSpace3 = XMVector4Transform(vScreenSpace2, proj);
-
-	XMFLOAT4 v;
-	XMStoreFloat4(&v, vScreenSpace3);
-	v.x /= v.w;
-	v.y /= v.w;
-	v.z /= v.w;
-	v.w /= v.w;
-
-	float fOffset = 10; // a suitable distance to rectify position within clip space
-	if (v.x < -1 || v.x > 1 || v.y < -1 || v.y > 1)
-	{
-		if (v.x < -1 || v.x > 1) {
-			v4.x = -v4.x + (fOffset * v.x);
-		}
-		else if (v.y < -1 || v.y > 1) {
-			v4.y = -v4.y + (fOffset * v.y);
-		}
-	}
-
-	m_position.x = v4.x;
-	m_position.y = v4.y;
-	m_position.z = v4.z;
-
-	return;
-}
\ No newline at end of file
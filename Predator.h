@@ -1,26 +1,50 @@
 #pragma once
 
 #include "DrawableGameObject.h"
+#include "SpatialGrid.h"
+#include "QuadTree.h"
 
 #define PREDATOR_SPEED_DEFAULT 150.0f
+#define PREDATOR_SIGHT_DISTANCE	150.0f	// a predator picks a boid to chase from this close, and gives up on one that gets further away
+#define PREDATOR_CANDIDATES		8		// the nearest unclaimed boids tried in turn, in case another predator claims one first
 
 class Boid;
 
 class Predator : public DrawableGameObject
 {
+	friend class Benchmark;
+
 public:
 	Predator();
 	~Predator();
 
 	XMFLOAT3*							GetDirection() { return &m_direction; }
-	void								CheckIsOnScreenAndFix(const XMMATRIX& view, const XMMATRIX& proj);
-	void								Update(float t, vecBoid* boidList);
+	void								Update(float t, vecBoid* boidList, SpatialGrid* grid, QuadTree* tree);
+	// a new predator in this one's place for EntityPool, keeping the mesh
+	void								Respawn();
+
+	// the boid this predator has claimed and is chasing, nullptr while it roams towards the flock
+	Boid*								GetTarget() { return targetedBoid; }
+	// let go of the target, main calls it before removing the boid (Boid::GetTargetedBy says who to tell)
+	void								ReleaseTarget();
+	// the target's state was moved to another pool slot, the claim went with it
+	void								TargetMoved(Boid* target) { targetedBoid = target; }
+	// claims made, and claims lost to another predator between seeing a boid was free and claiming it
+	unsigned int						GetClaims() { return m_claims; }
+	unsigned int						GetLostClaims() { return m_lostClaims; }
+
+	// boids pull across the edges of these bounds, nullptr for an open plane
+	static void							SetWorldBounds(const WorldBounds* bounds) { worldBounds = bounds; }
 
 protected:
 	void								SetDirection(XMFLOAT3 direction);
 
 	//vecBoid								NearbyBoids(vecBoid* boidList);
-	XMFLOAT3							VecToNearbyBoids(vecBoid* boidList);
+	XMFLOAT3							VecToNearbyBoids(vecBoid* boidList, SpatialGrid* grid, QuadTree* tree);
+	// keep chasing the target, or let it go if it died or got out of sight
+	bool								KeepTarget();
+	// claim the nearest free boid in sight, trying the next nearest if another predator claims it first
+	bool								ChooseTarget(vecBoid* boidList, SpatialGrid* grid);
 	void								CreateRandomDirection();
 
 	XMFLOAT3							AddFloat3(XMFLOAT3& f1, XMFLOAT3& f2);
@@ -30,9 +54,17 @@ protected:
 	XMFLOAT3							MultiplyFloat3(XMFLOAT3& f1, const float scalar);
 	XMFLOAT3							DivideFloat3(XMFLOAT3& f1, const float scalar);
 
+	// the copy of a boid's position closest to this predator when the world wraps
+	XMFLOAT3							NearestImage(const XMFLOAT3& position) { return worldBounds != nullptr ? worldBounds->NearestImage(position, m_position) : position; }
+
 	XMFLOAT3							m_direction;
 
-	Boid*								targetedBoid = nullptr;
+	Boid*								targetedBoid = nullptr; // claimed with Boid::TryClaim, only this predator reads or writes it
+	unsigned int						m_claims = 0;
+	unsigned int						m_lostClaims = 0;
 
 	float								speed = PREDATOR_SPEED_DEFAULT;
+	unsigned int						m_random; // this predator's random stream, see Boid::RandomDirection
+
+	static const WorldBounds*			worldBounds;
 };
\ No newline at end of file
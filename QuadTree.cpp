@@ -0,0 +1,172 @@
+#include "QuadTree.h"
+#include "MortonOrder.h"
+
+#include <algorithm>
+
+QuadTree::QuadTree(float theta)
+{
+	m_theta = theta;
+}
+
+QuadTree::~QuadTree()
+{
+}
+
+void QuadTree::Build(const vector<XMFLOAT3>& positions)
+{
+	unsigned int count = (unsigned int)positions.size();
+	m_nodes.clear();
+	m_points.resize(count);
+	if (count == 0)
+		return;
+
+	// the root is the smallest square around every boid
+	XMFLOAT2 lower = XMFLOAT2(positions[0].x, positions[0].y);
+	XMFLOAT2 upper = lower;
+	for (const XMFLOAT3& p : positions)
+	{
+		lower.x = min(lower.x, p.x);
+		lower.y = min(lower.y, p.y);
+		upper.x = max(upper.x, p.x);
+		upper.y = max(upper.y, p.y);
+	}
+	float size = max(max(upper.x - lower.x, upper.y - lower.y), 1.0f);
+	float scale = 65535.0f / size;
+
+	m_codes.resize(count);
+	m_order.resize(count);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		unsigned int x = (unsigned int)((positions[i].x - lower.x) * scale);
+		unsigned int y = (unsigned int)((positions[i].y - lower.y) * scale);
+		m_codes[i] = MortonOrder::Encode(x, y);
+		m_order[i] = i;
+	}
+	MortonOrder::RadixSort(m_codes, m_order);
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		m_points[i] = XMFLOAT2(positions[m_order[i]].x, positions[m_order[i]].y);
+	}
+
+	QuadNode root = {};
+	root.halfSize = size * 0.5f;
+	root.firstPoint = 0;
+	root.lastPoint = count;
+	m_nodes.push_back(root);
+
+	Subdivide(0, 0);
+}
+
+void QuadTree::Subdivide(unsigned int node, unsigned int depth)
+{
+	// note m_nodes can grow below, so the node is always looked up by index
+	unsigned int first = m_nodes[node].firstPoint;
+	unsigned int last = m_nodes[node].lastPoint;
+	m_nodes[node].count = last - first;
+
+	if (last - first <= QUADTREE_LEAF_SIZE || depth >= QUADTREE_MAX_DEPTH)
+	{
+		// leaf - work out the centre of mass directly
+		XMFLOAT2 sum = XMFLOAT2(0, 0);
+		for (unsigned int i = first; i < last; i++)
+		{
+			sum.x += m_points[i].x;
+			sum.y += m_points[i].y;
+		}
+		float count = (float)max(last - first, 1u);
+		m_nodes[node].massCentre = XMFLOAT2(sum.x / count, sum.y / count);
+		m_nodes[node].firstChild = 0;
+		return;
+	}
+
+	// every point in this node shares the code above these two bits, which pick the quarter (x low bit, y high bit)
+	unsigned int shift = 2 * (QUADTREE_MAX_DEPTH - 1 - depth);
+	unsigned int prefix = (unsigned int)(m_codes[first] & ~((4ull << shift) - 1));
+	unsigned int bounds[5] = { first, 0, 0, 0, last };
+	for (unsigned int c = 1; c < 4; c++)
+	{
+		bounds[c] = (unsigned int)(lower_bound(m_codes.begin() + first, m_codes.begin() + last, prefix | (c << shift)) - m_codes.begin());
+	}
+
+	unsigned int firstChild = (unsigned int)m_nodes.size();
+	m_nodes[node].firstChild = firstChild;
+	for (unsigned int c = 0; c < 4; c++)
+	{
+		QuadNode child = {};
+		child.halfSize = m_nodes[node].halfSize * 0.5f;
+		child.firstPoint = bounds[c];
+		child.lastPoint = bounds[c + 1];
+		m_nodes.push_back(child);
+	}
+
+	// the centre of mass of this node is the weighted average of its children
+	XMFLOAT2 sum = XMFLOAT2(0, 0);
+	for (unsigned int c = 0; c < 4; c++)
+	{
+		Subdivide(firstChild + c, depth + 1);
+
+		const QuadNode& child = m_nodes[firstChild + c];
+		sum.x += child.massCentre.x * child.count;
+		sum.y += child.massCentre.y * child.count;
+	}
+	float count = (float)m_nodes[node].count;
+	m_nodes[node].massCentre = XMFLOAT2(sum.x / count, sum.y / count);
+}
+
+XMFLOAT3 QuadTree::InverseDistanceSum(const XMFLOAT3& position) const
+{
+	XMFLOAT3 sum = XMFLOAT3(0, 0, 0);
+	if (m_nodes.empty())
+		return sum;
+
+	float thetaSq = m_theta * m_theta;
+
+	// depth first, every level adds at most three more nodes than it removes
+	unsigned int stack[QUADTREE_MAX_DEPTH * 3 + 4];
+	unsigned int stackSize = 0;
+	stack[stackSize++] = 0;
+
+	while (stackSize > 0)
+	{
+		const QuadNode& node = m_nodes[stack[--stackSize]];
+		if (node.count == 0)
+			continue;
+
+		if (node.firstChild == 0)
+		{
+			// leaf - add each boid exactly
+			for (unsigned int i = node.firstPoint; i < node.lastPoint; i++)
+			{
+				float dx = m_points[i].x - position.x;
+				float dy = m_points[i].y - position.y;
+				float lSq = (dx * dx) + (dy * dy);
+				if (lSq > 0.0f)
+				{
+					sum.x += dx / lSq;
+					sum.y += dy / lSq;
+				}
+			}
+			continue;
+		}
+
+		float dx = node.massCentre.x - position.x;
+		float dy = node.massCentre.y - position.y;
+		float lSq = (dx * dx) + (dy * dy);
+		float size = node.halfSize * 2.0f;
+
+		if (size * size < thetaSq * lSq)
+		{
+			// far enough away to count the whole node as one boid at its centre of mass
+			sum.x += node.count * dx / lSq;
+			sum.y += node.count * dy / lSq;
+		}
+		else
+		{
+			for (unsigned int c = 0; c < 4; c++)
+				stack[stackSize++] = node.firstChild + c;
+		}
+	}
+
+	return sum;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+#include <DirectXMath.h>
+
+using namespace std;
+using namespace DirectX;
+
+#define QUADTREE_LEAF_SIZE			8
+#define QUADTREE_MAX_DEPTH			16		// one level per bit of the 16 bit morton coordinates
+#define BARNES_HUT_THETA_DEFAULT	0.5f
+
+/*
+ quadtree over boid positions for barnes-hut sums
+ every node stores how many boids are under it and their centre of mass, so a group
+ of boids that is far enough away can be treated as one heavy boid at its centre
+ the points are sorted along a morton curve first, which makes every node a contiguous
+ run of the sorted points and splitting a node just a search for where the code changes
+*/
+
+struct QuadNode
+{
+	float								halfSize;		// of the square this node covers
+	XMFLOAT2							massCentre;		// average position of the boids under this node
+	unsigned int						count;
+	unsigned int						firstChild;		// the four children are stored together, 0 for a leaf
+	unsigned int						firstPoint;		// leaves only, range in m_points
+	unsigned int						lastPoint;
+};
+
+class QuadTree
+{
+public:
+	QuadTree(float theta = BARNES_HUT_THETA_DEFAULT);
+	~QuadTree();
+
+	void								Build(const vector<XMFLOAT3>& positions);
+
+	// sum of (boid - position) / distance^2 over every boid, the inverse distance weighted pull the predator uses
+	// nodes smaller than theta * distance are not opened, theta of 0 gives the exact sum
+	XMFLOAT3							InverseDistanceSum(const XMFLOAT3& position) const;
+
+	float								GetTheta() { return m_theta; }
+	void								SetTheta(float theta) { m_theta = theta; }
+	unsigned int						GetCount() { return (unsigned int)m_points.size(); }
+
+protected:
+	void								Subdivide(unsigned int node, unsigned int depth);
+
+	float								m_theta;
+	vector<QuadNode>					m_nodes;
+	vector<XMFLOAT2>					m_points;		// in morton order, nodes own contiguous ranges of this
+	vector<unsigned int>				m_codes;		// morton code of each point
+	vector<unsigned int>				m_order;
+};
@@ -0,0 +1,233 @@
+#pragma once
+
+#include "SteeringKernel.h"
+
+// the body of SteeringKernel::Run for a QuantisedFrame, included by the file built for each instruction set
+// the same rules as SteerBatchesIn in 2d, but a batch is up to S::Width boids from one cell and everything is
+// worked out relative to that cell's corner, neighbours in the cells around it are a whole number of cells away
+// so there is no wrapping to do and the small numbers keep more precision than world positions would
+// static like everything else here, see SteeringKernel.h
+
+template<class S>
+static void SteerQuantisedBatches(const QuantisedFrame& f)
+{
+	typedef typename S::V V;
+	typedef typename S::M M;
+	const unsigned int W = S::Width;
+
+	const V zero = S::Set(0.0f);
+	const V one = S::Set(1.0f);
+	const V half = S::Set(0.5f);
+	const V lanes = S::Lanes();
+	const V nearbySq = S::Set(f.nearbyDistance * f.nearbyDistance);
+	const V separationSq = S::Set(f.separationDistance * f.separationDistance);
+	const V killDistanceSq = S::Set(f.killDistance * f.killDistance);
+	const V separationScale = S::Set(f.separationScale);
+	const V alignmentScale = S::Set(f.alignmentScale);
+	const V cohesionScale = S::Set(f.cohesionScale);
+	const V fleeScale = S::Set(f.fleeScale);
+
+	// decoding
+	const float unitX = f.cellSize[0] / QUANTISED_OFFSET_STEPS;
+	const float unitY = f.cellSize[1] / QUANTISED_OFFSET_STEPS;
+	const float directionUnit = 1.0f / QUANTISED_DIRECTION_STEPS;
+	const V offsetUnit[2] = { S::Set(unitX), S::Set(unitY) };
+	const V direction1 = S::Set(directionUnit);
+	const V speedStep = S::Set(f.t);
+	const V speedBase = S::Set(f.t * f.speedDefault);
+	const V fleeBase = S::Set(f.fleeDistanceMin);
+
+	// predators are kept as world positions, so they still need the short way round
+	const V size[2] = { S::Set(f.worldSize[0]), S::Set(f.worldSize[1]) };
+	const V invSize[2] = { S::Set(1.0f / f.worldSize[0]), S::Set(1.0f / f.worldSize[1]) };
+	const bool predators = f.predatorGrid != nullptr && f.predatorCount > 0;
+
+	auto length = [&](const V* v)
+	{
+		return S::Sqrt(S::Add(S::Mul(v[0], v[0]), S::Mul(v[1], v[1])));
+	};
+	auto normalise = [&](V* v)
+	{
+		V l = length(v);
+		v[0] = S::Div(v[0], l);
+		v[1] = S::Div(v[1], l);
+	};
+
+	float newX[SIMD_MAX_WIDTH], newY[SIMD_MAX_WIDTH];
+	float newDirectionX[SIMD_MAX_WIDTH], newDirectionY[SIMD_MAX_WIDTH];
+
+	for (unsigned int cell = f.cellBegin; cell < f.cellEnd; cell++)
+	{
+		const unsigned int cx = cell % f.cellsX;
+		const unsigned int cy = cell / f.cellsX;
+		const unsigned int begin = f.cellStart[cell];
+		const unsigned int end = f.cellStart[cell + 1];
+		if (begin == end)
+			continue;
+
+		// the 3 by 3 cells around this one and where their corners are from this one's
+		unsigned int around[9];
+		float shiftX[9], shiftY[9];
+		for (int dy = -1, c = 0; dy <= 1; dy++)
+		{
+			for (int dx = -1; dx <= 1; dx++, c++)
+			{
+				unsigned int x = (cx + f.cellsX + dx) % f.cellsX;
+				unsigned int y = (cy + f.cellsY + dy) % f.cellsY;
+				around[c] = (y * f.cellsX) + x;
+				shiftX[c] = dx * f.cellSize[0];
+				shiftY[c] = dy * f.cellSize[1];
+			}
+		}
+		const float corner[2] = { f.lower[0] + (cx * f.cellSize[0]), f.lower[1] + (cy * f.cellSize[1]) };
+
+		for (unsigned int s = begin, n = 0; s < end; s += n)
+		{
+			n = SmallerOf(W, end - s);
+			const M valid = S::Less(lanes, S::Set((float)n));
+
+			V p[2] = { S::Mul(S::LoadUnsignedShort(f.offsetX + s), offsetUnit[0]), S::Mul(S::LoadUnsignedShort(f.offsetY + s), offsetUnit[1]) };
+			V dir[2] = { S::Mul(S::LoadShort(f.directionX + s), direction1), S::Mul(S::LoadShort(f.directionY + s), direction1) };
+
+			V separation[2] = { zero, zero };
+			V direction[2] = { zero, zero };
+			V position[2] = { zero, zero };
+			V separationCount = zero;
+			V count = zero;
+
+			for (unsigned int c = 0; c < 9; c++)
+			{
+				const unsigned int to = f.cellStart[around[c] + 1];
+				for (unsigned int j = f.cellStart[around[c]]; j < to; j++)
+				{
+					V b[2] = { S::Set((f.offsetX[j] * unitX) + shiftX[c]), S::Set((f.offsetY[j] * unitY) + shiftY[c]) };
+					V d[2] = { S::Sub(p[0], b[0]), S::Sub(p[1], b[1]) };
+					V lSq = S::Add(S::Mul(d[0], d[0]), S::Mul(d[1], d[1]));
+
+					M nearby = S::And(S::Less(lSq, nearbySq), valid);
+					if (c == 4 && j - s < W)
+						nearby = S::And(nearby, S::NotEqual(lanes, S::Set((float)(j - s)))); // not itself
+					if (!S::Any(nearby))
+						continue;
+
+					direction[0] = S::Add(direction[0], S::Select(nearby, S::Set(f.directionX[j] * directionUnit), zero));
+					direction[1] = S::Add(direction[1], S::Select(nearby, S::Set(f.directionY[j] * directionUnit), zero));
+					position[0] = S::Add(position[0], S::Select(nearby, b[0], zero));
+					position[1] = S::Add(position[1], S::Select(nearby, b[1], zero));
+					count = S::Add(count, S::Select(nearby, one, zero));
+
+					M close = S::And(S::And(nearby, S::Less(lSq, separationSq)), S::Greater(lSq, zero)); // not exactly on top, see Boid
+					if (S::Any(close))
+					{
+						// closer boids will have a greater weight
+						V l = S::Sqrt(lSq);
+						separation[0] = S::Add(separation[0], S::Select(close, S::Div(S::Div(d[0], l), l), zero));
+						separation[1] = S::Add(separation[1], S::Select(close, S::Div(S::Div(d[1], l), l), zero));
+						separationCount = S::Add(separationCount, S::Select(close, one, zero));
+					}
+				}
+			}
+
+			// each rule falls back to the current direction when it has nothing to go on, as in Boid
+			M separating = S::Greater(length(separation), zero);
+			separation[0] = S::Div(separation[0], separationCount);
+			separation[1] = S::Div(separation[1], separationCount);
+			normalise(separation);
+
+			V alignment[2] = { S::Div(direction[0], count), S::Div(direction[1], count) };
+			V cohesion[2] = { S::Sub(S::Div(position[0], count), p[0]), S::Sub(S::Div(position[1], count), p[1]) };
+			M aligning = S::Greater(length(alignment), zero);
+			M cohering = S::Greater(length(cohesion), zero);
+			normalise(alignment);
+			normalise(cohesion);
+
+			for (unsigned int k = 0; k < 2; k++)
+			{
+				separation[k] = S::Select(separating, separation[k], dir[k]);
+				alignment[k] = S::Select(aligning, alignment[k], dir[k]);
+				cohesion[k] = S::Select(cohering, cohesion[k], dir[k]);
+			}
+
+			// flee from the predators in range and in the field of view, caught if one is within the kill distance
+			V flee[2] = { zero, zero };
+			M caught = S::Less(one, zero);
+			if (predators)
+			{
+				const V fleeDistance = S::Add(S::LoadByte(f.fleeDistance + s), fleeBase);
+				const V fleeDistanceSq = S::Mul(fleeDistance, fleeDistance);
+				const V cosHalfFOV = S::Mul(S::LoadShort(f.cosHalfFOV + s), direction1);
+				const V dirLengthSq = S::Add(S::Mul(dir[0], dir[0]), S::Mul(dir[1], dir[1]));
+				const V world[2] = { S::Add(p[0], S::Set(corner[0])), S::Add(p[1], S::Set(corner[1])) };
+
+				float reach = f.killDistance;
+				for (unsigned int i = 0; i < n; i++)
+					reach = LargerOf(reach, f.fleeDistanceMin + f.fleeDistance[s + i]);
+
+				SearchBox(f.search, f.predatorGrid, corner[0] - reach, corner[1] - reach, corner[0] + f.cellSize[0] + reach, corner[1] + f.cellSize[1] + reach, [&](unsigned int j)
+				{
+					const float* predator = f.predatorPosition + (j * 3);
+					V d[2] = { S::Sub(world[0], S::Set(predator[0])), S::Sub(world[1], S::Set(predator[1])) };
+					for (unsigned int k = 0; k < 2; k++)
+						d[k] = S::Sub(d[k], S::Mul(size[k], S::Floor(S::Add(S::Mul(d[k], invSize[k]), half))));
+					V lSq = S::Add(S::Mul(d[0], d[0]), S::Mul(d[1], d[1]));
+					// squared distances, as Boid compares them
+					M kill = S::And(S::LessEqual(lSq, killDistanceSq), valid);
+					if (f.canDie)
+						caught = S::Or(caught, kill);
+
+					// the predator is at -d from the boid, see PerceptionCone::Inside
+					V dot = S::Sub(zero, S::Add(S::Mul(dir[0], d[0]), S::Mul(dir[1], d[1])));
+					M seen = S::GreaterEqual(dot, S::Mul(cosHalfFOV, S::Sqrt(S::Mul(dirLengthSq, lSq))));
+					M fleeing = S::And(S::AndNot(S::Less(lSq, fleeDistanceSq), kill), seen);
+					if (!f.canDie)
+						fleeing = S::Or(fleeing, kill);
+
+					flee[0] = S::Add(flee[0], S::Select(fleeing, d[0], zero));
+					flee[1] = S::Add(flee[1], S::Select(fleeing, d[1], zero));
+				});
+
+				M spotted = S::Greater(length(flee), zero);
+				flee[0] = S::Select(spotted, flee[0], dir[0]);
+				flee[1] = S::Select(spotted, flee[1], dir[1]);
+			}
+
+			// scale and add the four together, where they cancel out keep going the same way
+			V newDirection[2];
+			for (unsigned int k = 0; k < 2; k++)
+			{
+				V force = S::Add(S::Add(S::Add(S::Mul(separation[k], separationScale), S::Mul(alignment[k], alignmentScale)), S::Mul(cohesion[k], cohesionScale)), S::Mul(flee[k], fleeScale));
+				newDirection[k] = S::Add(dir[k], force);
+			}
+			V l = length(newDirection);
+			M moving = S::NotEqual(l, zero);
+			for (unsigned int k = 0; k < 2; k++)
+				newDirection[k] = S::Select(moving, S::Div(newDirection[k], l), dir[k]);
+
+			// and move, still relative to this cell's corner
+			V step = S::Add(S::Mul(S::LoadByte(f.speed + s), speedStep), speedBase);
+			S::Store(newX, S::Add(p[0], S::Mul(newDirection[0], step)));
+			S::Store(newY, S::Add(p[1], S::Mul(newDirection[1], step)));
+			S::Store(newDirectionX, newDirection[0]);
+			S::Store(newDirectionY, newDirection[1]);
+
+			// encode again, a boid that left the cell is put in the one it moved into
+			unsigned int caughtBits = S::Bits(caught);
+			for (unsigned int i = 0; i < n; i++)
+			{
+				int moveX = (int)floorf(newX[i] / f.cellSize[0]);
+				int moveY = (int)floorf(newY[i] / f.cellSize[1]);
+				float x = newX[i] - (moveX * f.cellSize[0]);
+				float y = newY[i] - (moveY * f.cellSize[1]);
+				int toX = ((((int)cx + moveX) % (int)f.cellsX) + (int)f.cellsX) % (int)f.cellsX;
+				int toY = ((((int)cy + moveY) % (int)f.cellsY) + (int)f.cellsY) % (int)f.cellsY;
+
+				f.newCell[s + i] = (toY * f.cellsX) + toX;
+				f.newOffsetX[s + i] = (unsigned short)SmallerOf((int)((x / unitX) + 0.5f), 65535);
+				f.newOffsetY[s + i] = (unsigned short)SmallerOf((int)((y / unitY) + 0.5f), 65535);
+				f.newDirectionX[s + i] = (short)floorf((newDirectionX[i] * QUANTISED_DIRECTION_STEPS) + 0.5f);
+				f.newDirectionY[s + i] = (short)floorf((newDirectionY[i] * QUANTISED_DIRECTION_STEPS) + 0.5f);
+				f.caught[s + i] = (caughtBits >> i) & 1;
+			}
+		}
+	}
+}
@@ -0,0 +1,251 @@
+#include "QuantisedPopulation.h"
+
+#include <algorithm>
+
+static unsigned char ToByte(float f)
+{
+	return (unsigned char)max(0, min((int)floorf(f + 0.5f), 255));
+}
+
+static short ToFixed(float f)
+{
+	return (short)floorf((f * QUANTISED_DIRECTION_STEPS) + 0.5f);
+}
+
+QuantisedPopulation::QuantisedPopulation()
+{
+}
+
+QuantisedPopulation::~QuantisedPopulation()
+{
+}
+
+bool QuantisedPopulation::SetWorldBounds(const WorldBounds* bounds)
+{
+	XMFLOAT2 size = bounds->GetSize();
+	unsigned int cellsX = (unsigned int)(size.x / NEARBY_DISTANCE);
+	unsigned int cellsY = (unsigned int)(size.y / NEARBY_DISTANCE);
+	// with fewer, the cells either side of a boid would be the same cell and it would see its neighbours twice
+	if (cellsX < 3 || cellsY < 3)
+		return false;
+
+	m_bounds = bounds;
+	m_cellsX = cellsX;
+	m_cellsY = cellsY;
+	m_cellSize = XMFLOAT2(size.x / cellsX, size.y / cellsY);
+	Clear();
+	return true;
+}
+
+template<unsigned int D>
+void QuantisedPopulation::CopyFrom(const BoidPopulationT<D>& population)
+{
+	unsigned int count = population.GetCount();
+	m_newCell.resize(count);
+	m_newOffsetX.resize(count);
+	m_newOffsetY.resize(count);
+	m_newDirectionX.resize(count);
+	m_newDirectionY.resize(count);
+	m_swapCosHalfFOV.resize(count);
+	m_swapSpeed.resize(count);
+	m_swapFleeDistance.resize(count);
+	m_swapId.resize(count);
+
+	XMFLOAT2 lower = m_bounds->GetLower();
+	for (unsigned int i = 0; i < count; i++)
+	{
+		// which cell and how far across it
+		float x = (population.m_position[0][i] - lower.x) / m_cellSize.x;
+		float y = (population.m_position[1][i] - lower.y) / m_cellSize.y;
+		int cellX = (int)floorf(x);
+		int cellY = (int)floorf(y);
+		x -= cellX;
+		y -= cellY;
+		cellX = ((cellX % (int)m_cellsX) + (int)m_cellsX) % (int)m_cellsX;
+		cellY = ((cellY % (int)m_cellsY) + (int)m_cellsY) % (int)m_cellsY;
+
+		m_newCell[i] = (cellY * m_cellsX) + cellX;
+		m_newOffsetX[i] = (unsigned short)min((int)((x * QUANTISED_OFFSET_STEPS) + 0.5f), 65535);
+		m_newOffsetY[i] = (unsigned short)min((int)((y * QUANTISED_OFFSET_STEPS) + 0.5f), 65535);
+		// a 3d boid's direction flattened onto the plane
+		float directionX = population.m_direction[0][i];
+		float directionY = population.m_direction[1][i];
+		float length = sqrtf((directionX * directionX) + (directionY * directionY));
+		if (length > 0.0f)
+		{
+			directionX /= length;
+			directionY /= length;
+		}
+		m_newDirectionX[i] = ToFixed(directionX);
+		m_newDirectionY[i] = ToFixed(directionY);
+		m_swapCosHalfFOV[i] = ToFixed(population.m_cosHalfFOV[i]);
+		m_swapSpeed[i] = ToByte(population.m_speed[i] - SPEED_DEFAULT);
+		m_swapFleeDistance[i] = ToByte(population.m_fleeDistance[i] - FLEE_DISTANCE_MIN);
+		m_swapId[i] = i;
+	}
+	Sort(nullptr);
+
+	m_separationScale = population.m_separationScale;
+	m_alignmentScale = population.m_alignmentScale;
+	m_cohesionScale = population.m_cohesionScale;
+	m_fleeScale = population.m_fleeScale;
+	m_killDistance = population.m_killDistance;
+	m_canDie = population.m_canDie;
+}
+
+template void QuantisedPopulation::CopyFrom(const BoidPopulationT<2>& population);
+template void QuantisedPopulation::CopyFrom(const BoidPopulationT<3>& population);
+
+void QuantisedPopulation::Clear()
+{
+	m_cellStart.assign((m_cellsX * m_cellsY) + 1, 0);
+	m_offsetX.clear();
+	m_offsetY.clear();
+	m_directionX.clear();
+	m_directionY.clear();
+	m_cosHalfFOV.clear();
+	m_speed.clear();
+	m_fleeDistance.clear();
+	m_id.clear();
+}
+
+size_t QuantisedPopulation::BytesPerBoid()
+{
+	return (5 * sizeof(short)) + (2 * sizeof(unsigned char)) + sizeof(unsigned int);
+}
+
+void QuantisedPopulation::Update(float t, SpatialGrid* predatorGrid, SimdLevel level)
+{
+	unsigned int count = GetCount();
+	m_newCell.resize(count);
+	m_newOffsetX.resize(count);
+	m_newOffsetY.resize(count);
+	m_newDirectionX.resize(count);
+	m_newDirectionY.resize(count);
+	m_caught.resize(count);
+
+	QuantisedFrame frame;
+	frame.cellsX = m_cellsX;
+	frame.cellsY = m_cellsY;
+	frame.cellSize[0] = m_cellSize.x;
+	frame.cellSize[1] = m_cellSize.y;
+	frame.lower[0] = m_bounds->GetLower().x;
+	frame.lower[1] = m_bounds->GetLower().y;
+	frame.cellStart = m_cellStart.data();
+	frame.offsetX = m_offsetX.data();
+	frame.offsetY = m_offsetY.data();
+	frame.directionX = m_directionX.data();
+	frame.directionY = m_directionY.data();
+	frame.cosHalfFOV = m_cosHalfFOV.data();
+	frame.speed = m_speed.data();
+	frame.fleeDistance = m_fleeDistance.data();
+	frame.search = SteeringKernel::Search;
+	frame.predatorGrid = predatorGrid;
+	frame.predatorPosition = predatorGrid != nullptr && predatorGrid->GetCount() > 0 ? &predatorGrid->GetSortedPositions()[0].x : nullptr;
+	frame.predatorCount = predatorGrid != nullptr ? predatorGrid->GetCount() : 0;
+	frame.worldSize[0] = m_bounds->GetSize().x;
+	frame.worldSize[1] = m_bounds->GetSize().y;
+	frame.nearbyDistance = NEARBY_DISTANCE;
+	frame.separationDistance = SEPARATION_DISTANCE;
+	frame.speedDefault = SPEED_DEFAULT;
+	frame.fleeDistanceMin = FLEE_DISTANCE_MIN;
+	frame.t = t;
+	frame.separationScale = m_separationScale;
+	frame.alignmentScale = m_alignmentScale;
+	frame.cohesionScale = m_cohesionScale;
+	frame.fleeScale = m_fleeScale;
+	frame.killDistance = m_killDistance;
+	frame.canDie = m_canDie;
+	frame.newCell = m_newCell.data();
+	frame.newOffsetX = m_newOffsetX.data();
+	frame.newOffsetY = m_newOffsetY.data();
+	frame.newDirectionX = m_newDirectionX.data();
+	frame.newDirectionY = m_newDirectionY.data();
+	frame.caught = m_caught.data();
+
+	// a cell's boids are only written by the range with that cell, and read by anyone
+	unsigned int cells = m_cellsX * m_cellsY;
+	auto steer = [&](unsigned int begin, unsigned int end)
+	{
+		QuantisedFrame range = frame;
+		range.cellBegin = begin;
+		range.cellEnd = end;
+		SteeringKernel::Run(range, level);
+	};
+	if (m_jobs != nullptr)
+		m_jobs->ParallelFor(cells, steer);
+	else
+		steer(0, cells);
+
+	// the traits don't change, they only have to follow their boid to its new place
+	m_cosHalfFOV.swap(m_swapCosHalfFOV);
+	m_speed.swap(m_swapSpeed);
+	m_fleeDistance.swap(m_swapFleeDistance);
+	m_id.swap(m_swapId);
+	Sort(&m_caught);
+}
+
+void QuantisedPopulation::Sort(const vecAlignedByte* caught)
+{
+	// a counting sort by cell, which is also the cell table for next frame
+	unsigned int count = (unsigned int)m_newCell.size();
+	unsigned int cells = m_cellsX * m_cellsY;
+	m_cellStart.assign(cells + 1, 0);
+	unsigned int alive = 0;
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (caught != nullptr && (*caught)[i])
+			continue;
+		m_cellStart[m_newCell[i] + 1]++;
+		alive++;
+	}
+	for (unsigned int c = 0; c < cells; c++)
+		m_cellStart[c + 1] += m_cellStart[c];
+	m_next.assign(m_cellStart.begin(), m_cellStart.end() - 1);
+
+	// a batch can start at the last boid and still read a whole register
+	unsigned int padded = alive + SIMD_MAX_WIDTH - 1;
+	m_offsetX.resize(padded, 0);
+	m_offsetY.resize(padded, 0);
+	m_directionX.resize(padded, 0);
+	m_directionY.resize(padded, 0);
+	m_cosHalfFOV.resize(padded, 0);
+	m_speed.resize(padded, 0);
+	m_fleeDistance.resize(padded, 0);
+	m_id.resize(alive);
+
+	for (unsigned int i = 0; i < count; i++)
+	{
+		if (caught != nullptr && (*caught)[i])
+			continue;
+		unsigned int to = m_next[m_newCell[i]]++;
+		m_offsetX[to] = m_newOffsetX[i];
+		m_offsetY[to] = m_newOffsetY[i];
+		m_directionX[to] = m_newDirectionX[i];
+		m_directionY[to] = m_newDirectionY[i];
+		m_cosHalfFOV[to] = m_swapCosHalfFOV[i];
+		m_speed[to] = m_swapSpeed[i];
+		m_fleeDistance[to] = m_swapFleeDistance[i];
+		m_id[to] = m_swapId[i];
+	}
+}
+
+unsigned int QuantisedPopulation::CellOf(unsigned int i) const
+{
+	// the last cell that starts at or before i
+	return (unsigned int)(upper_bound(m_cellStart.begin(), m_cellStart.end(), i) - m_cellStart.begin()) - 1;
+}
+
+XMFLOAT3 QuantisedPopulation::GetPosition(unsigned int i) const
+{
+	unsigned int cell = CellOf(i);
+	XMFLOAT2 lower = m_bounds->GetLower();
+	float x = lower.x + (((cell % m_cellsX) + (m_offsetX[i] / QUANTISED_OFFSET_STEPS)) * m_cellSize.x);
+	float y = lower.y + (((cell / m_cellsX) + (m_offsetY[i] / QUANTISED_OFFSET_STEPS)) * m_cellSize.y);
+	return XMFLOAT3(x, y, 0.0f);
+}
+
+XMFLOAT3 QuantisedPopulation::GetDirection(unsigned int i) const
+{
+	return XMFLOAT3(m_directionX[i] / QUANTISED_DIRECTION_STEPS, m_directionY[i] / QUANTISED_DIRECTION_STEPS, 0.0f);
+}
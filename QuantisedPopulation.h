@@ -0,0 +1,103 @@
+#pragma once
+
+#include "BoidPopulation.h"
+
+typedef vector<unsigned short, LargePageAllocator<unsigned short>>	vecPagedUShort;
+typedef vector<short, LargePageAllocator<short>>					vecPagedShort;
+typedef vector<unsigned int, LargePageAllocator<unsigned int>>		vecPagedUInt;
+
+/*
+ a 2d flock in as few bytes as possible, for populations so big that reading the arrays is what limits the frame rate
+ the world is cut into cells at least NEARBY_DISTANCE across that tile the wrapped world exactly, and the boids are
+ kept sorted by cell, so a boid's position only needs to say where it is inside its cell (16 bits an axis)
+ and the cell table doubles as the neighbour grid, there is no SpatialGrid to build for the flock
+ directions and the cosine of half the field of view are 16 bit fixed point (QUANTISED_DIRECTION_STEPS is 1),
+ speed and flee distance a byte each above their minimums, which holds Boid::RandomTraits exactly
+ the rules are BoidPopulation::UpdateBatched's, every boid steers from the start of the frame, except that
+ where the forces cancel out a boid keeps its heading instead of turning to its nearest neighbour
+ caught boids are dropped when the boids are put back in cell order, which happens every frame
+ BoidPopulation stays the default, this is only worth it for millions of boids (see Benchmark::QuantisedStorage)
+*/
+
+class QuantisedPopulation
+{
+	friend class Benchmark;
+
+public:
+	QuantisedPopulation();
+	~QuantisedPopulation();
+
+	// the cells have to tile these bounds, false if they are less than 3 cells across either way
+	bool								SetWorldBounds(const WorldBounds* bounds);
+	// start from copies of these boids, SetWorldBounds must have been called first, only x and y are kept from 3d
+	template<unsigned int D>
+	void								CopyFrom(const BoidPopulationT<D>& population);
+	void								Clear();
+
+	// steer and move every boid, then put them back in cell order without the ones that were caught
+	// the steering is split over the job system by ranges of cells, the sort stays on the calling thread
+	void								Update(float t, SpatialGrid* predatorGrid, SimdLevel level);
+	// nullptr (the default) steers every cell on the calling thread
+	void								SetJobSystem(JobSystem* jobs) { m_jobs = jobs; }
+
+	unsigned int						GetCount() const { return (unsigned int)m_id.size(); }
+	// decoded, for drawing and comparing against a BoidPopulation
+	XMFLOAT3							GetPosition(unsigned int i) const;
+	XMFLOAT3							GetDirection(unsigned int i) const;
+	// the boid's index in the population it was copied from, boids move around the arrays as they change cell
+	unsigned int						GetId(unsigned int i) const { return m_id[i]; }
+
+	// bytes stored for each boid across all of the arrays, not counting the cell table
+	static size_t						BytesPerBoid();
+	size_t								BytesPerCellTable() const { return m_cellStart.size() * sizeof(unsigned int); }
+
+protected:
+	// move every boid from the new and swap arrays into the one for its cell, keeping their order within a cell
+	// and leaving out the caught ones if caught isn't nullptr
+	void								Sort(const vecAlignedByte* caught);
+	unsigned int						CellOf(unsigned int i) const;
+
+	const WorldBounds*					m_bounds = nullptr;
+	JobSystem*							m_jobs = nullptr;
+	unsigned int						m_cellsX = 0;
+	unsigned int						m_cellsY = 0;
+	XMFLOAT2							m_cellSize = XMFLOAT2(0.0f, 0.0f);
+
+	// the first boid in each cell, and one past the last boid at the end
+	vecPagedUInt					m_cellStart;
+
+	// read for every neighbour, padded so a batch can read a whole register past the last boid
+	vecPagedUShort					m_offsetX;
+	vecPagedUShort					m_offsetY;
+	vecPagedShort					m_directionX;
+	vecPagedShort					m_directionY;
+
+	// only read for the boid being updated
+	vecPagedShort					m_cosHalfFOV;
+	vecAlignedByte					m_speed;
+	vecAlignedByte					m_fleeDistance;
+	vecPagedUInt					m_id;
+
+	// what the kernel writes, in the order the boids are in above, Sort moves them back into cell order
+	vecPagedUInt					m_newCell;
+	vecPagedUShort					m_newOffsetX;
+	vecPagedUShort					m_newOffsetY;
+	vecPagedShort					m_newDirectionX;
+	vecPagedShort					m_newDirectionY;
+	vecAlignedByte					m_caught;
+
+	// Sort moves the boids' traits from here back into the arrays above
+	vecPagedShort					m_swapCosHalfFOV;
+	vecAlignedByte					m_swapSpeed;
+	vecAlignedByte					m_swapFleeDistance;
+	vecPagedUInt					m_swapId;
+	vecPagedUInt					m_next;
+
+	// the same for every boid
+	float								m_separationScale = SEPARATIONSCALE_DEFAULT;
+	float								m_alignmentScale = ALIGNMENTSCALE_DEFAULT;
+	float								m_cohesionScale = COHESIONSCALE_DEFAULT;
+	float								m_fleeScale = FLEESCALE_DEFAULT;
+	float								m_killDistance = KILL_DISTANCE_DEFAULT;
+	bool								m_canDie = true;
+};
@@ -0,0 +1,176 @@
+#pragma once
+
+#include <cmath>
+
+// msvc lets any file use the SSE4.1 intrinsics, other compilers only with it switched on
+#if defined(__SSE4_1__) || (defined(_MSC_VER) && (defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)))
+#include <smmintrin.h>
+#define SIMD_HAS_SSE41
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define SIMD_HAS_AVX2
+#endif
+
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#define SIMD_HAS_AVX512
+#endif
+
+#define SIMD_MAX_WIDTH		16	// the most lanes any of these have, batched kernels read this far past where a batch starts
+
+/*
+ the handful of float operations the batched kernels use, so one template can be built for plain floats,
+ SSE4.1 (4 lanes), AVX2 (8 lanes) and AVX-512 (16 lanes)
+ comparisons give a mask for Select, And, AndNot, Or and Any
+ Load and Store don't need aligned pointers, batches can start anywhere in an array
+ LoadShort, LoadUnsignedShort and LoadByte widen that many small integers straight into float lanes (QuantisedPopulation)
+ SimdAVX2 and SimdAVX512 only exist in files built with them enabled (/arch:AVX2, /arch:AVX512)
+*/
+
+struct SimdScalar
+{
+	typedef float						V;
+	typedef bool						M;
+	static const unsigned int			Width = 1;
+
+	static V							Set(float f) { return f; }
+	static V							Lanes() { return 0.0f; }
+	static V							Load(const float* p) { return *p; }
+	static void							Store(float* p, V a) { *p = a; }
+	static V							LoadShort(const short* p) { return (float)*p; }
+	static V							LoadUnsignedShort(const unsigned short* p) { return (float)*p; }
+	static V							LoadByte(const unsigned char* p) { return (float)*p; }
+
+	static V							Add(V a, V b) { return a + b; }
+	static V							Sub(V a, V b) { return a - b; }
+	static V							Mul(V a, V b) { return a * b; }
+	static V							Div(V a, V b) { return a / b; }
+	static V							Sqrt(V a) { return sqrtf(a); }
+	static V							Floor(V a) { return floorf(a); }
+
+	static M							Less(V a, V b) { return a < b; }
+	static M							LessEqual(V a, V b) { return a <= b; }
+	static M							Greater(V a, V b) { return a > b; }
+	static M							GreaterEqual(V a, V b) { return a >= b; }
+	static M							NotEqual(V a, V b) { return a != b; }
+
+	static M							And(M a, M b) { return a && b; }
+	static M							AndNot(M a, M b) { return a && !b; }
+	static M							Or(M a, M b) { return a || b; }
+	static V							Select(M m, V a, V b) { return m ? a : b; }
+	static bool							Any(M m) { return m; }
+	static unsigned int					Bits(M m) { return m ? 1u : 0u; }
+};
+
+#if defined(SIMD_HAS_SSE41)
+struct SimdSSE41
+{
+	typedef __m128						V;
+	typedef __m128						M;
+	static const unsigned int			Width = 4;
+
+	static V							Set(float f) { return _mm_set1_ps(f); }
+	static V							Lanes() { return _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f); }
+	static V							Load(const float* p) { return _mm_loadu_ps(p); }
+	static void							Store(float* p, V a) { _mm_storeu_ps(p, a); }
+	static V							LoadShort(const short* p) { return _mm_cvtepi32_ps(_mm_cvtepi16_epi32(_mm_loadl_epi64((const __m128i*)p))); }
+	static V							LoadUnsignedShort(const unsigned short* p) { return _mm_cvtepi32_ps(_mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)p))); }
+	static V							LoadByte(const unsigned char* p) { return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(*(const int*)p))); }
+
+	static V							Add(V a, V b) { return _mm_add_ps(a, b); }
+	static V							Sub(V a, V b) { return _mm_sub_ps(a, b); }
+	static V							Mul(V a, V b) { return _mm_mul_ps(a, b); }
+	static V							Div(V a, V b) { return _mm_div_ps(a, b); }
+	static V							Sqrt(V a) { return _mm_sqrt_ps(a); }
+	static V							Floor(V a) { return _mm_floor_ps(a); }
+
+	static M							Less(V a, V b) { return _mm_cmplt_ps(a, b); }
+	static M							LessEqual(V a, V b) { return _mm_cmple_ps(a, b); }
+	static M							Greater(V a, V b) { return _mm_cmpgt_ps(a, b); }
+	static M							GreaterEqual(V a, V b) { return _mm_cmpge_ps(a, b); }
+	static M							NotEqual(V a, V b) { return _mm_cmpneq_ps(a, b); }
+
+	static M							And(M a, M b) { return _mm_and_ps(a, b); }
+	static M							AndNot(M a, M b) { return _mm_andnot_ps(b, a); }
+	static M							Or(M a, M b) { return _mm_or_ps(a, b); }
+	static V							Select(M m, V a, V b) { return _mm_blendv_ps(b, a, m); }
+	static bool							Any(M m) { return _mm_movemask_ps(m) != 0; }
+	static unsigned int					Bits(M m) { return (unsigned int)_mm_movemask_ps(m); }
+};
+#endif
+
+#if defined(SIMD_HAS_AVX2)
+struct SimdAVX2
+{
+	typedef __m256						V;
+	typedef __m256						M;
+	static const unsigned int			Width = 8;
+
+	static V							Set(float f) { return _mm256_set1_ps(f); }
+	static V							Lanes() { return _mm256_set_ps(7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f); }
+	static V							Load(const float* p) { return _mm256_loadu_ps(p); }
+	static void							Store(float* p, V a) { _mm256_storeu_ps(p, a); }
+	static V							LoadShort(const short* p) { return _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i*)p))); }
+	static V							LoadUnsignedShort(const unsigned short* p) { return _mm256_cvtepi32_ps(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p))); }
+	static V							LoadByte(const unsigned char* p) { return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)p))); }
+
+	static V							Add(V a, V b) { return _mm256_add_ps(a, b); }
+	static V							Sub(V a, V b) { return _mm256_sub_ps(a, b); }
+	static V							Mul(V a, V b) { return _mm256_mul_ps(a, b); }
+	static V							Div(V a, V b) { return _mm256_div_ps(a, b); }
+	static V							Sqrt(V a) { return _mm256_sqrt_ps(a); }
+	static V							Floor(V a) { return _mm256_floor_ps(a); }
+
+	static M							Less(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	static M							LessEqual(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+	static M							Greater(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+	static M							GreaterEqual(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+	static M							NotEqual(V a, V b) { return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ); }
+
+	static M							And(M a, M b) { return _mm256_and_ps(a, b); }
+	static M							AndNot(M a, M b) { return _mm256_andnot_ps(b, a); }
+	static M							Or(M a, M b) { return _mm256_or_ps(a, b); }
+	static V							Select(M m, V a, V b) { return _mm256_blendv_ps(b, a, m); }
+	static bool							Any(M m) { return _mm256_movemask_ps(m) != 0; }
+	static unsigned int					Bits(M m) { return (unsigned int)_mm256_movemask_ps(m); }
+};
+#endif
+
+#if defined(SIMD_HAS_AVX512)
+struct SimdAVX512
+{
+	typedef __m512						V;
+	typedef __mmask16					M;	// one bit per lane rather than a register of all ones
+	static const unsigned int			Width = 16;
+
+	static V							Set(float f) { return _mm512_set1_ps(f); }
+	static V							Lanes() { return _mm512_set_ps(15.0f, 14.0f, 13.0f, 12.0f, 11.0f, 10.0f, 9.0f, 8.0f, 7.0f, 6.0f, 5.0f, 4.0f, 3.0f, 2.0f, 1.0f, 0.0f); }
+	static V							Load(const float* p) { return _mm512_loadu_ps(p); }
+	static void							Store(float* p, V a) { _mm512_storeu_ps(p, a); }
+	static V							LoadShort(const short* p) { return _mm512_cvtepi32_ps(_mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i*)p))); }
+	static V							LoadUnsignedShort(const unsigned short* p) { return _mm512_cvtepi32_ps(_mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)p))); }
+	static V							LoadByte(const unsigned char* p) { return _mm512_cvtepi32_ps(_mm512_cvtepu8_epi32(_mm_loadu_si128((const __m128i*)p))); }
+
+	static V							Add(V a, V b) { return _mm512_add_ps(a, b); }
+	static V							Sub(V a, V b) { return _mm512_sub_ps(a, b); }
+	static V							Mul(V a, V b) { return _mm512_mul_ps(a, b); }
+	static V							Div(V a, V b) { return _mm512_div_ps(a, b); }
+	static V							Sqrt(V a) { return _mm512_sqrt_ps(a); }
+	static V							Floor(V a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+
+	static M							Less(V a, V b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+	static M							LessEqual(V a, V b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+	static M							Greater(V a, V b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+	static M							GreaterEqual(V a, V b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+	static M							NotEqual(V a, V b) { return _mm512_cmp_ps_mask(a, b, _CMP_NEQ_UQ); }
+
+	static M							And(M a, M b) { return (M)(a & b); }
+	static M							AndNot(M a, M b) { return (M)(a & ~b); }
+	static M							Or(M a, M b) { return (M)(a | b); }
+	static V							Select(M m, V a, V b) { return _mm512_mask_blend_ps(m, b, a); }
+	static bool							Any(M m) { return m != 0; }
+	static unsigned int					Bits(M m) { return (unsigned int)m; }
+};
+#endif
@@ -0,0 +1,61 @@
+#include "SimulationThread.h"
+#include "FrameArena.h"
+
+#include <chrono>
+
+void SimulationThread::Start(float hz, function<void(float, SimulationSnapshot&)> step, function<void()> endStep)
+{
+	Stop();
+
+	m_hz = hz;
+	m_step = step;
+	m_endStep = endStep;
+	m_stop = false;
+	m_steps = 0;
+	m_thread = thread(&SimulationThread::Loop, this);
+}
+
+void SimulationThread::Stop()
+{
+	if (!m_thread.joinable())
+		return;
+
+	m_stop = true;
+	m_thread.join();
+}
+
+double SimulationThread::Now()
+{
+	return chrono::duration<double>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void SimulationThread::Loop()
+{
+	float stepLength = 1.0f / m_hz;
+	chrono::steady_clock::duration period = chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(stepLength));
+	chrono::steady_clock::time_point next = chrono::steady_clock::now();
+	unsigned long long step = 0;
+
+	while (!m_stop.load(memory_order_relaxed))
+	{
+		SimulationSnapshot& snapshot = m_snapshots.GetWriteBuffer();
+		m_step(stepLength, snapshot);
+		snapshot.step = ++step;
+		snapshot.stepLength = stepLength;
+		snapshot.time = Now();
+		m_snapshots.Publish();
+		m_steps.store(step, memory_order_relaxed);
+
+		// this thread's temporaries for the step, the render thread resets its own
+		FrameArena::Frame().Reset();
+		if (m_endStep)
+			m_endStep();
+
+		// a fixed rate, unless the steps take longer than that
+		next += period;
+		chrono::steady_clock::time_point now = chrono::steady_clock::now();
+		if (now - next > period * SIMULATION_MAX_BEHIND)
+			next = now;
+		this_thread::sleep_until(next);
+	}
+}
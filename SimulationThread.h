@@ -0,0 +1,85 @@
+#pragma once
+
+#include <DirectXMath.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "TripleBuffer.h"
+
+using namespace std;
+using namespace DirectX;
+
+#define SIMULATION_HZ_DEFAULT	60.0f
+#define SIMULATION_MAX_BEHIND	5		// steps, a simulation further behind than this gives up catching up
+
+// where an object was at the start and the end of a step, drawing goes from one to the other
+struct SnapshotObject
+{
+	XMFLOAT3							previous;
+	XMFLOAT3							position;
+};
+
+// everything drawing needs from one simulation step, so the render thread never reads the simulation
+struct SimulationSnapshot
+{
+	vector<SnapshotObject>				boids;
+	vector<SnapshotObject>				predators;	// in the same order as g_Predators, which is never reordered
+	unsigned long long					step = 0;
+	double								time = 0.0;	// SimulationThread::Now when it was published
+	float								stepLength = 0.0f;
+
+	// how far drawing at now is from the start to the end of this step, the step is shown one step late so it can be drawn smoothly
+	float								GetAlpha(double now) const { return stepLength > 0.0f ? (float)min(max((now - time) / stepLength, 0.0), 1.0) : 1.0f; }
+	static XMFLOAT3						Interpolate(const SnapshotObject& o, float alpha)
+	{
+		return XMFLOAT3(o.previous.x + (o.position.x - o.previous.x) * alpha, o.previous.y + (o.position.y - o.previous.y) * alpha,
+			o.previous.z + (o.position.z - o.previous.z) * alpha);
+	}
+};
+
+/*
+ runs the simulation on its own thread at a fixed rate, handing each step to the render thread as a snapshot
+ through a triple buffer, so neither waits for the other, a slow frame on one side only slows that side
+ step(t, snapshot) is given the fixed timestep and the snapshot to fill, the vectors in it are reused so
+ filling them stops allocating once they have grown
+ the render thread calls Acquire once a frame and draws GetSnapshot between previous and position using GetAlpha
+ a simulation that can't keep up runs as fast as it can instead of trying to catch up on every missed step
+*/
+
+class SimulationThread
+{
+public:
+	SimulationThread() {}
+	~SimulationThread() { Stop(); }
+	SimulationThread(const SimulationThread&) = delete;
+	SimulationThread&					operator=(const SimulationThread&) = delete;
+
+	// endStep, if given, runs on the simulation thread once each step is published and its arena reset
+	void								Start(float hz, function<void(float, SimulationSnapshot&)> step, function<void()> endStep = nullptr);
+	void								Stop();
+	bool								GetRunning() const { return m_thread.joinable(); }
+
+	// render thread: take the newest snapshot, false if there hasn't been one since the last call
+	bool								Acquire() { return m_snapshots.Acquire(); }
+	const SimulationSnapshot&			GetSnapshot() const { return m_snapshots.GetReadBuffer(); }
+
+	// steps run since Start, for the simulation rate
+	unsigned long long					GetSteps() const { return m_steps.load(memory_order_relaxed); }
+
+	// seconds, the clock snapshots are stamped with
+	static double						Now();
+
+private:
+	void								Loop();
+
+	TripleBuffer<SimulationSnapshot>	m_snapshots;
+	thread								m_thread;
+	atomic<bool>						m_stop{ false };
+	atomic<unsigned long long>			m_steps{ 0 };
+	float								m_hz = SIMULATION_HZ_DEFAULT;
+	function<void(float, SimulationSnapshot&)>	m_step;
+	function<void()>					m_endStep;
+};
@@ -0,0 +1,86 @@
+#include "SpatialGrid.h"
+#include "FrameArena.h"
+
+#define MIN_TABLE_SIZE	64
+
+SpatialGrid::SpatialGrid(float cellSize)
+{
+	m_cellSize = cellSize;
+	m_invCellSize = 1.0f / cellSize;
+	m_nextCellSize = cellSize;
+}
+
+SpatialGrid::~SpatialGrid()
+{
+}
+
+void SpatialGrid::BuildCells()
+{
+	unsigned int count = (unsigned int)m_positions.size();
+
+	m_cellSize = m_nextCellSize;
+	m_invCellSize = 1.0f / m_nextCellSize;
+
+	// keep roughly two buckets per object so collisions stay rare
+	unsigned int tableSize = MIN_TABLE_SIZE;
+	while (tableSize < count * 2)
+		tableSize *= 2;
+	m_tableSize = tableSize;
+	m_tableMask = tableSize - 1;
+
+	m_occupiedCells = 0;
+	m_cellOf.resize(count);
+	m_cellStart.assign(m_tableSize + 1, 0);
+	m_sortedIndices.resize(count);
+	m_sortedPositions.resize(count);
+
+	if (count == 0)
+		return;
+
+	m_minCellX = m_maxCellX = CellCoord(m_positions[0].x);
+	m_minCellY = m_maxCellY = CellCoord(m_positions[0].y);
+
+	// count how many objects land in each bucket
+	for (unsigned int i = 0; i < count; i++)
+	{
+		int x = CellCoord(m_positions[i].x);
+		int y = CellCoord(m_positions[i].y);
+		m_minCellX = min(m_minCellX, x);
+		m_maxCellX = max(m_maxCellX, x);
+		m_minCellY = min(m_minCellY, y);
+		m_maxCellY = max(m_maxCellY, y);
+
+		m_cellOf[i] = HashCell(x, y);
+		m_cellStart[m_cellOf[i] + 1]++;
+	}
+
+	// turn the counts into start offsets
+	for (unsigned int c = 0; c < m_tableSize; c++)
+	{
+		if (m_cellStart[c + 1] > 0)
+			m_occupiedCells++;
+		m_cellStart[c + 1] += m_cellStart[c];
+	}
+
+	// scatter the objects into their buckets, keeping list order inside each bucket
+	ArenaScope scope(FrameArena::Frame());
+	unsigned int* next = FrameArena::Frame().Allocate<unsigned int>(m_tableSize);
+	copy(m_cellStart.begin(), m_cellStart.end() - 1, next);
+	for (unsigned int i = 0; i < count; i++)
+	{
+		unsigned int slot = next[m_cellOf[i]]++;
+		m_sortedIndices[slot] = i;
+		m_sortedPositions[slot] = m_positions[i];
+	}
+}
+
+void SpatialGrid::FitCellSize(float targetCount, float minSize, float maxSize)
+{
+	if (m_occupiedCells == 0)
+		return;
+
+	// the number of objects in a cell goes with its area
+	float occupancy = (float)GetCount() / (float)m_occupiedCells;
+	float cellSize = m_cellSize * sqrtf(targetCount / occupancy);
+	SetCellSize(min(max(cellSize, minSize), maxSize));
+}
@@ -0,0 +1,397 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <cmath>
+#include <cfloat>
+#include <DirectXMath.h>
+#include "WorldBounds.h"
+
+using namespace std;
+using namespace DirectX;
+
+/*
+ uniform grid used to find nearby objects without checking every object
+ the grid is rebuilt once per frame from the object list and queries return
+ indices into that same list
+ cells are hashed into a fixed size table so the world does not need bounds
+*/
+
+class SpatialGrid
+{
+public:
+	SpatialGrid(float cellSize);
+	~SpatialGrid();
+
+	// copy the positions out of a list of objects (boids or predators) and rebuild the cells
+	template<class T>
+	void								Build(const vector<T*>& objects)
+	{
+		m_positions.resize(objects.size());
+		for (unsigned int i = 0; i < objects.size(); i++)
+		{
+			m_positions[i] = *objects[i]->getPosition();
+		}
+		BuildCells();
+	}
+
+	// the same from separate x, y and (in 3d) z arrays (see BoidPopulation), cells are still only in x and y
+	void								Build(const float* x, const float* y, unsigned int count, const float* z = nullptr)
+	{
+		m_positions.resize(count);
+		for (unsigned int i = 0; i < count; i++)
+		{
+			m_positions[i] = XMFLOAT3(x[i], y[i], z != nullptr ? z[i] : 0.0f);
+		}
+		BuildCells();
+	}
+
+	// calls func(index) for every object closer than radius to position
+	template<class Func>
+	void								ForEachInRadius(const XMFLOAT3& position, float radius, Func func) const
+	{
+		if (m_sortedIndices.empty())
+			return;
+
+		float radiusSq = radius * radius;
+		int cellsX = CellCoord(position.x + radius) - CellCoord(position.x - radius) + 1;
+		int cellsY = CellCoord(position.y + radius) - CellCoord(position.y - radius) + 1;
+
+		// a huge radius covers more cells than the table has buckets, so just check everything
+		if ((unsigned int)(cellsX * cellsY) > m_tableSize)
+		{
+			for (unsigned int i = 0; i < m_sortedIndices.size(); i++)
+			{
+				if (WrappedDistanceSq(position, m_sortedPositions[i]) < radiusSq)
+					func(m_sortedIndices[i]);
+			}
+			return;
+		}
+
+		// on a torus the search is repeated from each copy of position that reaches over an edge
+		XMFLOAT2 offsets[4] = { XMFLOAT2(0, 0) };
+		unsigned int images = m_bounds != nullptr ? m_bounds->Images(position, radius, offsets) : 1;
+		for (unsigned int image = 0; image < images; image++)
+		{
+			XMFLOAT3 p = XMFLOAT3(position.x + offsets[image].x, position.y + offsets[image].y, position.z);
+			ForEachInCells(p, radius, func);
+		}
+	}
+
+	// calls func(sorted) for every object in the cells touched by the box from lower to upper, where sorted is
+	// its place in GetSortedPositions and GetSortedIndices, for batched searches that check the distances themselves
+	template<class Func>
+	void								ForEachSortedInBox(const XMFLOAT2& lower, const XMFLOAT2& upper, Func func) const
+	{
+		if (m_sortedIndices.empty())
+			return;
+
+		int cellsX = CellCoord(upper.x) - CellCoord(lower.x) + 1;
+		int cellsY = CellCoord(upper.y) - CellCoord(lower.y) + 1;
+		if ((unsigned int)(cellsX * cellsY) > m_tableSize)
+		{
+			for (unsigned int i = 0; i < m_sortedIndices.size(); i++)
+				func(i);
+			return;
+		}
+
+		// the same as ForEachInRadius, a box reaching over an edge is searched again from the other side
+		XMFLOAT2 offsets[4] = { XMFLOAT2(0, 0) };
+		unsigned int images = 1;
+		if (m_bounds != nullptr)
+		{
+			XMFLOAT3 centre = XMFLOAT3((lower.x + upper.x) * 0.5f, (lower.y + upper.y) * 0.5f, 0.0f);
+			images = m_bounds->Images(centre, max(upper.x - lower.x, upper.y - lower.y) * 0.5f, offsets);
+		}
+		for (unsigned int image = 0; image < images; image++)
+		{
+			int minX = CellCoord(lower.x + offsets[image].x);
+			int maxX = CellCoord(upper.x + offsets[image].x);
+			int minY = CellCoord(lower.y + offsets[image].y);
+			int maxY = CellCoord(upper.y + offsets[image].y);
+			for (int y = minY; y <= maxY; y++)
+			{
+				for (int x = minX; x <= maxX; x++)
+				{
+					unsigned int cell = HashCell(x, y);
+					for (unsigned int i = m_cellStart[cell]; i < m_cellStart[cell + 1]; i++)
+					{
+						const XMFLOAT3& p = m_sortedPositions[i];
+						if (CellCoord(p.x) == x && CellCoord(p.y) == y)
+							func(i);
+					}
+				}
+			}
+		}
+	}
+
+	// index of the object nearest to position, or -1 if there isn't one
+	// skip(index) returns true for objects that should be ignored (e.g. self)
+	template<class Skip>
+	int									Nearest(const XMFLOAT3& position, Skip skip) const
+	{
+		int nearest = -1;
+		float shortestSq = FLT_MAX;
+		if (m_sortedIndices.empty())
+			return nearest;
+
+		if (NearestFrom(position, skip, nearest, shortestSq) || m_bounds == nullptr)
+			return nearest;
+
+		// then look over any edge that is closer than the nearest found so far
+		XMFLOAT2 offsets[4];
+		unsigned int images = m_bounds->Images(position, nearest == -1 ? FLT_MAX : sqrtf(shortestSq), offsets);
+		for (unsigned int image = 1; image < images; image++)
+		{
+			XMFLOAT3 p = XMFLOAT3(position.x + offsets[image].x, position.y + offsets[image].y, position.z);
+			if (NearestFrom(p, skip, nearest, shortestSq))
+				break;
+		}
+		return nearest;
+	}
+
+	// the k objects nearest to position, written to heap as (distance squared, index) pairs in no particular order
+	// heap must have room for k entries, returns how many were found
+	template<class Skip>
+	unsigned int						NearestK(const XMFLOAT3& position, unsigned int k, Skip skip, pair<float, unsigned int>* heap) const
+	{
+		unsigned int found = 0;
+		if (m_sortedIndices.empty() || k == 0)
+			return found;
+
+		if (NearestKFrom(position, k, skip, heap, found, false) || m_bounds == nullptr)
+			return found;
+
+		// then look over any edge that is closer than the kth nearest so far
+		XMFLOAT2 offsets[4];
+		unsigned int images = m_bounds->Images(position, found < k ? FLT_MAX : sqrtf(heap[0].first), offsets);
+		for (unsigned int image = 1; image < images; image++)
+		{
+			XMFLOAT3 p = XMFLOAT3(position.x + offsets[image].x, position.y + offsets[image].y, position.z);
+			if (NearestKFrom(p, k, skip, heap, found, true))
+				break;
+		}
+		return found;
+	}
+
+	// search on a torus, nullptr (the default) for an open plane
+	void								SetWorldBounds(const WorldBounds* bounds) { m_bounds = bounds; }
+	const WorldBounds*					GetWorldBounds() const { return m_bounds; }
+
+	// change the cell size used from the next build, the cells already built keep the size they were built at
+	void								SetCellSize(float cellSize) { m_nextCellSize = cellSize; }
+	// pick the cell size for the next build so that an occupied cell holds about targetCount objects
+	void								FitCellSize(float targetCount, float minSize, float maxSize);
+
+	// whether the two points fall in the same cell (not just the same hash bucket)
+	bool								SameCell(float ax, float ay, float bx, float by) const { return CellCoord(ax) == CellCoord(bx) && CellCoord(ay) == CellCoord(by); }
+
+	unsigned int						GetCount() const { return (unsigned int)m_positions.size(); }
+	// the size the current cells were built at
+	float								GetCellSize() const { return m_cellSize; }
+	unsigned int						GetOccupiedCellCount() const { return m_occupiedCells; }
+
+	// positions grouped by cell, for code that wants to walk every object in memory order
+	const vector<XMFLOAT3>&				GetSortedPositions() const { return m_sortedPositions; }
+	const vector<unsigned int>&			GetSortedIndices() const { return m_sortedIndices; }
+
+protected:
+	void								BuildCells();
+
+	template<class Func>
+	void								ForEachInCells(const XMFLOAT3& position, float radius, Func func) const
+	{
+		float radiusSq = radius * radius;
+		int minX = CellCoord(position.x - radius);
+		int maxX = CellCoord(position.x + radius);
+		int minY = CellCoord(position.y - radius);
+		int maxY = CellCoord(position.y + radius);
+
+		for (int y = minY; y <= maxY; y++)
+		{
+			for (int x = minX; x <= maxX; x++)
+			{
+				unsigned int cell = HashCell(x, y);
+				for (unsigned int i = m_cellStart[cell]; i < m_cellStart[cell + 1]; i++)
+				{
+					const XMFLOAT3& p = m_sortedPositions[i];
+
+					// different cells can share a bucket, only accept objects that are really in this cell
+					if (CellCoord(p.x) != x || CellCoord(p.y) != y)
+						continue;
+
+					if (DistanceSq(position, p) < radiusSq)
+						func(m_sortedIndices[i]);
+				}
+			}
+		}
+	}
+
+	// ring search from position, carrying on from nearest and shortestSq
+	// returns true if it ended up checking every object, so there is nothing left to find over an edge
+	template<class Skip>
+	bool								NearestFrom(const XMFLOAT3& position, Skip skip, int& nearest, float& shortestSq) const
+	{
+		int cx = CellCoord(position.x);
+		int cy = CellCoord(position.y);
+
+		// search outwards one ring of cells at a time until nothing closer can exist
+		int maxRing = max(max(abs(cx - m_minCellX), abs(m_maxCellX - cx)), max(abs(cy - m_minCellY), abs(m_maxCellY - cy)));
+		for (int ring = 0; ring <= maxRing; ring++)
+		{
+			// rings this big visit more cells than there are objects, scan the lot instead
+			if ((unsigned int)(8 * ring) > m_sortedIndices.size())
+			{
+				for (unsigned int i = 0; i < m_sortedIndices.size(); i++)
+				{
+					float l = WrappedDistanceSq(position, m_sortedPositions[i]);
+					if (l < shortestSq && !skip(m_sortedIndices[i]))
+					{
+						shortestSq = l;
+						nearest = m_sortedIndices[i];
+					}
+				}
+				return true;
+			}
+
+			for (int y = cy - ring; y <= cy + ring; y++)
+			{
+				// only the edge of the ring, the inside has already been searched
+				int step = (y == cy - ring || y == cy + ring) ? 1 : max(2 * ring, 1);
+				for (int x = cx - ring; x <= cx + ring; x += step)
+				{
+					unsigned int cell = HashCell(x, y);
+					for (unsigned int i = m_cellStart[cell]; i < m_cellStart[cell + 1]; i++)
+					{
+						float l = WrappedDistanceSq(position, m_sortedPositions[i]);
+						if (l < shortestSq && !skip(m_sortedIndices[i]))
+						{
+							shortestSq = l;
+							nearest = m_sortedIndices[i];
+						}
+					}
+				}
+			}
+
+			// anything in the next ring is at least ring * cellSize away
+			float bound = ring * m_cellSize;
+			if (nearest != -1 && shortestSq <= bound * bound)
+				break;
+		}
+
+		return false;
+	}
+
+	// ring search for the k nearest, carrying on from the found entries already in heap
+	// checkDuplicates is needed once a second copy of position is searched, as an object can be in range of both
+	template<class Skip>
+	bool								NearestKFrom(const XMFLOAT3& position, unsigned int k, Skip skip, pair<float, unsigned int>* heap, unsigned int& found, bool checkDuplicates) const
+	{
+		// bounded max heap, the furthest of the best k so far is always on top
+		auto consider = [&](unsigned int sorted)
+		{
+			float l = WrappedDistanceSq(position, m_sortedPositions[sorted]);
+			if (found == k && l >= heap[0].first)
+				return;
+			if (skip(m_sortedIndices[sorted]))
+				return;
+			if (checkDuplicates)
+			{
+				for (unsigned int i = 0; i < found; i++)
+				{
+					if (heap[i].second == m_sortedIndices[sorted])
+						return;
+				}
+			}
+
+			if (found == k)
+			{
+				pop_heap(heap, heap + found);
+				found--;
+			}
+			heap[found++] = make_pair(l, m_sortedIndices[sorted]);
+			push_heap(heap, heap + found);
+		};
+
+		int cx = CellCoord(position.x);
+		int cy = CellCoord(position.y);
+
+		// same outward ring search as Nearest, stopping once the kth nearest is closer than the next ring
+		int maxRing = max(max(abs(cx - m_minCellX), abs(m_maxCellX - cx)), max(abs(cy - m_minCellY), abs(m_maxCellY - cy)));
+		for (int ring = 0; ring <= maxRing; ring++)
+		{
+			if ((unsigned int)(8 * ring) > m_sortedIndices.size())
+			{
+				// start again over everything, the rings already searched would otherwise be added twice
+				found = 0;
+				for (unsigned int i = 0; i < m_sortedIndices.size(); i++)
+					consider(i);
+				return true;
+			}
+
+			for (int y = cy - ring; y <= cy + ring; y++)
+			{
+				int step = (y == cy - ring || y == cy + ring) ? 1 : max(2 * ring, 1);
+				for (int x = cx - ring; x <= cx + ring; x += step)
+				{
+					unsigned int cell = HashCell(x, y);
+					for (unsigned int i = m_cellStart[cell]; i < m_cellStart[cell + 1]; i++)
+					{
+						// a bucket can come up again in a later ring, only take objects that are really in this cell
+						const XMFLOAT3& p = m_sortedPositions[i];
+						if (CellCoord(p.x) != x || CellCoord(p.y) != y)
+							continue;
+
+						consider(i);
+					}
+				}
+			}
+
+			float bound = ring * m_cellSize;
+			if (found == k && heap[0].first <= bound * bound)
+				break;
+		}
+
+		return false;
+	}
+
+
+	int									CellCoord(float v) const { return (int)floorf(v * m_invCellSize); }
+	unsigned int						HashCell(int x, int y) const { return (((unsigned int)x * 73856093u) ^ ((unsigned int)y * 19349663u)) & m_tableMask; }
+	static float						DistanceSq(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		float dx = a.x - b.x;
+		float dy = a.y - b.y;
+		float dz = a.z - b.z;
+		return (dx * dx) + (dy * dy) + (dz * dz);
+	}
+	// the short way round on a torus
+	float								WrappedDistanceSq(const XMFLOAT3& a, const XMFLOAT3& b) const
+	{
+		if (m_bounds == nullptr)
+			return DistanceSq(a, b);
+
+		XMFLOAT3 d = m_bounds->Delta(a, b);
+		return (d.x * d.x) + (d.y * d.y) + (d.z * d.z);
+	}
+
+	float								m_cellSize;
+	float								m_invCellSize;
+	float								m_nextCellSize;	// taken up by the next BuildCells, so queries always agree with the cells
+	const WorldBounds*					m_bounds = nullptr;
+	unsigned int						m_tableSize = 0;
+	unsigned int						m_tableMask = 0;
+	unsigned int						m_occupiedCells = 0;
+
+	int									m_minCellX = 0;
+	int									m_maxCellX = 0;
+	int									m_minCellY = 0;
+	int									m_maxCellY = 0;
+
+	vector<XMFLOAT3>					m_positions;		// in object order
+	vector<unsigned int>				m_cellOf;			// bucket of each object
+	vector<unsigned int>				m_cellStart;		// first sorted entry of each bucket, plus one on the end
+	vector<unsigned int>				m_sortedIndices;	// object indices grouped by bucket
+	vector<XMFLOAT3>					m_sortedPositions;	// positions in the same order so a bucket is read from one block
+};
@@ -0,0 +1,250 @@
+#pragma once
+
+#include "SteeringKernel.h"
+
+// the body of SteeringKernel, included by the file built for each instruction set
+// S is one of the SimdLanes types, each lane is one boid, D is the number of axes
+// static like everything else here, see SteeringKernel.h
+
+template<class S, unsigned int D>
+static void SteerBatchesIn(const SteeringFrame& f)
+{
+	typedef typename S::V V;
+	typedef typename S::M M;
+	const unsigned int W = S::Width;
+
+	const V zero = S::Set(0.0f);
+	const V one = S::Set(1.0f);
+	const V half = S::Set(0.5f);
+	const V lanes = S::Lanes();
+	const V nearbySq = S::Set(f.nearbyDistance * f.nearbyDistance);
+	const V separationSq = S::Set(f.separationDistance * f.separationDistance);
+	const V killDistanceSq = S::Set(f.killDistance * f.killDistance);
+	const V separationScale = S::Set(f.separationScale);
+	const V alignmentScale = S::Set(f.alignmentScale);
+	const V cohesionScale = S::Set(f.cohesionScale);
+	const V fleeScale = S::Set(f.fleeScale);
+
+	// only x and y wrap
+	const bool wrap = f.worldSize[0] > 0.0f;
+	const V size[2] = { S::Set(f.worldSize[0]), S::Set(f.worldSize[1]) };
+	const V invSize[2] = { S::Set(wrap ? 1.0f / f.worldSize[0] : 0.0f), S::Set(wrap ? 1.0f / f.worldSize[1] : 0.0f) };
+
+	const bool predators = f.predatorGrid != nullptr && f.predatorCount > 0;
+
+	const float* x = f.position[0];
+	const float* y = f.position[1];
+
+	auto length = [&](const V* v)
+	{
+		V lengthSq = zero;
+		for (unsigned int k = 0; k < D; k++)
+			lengthSq = S::Add(lengthSq, S::Mul(v[k], v[k]));
+		return S::Sqrt(lengthSq);
+	};
+
+	// which cell of the boid grid a position is in, as SpatialGrid::CellCoord
+	auto cell = [&](float v) { return (int)floorf(v * f.invCellSize); };
+
+	for (unsigned int s = f.begin, n = 0; s < f.end; s += n)
+	{
+		// a batch is a run of boids from the same cell, so the box around it stays small
+		const int cellX = cell(x[s]);
+		const int cellY = cell(y[s]);
+		n = 1;
+		while (n < W && s + n < f.end && cell(x[s + n]) == cellX && cell(y[s + n]) == cellY)
+			n++;
+		const M valid = S::Less(lanes, S::Set((float)n));
+
+		V p[D];
+		V dir[D];
+		for (unsigned int k = 0; k < D; k++)
+		{
+			p[k] = S::Load(f.position[k] + s);
+			dir[k] = S::Load(f.direction[k] + s);
+		}
+
+		// anything in range of a boid in the batch is inside this box
+		float lower[2] = { x[s], y[s] };
+		float upper[2] = { x[s], y[s] };
+		float reach = 0.0f;
+		for (unsigned int i = 1; i < n; i++)
+		{
+			lower[0] = SmallerOf(lower[0], x[s + i]);
+			lower[1] = SmallerOf(lower[1], y[s + i]);
+			upper[0] = LargerOf(upper[0], x[s + i]);
+			upper[1] = LargerOf(upper[1], y[s + i]);
+		}
+		for (unsigned int i = 0; i < n; i++)
+			reach = LargerOf(reach, LargerOf(f.fleeDistance[s + i], f.killDistance));
+
+		// the short way round on a torus
+		auto delta = [&](V* d)
+		{
+			if (!wrap)
+				return;
+			for (unsigned int k = 0; k < 2; k++)
+				d[k] = S::Sub(d[k], S::Mul(size[k], S::Floor(S::Add(S::Mul(d[k], invSize[k]), half))));
+		};
+
+		V separation[D], direction[D], position[D];
+		for (unsigned int k = 0; k < D; k++)
+		{
+			separation[k] = zero;
+			direction[k] = zero;
+			position[k] = zero;
+		}
+		V separationCount = zero;
+		V count = zero;
+
+		const float nearby = f.nearbyDistance;
+		SearchBox(f.search, f.grid, lower[0] - nearby, lower[1] - nearby, upper[0] + nearby, upper[1] + nearby, [&](unsigned int j)
+		{
+			V d[D];
+			for (unsigned int k = 0; k < D; k++)
+				d[k] = S::Sub(p[k], S::Set(f.position[k][j]));
+			delta(d);
+			V lSq = zero;
+			for (unsigned int k = 0; k < D; k++)
+				lSq = S::Add(lSq, S::Mul(d[k], d[k]));
+
+			M nearby = S::And(S::Less(lSq, nearbySq), valid);
+			if (j - s < W)
+				nearby = S::And(nearby, S::NotEqual(lanes, S::Set((float)(j - s)))); // not itself
+			if (!S::Any(nearby))
+				return;
+
+			for (unsigned int k = 0; k < D; k++)
+			{
+				direction[k] = S::Add(direction[k], S::Select(nearby, S::Set(f.direction[k][j]), zero));
+				// the neighbour's nearest image, as Boid::NearestImage would give it
+				V b = (wrap && k < 2) ? S::Sub(p[k], d[k]) : S::Set(f.position[k][j]);
+				position[k] = S::Add(position[k], S::Select(nearby, b, zero));
+			}
+			count = S::Add(count, S::Select(nearby, one, zero));
+
+			M close = S::And(S::And(nearby, S::Less(lSq, separationSq)), S::Greater(lSq, zero)); // not exactly on top, see Boid
+			if (S::Any(close))
+			{
+				// closer boids will have a greater weight
+				V l = S::Sqrt(lSq);
+				for (unsigned int k = 0; k < D; k++)
+					separation[k] = S::Add(separation[k], S::Select(close, S::Div(S::Div(d[k], l), l), zero));
+				separationCount = S::Add(separationCount, S::Select(close, one, zero));
+			}
+		});
+
+		// each rule falls back to the current direction when it has nothing to go on, as in Boid
+		auto normalise = [&](V* v)
+		{
+			V l = length(v);
+			for (unsigned int k = 0; k < D; k++)
+				v[k] = S::Div(v[k], l);
+		};
+
+		M separating = S::Greater(length(separation), zero);
+		for (unsigned int k = 0; k < D; k++)
+			separation[k] = S::Div(separation[k], separationCount);
+		normalise(separation);
+
+		V alignment[D];
+		V cohesion[D];
+		for (unsigned int k = 0; k < D; k++)
+		{
+			alignment[k] = S::Div(direction[k], count);
+			cohesion[k] = S::Sub(S::Div(position[k], count), p[k]);
+		}
+		// false where count is 0 as well, 0 / 0 isn't greater than anything
+		M aligning = S::Greater(length(alignment), zero);
+		M cohering = S::Greater(length(cohesion), zero);
+		normalise(alignment);
+		normalise(cohesion);
+
+		for (unsigned int k = 0; k < D; k++)
+		{
+			separation[k] = S::Select(separating, separation[k], dir[k]);
+			alignment[k] = S::Select(aligning, alignment[k], dir[k]);
+			cohesion[k] = S::Select(cohering, cohesion[k], dir[k]);
+		}
+
+		// flee from the predators in range and in the field of view, caught if one is within the kill distance
+		V flee[D];
+		for (unsigned int k = 0; k < D; k++)
+			flee[k] = zero;
+		M caught = S::Less(one, zero);
+		if (predators)
+		{
+			const V fleeDistance = S::Load(f.fleeDistance + s);
+			const V fleeDistanceSq = S::Mul(fleeDistance, fleeDistance);
+			const V cosHalfFOV = S::Load(f.cosHalfFOV + s);
+			V dirLengthSq = zero;
+			for (unsigned int k = 0; k < D; k++)
+				dirLengthSq = S::Add(dirLengthSq, S::Mul(dir[k], dir[k]));
+
+			SearchBox(f.search, f.predatorGrid, lower[0] - reach, lower[1] - reach, upper[0] + reach, upper[1] + reach, [&](unsigned int j)
+			{
+				const float* predator = f.predatorPosition + (j * 3);
+				V d[D];
+				for (unsigned int k = 0; k < D; k++)
+					d[k] = S::Sub(p[k], S::Set(predator[k]));
+				delta(d);
+				V lSq = zero;
+				V dot = zero;
+				for (unsigned int k = 0; k < D; k++)
+				{
+					lSq = S::Add(lSq, S::Mul(d[k], d[k]));
+					dot = S::Add(dot, S::Mul(dir[k], d[k]));
+				}
+				// squared distances, as Boid compares them
+				M kill = S::And(S::LessEqual(lSq, killDistanceSq), valid);
+				if (f.canDie)
+					caught = S::Or(caught, kill);
+
+				// the predator is at -d from the boid, see PerceptionCone::Inside
+				dot = S::Sub(zero, dot);
+				M seen = S::GreaterEqual(dot, S::Mul(cosHalfFOV, S::Sqrt(S::Mul(dirLengthSq, lSq))));
+				M fleeing = S::And(S::AndNot(S::Less(lSq, fleeDistanceSq), kill), seen);
+				if (!f.canDie)
+					fleeing = S::Or(fleeing, kill);
+
+				for (unsigned int k = 0; k < D; k++)
+					flee[k] = S::Add(flee[k], S::Select(fleeing, d[k], zero));
+			});
+
+			M spotted = S::Greater(length(flee), zero);
+			for (unsigned int k = 0; k < D; k++)
+				flee[k] = S::Select(spotted, flee[k], dir[k]);
+		}
+
+		// scale and add the four together
+		V newDirection[D];
+		for (unsigned int k = 0; k < D; k++)
+		{
+			V force = S::Add(S::Add(S::Add(S::Mul(separation[k], separationScale), S::Mul(alignment[k], alignmentScale)), S::Mul(cohesion[k], cohesionScale)), S::Mul(flee[k], fleeScale));
+			newDirection[k] = S::Add(dir[k], force);
+		}
+		V l = length(newDirection);
+		M moving = S::NotEqual(l, zero);
+		// only the batch's own lanes, the rest of a register would land on the next batch, which may be another thread's
+		for (unsigned int k = 0; k < D; k++)
+		{
+			float lane[SIMD_MAX_WIDTH];
+			S::Store(lane, S::Select(moving, S::Div(newDirection[k], l), zero));
+			for (unsigned int i = 0; i < n; i++)
+				f.newDirection[k][s + i] = lane[i];
+		}
+
+		unsigned int caughtBits = S::Bits(caught);
+		for (unsigned int i = 0; i < n; i++)
+			f.caught[s + i] = (caughtBits >> i) & 1;
+	}
+}
+
+template<class S>
+static void SteerBatches(const SteeringFrame& f)
+{
+	if (f.dimensions == 3)
+		SteerBatchesIn<S, 3>(f);
+	else
+		SteerBatchesIn<S, 2>(f);
+}
@@ -0,0 +1,102 @@
+#include "SteeringBatch.h"
+#include "QuantisedBatch.h"
+#include "SpatialGrid.h"
+
+void SteeringKernel::Run(const SteeringFrame& frame, SimdLevel level)
+{
+	switch (level)
+	{
+	case SIMD_LEVEL_AVX512:
+		RunAVX512(frame);
+		break;
+	case SIMD_LEVEL_AVX2:
+		RunAVX2(frame);
+		break;
+	case SIMD_LEVEL_SSE41:
+		RunSSE41(frame);
+		break;
+	default:
+		RunScalar(frame);
+		break;
+	}
+}
+
+void SteeringKernel::RunScalar(const SteeringFrame& frame)
+{
+	SteerBatches<SimdScalar>(frame);
+}
+
+void SteeringKernel::Run(const QuantisedFrame& frame, SimdLevel level)
+{
+	switch (level)
+	{
+	case SIMD_LEVEL_AVX512:
+		RunAVX512(frame);
+		break;
+	case SIMD_LEVEL_AVX2:
+		RunAVX2(frame);
+		break;
+	case SIMD_LEVEL_SSE41:
+		RunSSE41(frame);
+		break;
+	default:
+		RunScalar(frame);
+		break;
+	}
+}
+
+void SteeringKernel::RunScalar(const QuantisedFrame& frame)
+{
+	SteerQuantisedBatches<SimdScalar>(frame);
+}
+
+void SteeringKernel::Search(const void* grid, float lowerX, float lowerY, float upperX, float upperY, SteeringVisit visit, void* context)
+{
+	// this file is built with the same flags as SpatialGrid.cpp, the kernels only ever call into it
+	unsigned int sorted[STEERING_SEARCH_CHUNK];
+	unsigned int count = 0;
+	((const SpatialGrid*)grid)->ForEachSortedInBox(XMFLOAT2(lowerX, lowerY), XMFLOAT2(upperX, upperY), [&](unsigned int i)
+	{
+		sorted[count++] = i;
+		if (count == STEERING_SEARCH_CHUNK)
+		{
+			visit(sorted, count, context);
+			count = 0;
+		}
+	});
+	if (count > 0)
+		visit(sorted, count, context);
+}
+
+bool SteeringKernel::Supported(SimdLevel level)
+{
+	switch (level)
+	{
+	case SIMD_LEVEL_SCALAR:
+		return true;
+	case SIMD_LEVEL_SSE41:
+		return builtSSE41 && CpuFeatures::Supports(level);
+	case SIMD_LEVEL_AVX2:
+		return builtAVX2 && CpuFeatures::Supports(level);
+	case SIMD_LEVEL_AVX512:
+		return builtAVX512 && CpuFeatures::Supports(level);
+	default:
+		return false;
+	}
+}
+
+SimdLevel SteeringKernel::Best()
+{
+	// a cell rarely holds more than 8 boids, so most of the 16 avx-512 lanes would sit idle and it comes out
+	// slower than avx2 (see Benchmark::SteeringKernelThroughput), only use it when asked for
+	int highest = CpuFeatures::Level();
+	if (highest == SIMD_LEVEL_AVX512 && !CpuFeatures::LevelForced())
+		highest = SIMD_LEVEL_AVX2;
+
+	for (int level = highest; level > SIMD_LEVEL_SCALAR; level--)
+	{
+		if (Supported((SimdLevel)level))
+			return (SimdLevel)level;
+	}
+	return SIMD_LEVEL_SCALAR;
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "SimdLanes.h"
+#include "CpuFeatures.h"
+
+#define STEERING_KERNEL_TOLERANCE	1e-4f	// directions agree with Boid::Update to within this, more only if the compiler fuses or reorders the sums
+#define STEERING_SEARCH_CHUNK		256		// places SteeringKernel::Search hands over at a time
+
+// the kernels are built with /arch:AVX2 and /arch:AVX512 for some files, so nothing they include may have inline
+// functions the rest of the exe also uses, the linker could keep the avx copy and run it on any cpu
+// the frames are plain arrays and numbers, and grids are searched through SteeringSearch by code built normally
+
+// called with up to STEERING_SEARCH_CHUNK places in a grid's sorted order at a time
+typedef void (*SteeringVisit)(const unsigned int* sorted, unsigned int count, void* context);
+// visit every object in the cells of grid (a SpatialGrid) that the box from lower to upper touches
+typedef void (*SteeringSearch)(const void* grid, float lowerX, float lowerY, float upperX, float upperY, SteeringVisit visit, void* context);
+
+// the kernel's own min, max and search, static so each file keeps the copy built for its instruction set
+template<class T>
+static T SmallerOf(T a, T b) { return b < a ? b : a; }
+template<class T>
+static T LargerOf(T a, T b) { return a < b ? b : a; }
+
+template<class Func>
+static void VisitSorted(const unsigned int* sorted, unsigned int count, void* context)
+{
+	Func& func = *(Func*)context;
+	for (unsigned int i = 0; i < count; i++)
+		func(sorted[i]);
+}
+
+// calls func(sorted) for everything search finds, as SpatialGrid::ForEachSortedInBox would
+template<class Func>
+static void SearchBox(SteeringSearch search, const void* grid, float lowerX, float lowerY, float upperX, float upperY, Func func)
+{
+	search(grid, lowerX, lowerY, upperX, upperY, VisitSorted<Func>, &func);
+}
+
+// what the kernel reads and writes for one frame
+// every array is in the boid grid's sorted order and padded with room for SIMD_MAX_WIDTH - 1 more
+struct SteeringFrame
+{
+	unsigned int						begin;			// the boids to steer, from the start of one cell to the end of another
+	unsigned int						end;			// so the batches are the same however the flock is split up
+	unsigned int						dimensions;		// 2 or 3, only the first that many axes are used
+	const float*						position[3];
+	const float*						direction[3];
+	const float*						cosHalfFOV;
+	const float*						fleeDistance;
+	float								invCellSize;	// 1 / the grid's cell size, a batch never spans two cells
+
+	SteeringSearch						search;			// SteeringKernel::Search
+	const void*							grid;			// the SpatialGrid built from the positions
+	const void*							predatorGrid;	// built from the predators, nullptr if there aren't any
+	const float*						predatorPosition;	// x, y and z of each predator in predatorGrid's sorted order
+	unsigned int						predatorCount;
+	float								worldSize[2];	// the size of the torus, 0 for an open plane
+
+	float								nearbyDistance;	// NEARBY_DISTANCE and SEPARATION_DISTANCE, Boid.h isn't included here
+	float								separationDistance;
+	float								separationScale;
+	float								alignmentScale;
+	float								cohesionScale;
+	float								fleeScale;
+	float								killDistance;
+	bool								canDie;
+
+	// the new directions, 0 where the forces cancelled out and the caller has to pick one
+	float*								newDirection[3];
+	unsigned char*						caught;			// set for boids a predator got, never when canDie is off
+};
+
+#define QUANTISED_OFFSET_STEPS		65536.0f	// positions are stored in this many steps across a cell
+#define QUANTISED_DIRECTION_STEPS	32767.0f	// a direction (or cosine) of 1 is stored as this
+
+// the same for a QuantisedPopulation, every array is in cell order and decoded in the kernel
+struct QuantisedFrame
+{
+	unsigned int						cellBegin;		// the cells to steer the boids of, every boid in them is written
+	unsigned int						cellEnd;
+	unsigned int						cellsX;
+	unsigned int						cellsY;
+	float								cellSize[2];
+	float								lower[2];		// the corner of cell 0, the world wraps after cellsX by cellsY cells
+	const unsigned int*					cellStart;		// the first boid in each cell, cellsX * cellsY + 1 of them
+
+	const unsigned short*				offsetX;		// from the cell's corner, in QUANTISED_OFFSET_STEPS
+	const unsigned short*				offsetY;
+	const short*						directionX;		// in QUANTISED_DIRECTION_STEPS
+	const short*						directionY;
+	const short*						cosHalfFOV;		// in QUANTISED_DIRECTION_STEPS
+	const unsigned char*				speed;			// above SPEED_DEFAULT
+	const unsigned char*				fleeDistance;	// above FLEE_DISTANCE_MIN
+
+	SteeringSearch						search;			// SteeringKernel::Search
+	const void*							predatorGrid;	// built from the predators, nullptr if there aren't any
+	const float*						predatorPosition;	// x, y and z of each predator in predatorGrid's sorted order
+	unsigned int						predatorCount;
+	float								worldSize[2];
+
+	float								nearbyDistance;	// the constants from Boid.h, as for SteeringFrame
+	float								separationDistance;
+	float								speedDefault;
+	float								fleeDistanceMin;
+	float								t;
+	float								separationScale;
+	float								alignmentScale;
+	float								cohesionScale;
+	float								fleeScale;
+	float								killDistance;
+	bool								canDie;
+
+	// where each boid moved to and its new direction, encoded the same way, in the same order as the input
+	unsigned int*						newCell;
+	unsigned short*						newOffsetX;
+	unsigned short*						newOffsetY;
+	short*								newDirectionX;
+	short*								newDirectionY;
+	unsigned char*						caught;
+};
+
+/*
+ separation, alignment, cohesion and flee for a batch of boids at once, one boid per lane
+ the boids in a batch are next to each other in the grid, so they share one box of candidate
+ neighbours which are read once and compared against every lane
+ every boid steers from the same snapshot of the flock, so the batch doesn't see itself move
+ 2d and 3d are separate instantiations, chosen once per call rather than per boid
+ the same template is built for each SimdLevel (SteeringKernelSSE41.cpp, SteeringKernelAVX2.cpp, SteeringKernelAVX512.cpp)
+*/
+
+class SteeringKernel
+{
+public:
+	static void							Run(const SteeringFrame& frame, SimdLevel level);
+	// steer and move a quantised flock, the boids in a batch share a cell (QuantisedBatch.h)
+	static void							Run(const QuantisedFrame& frame, SimdLevel level);
+
+	// what SteeringFrame::search and QuantisedFrame::search are set to, SpatialGrid::ForEachSortedInBox built normally
+	static void							Search(const void* grid, float lowerX, float lowerY, float upperX, float upperY, SteeringVisit visit, void* context);
+
+	// built into this exe and runnable on this cpu
+	static bool							Supported(SimdLevel level);
+	// the highest supported level up to CpuFeatures::Level, the one to run each frame
+	static SimdLevel					Best();
+
+private:
+	static void							RunScalar(const SteeringFrame& frame);
+	static void							RunSSE41(const SteeringFrame& frame);
+	static void							RunAVX2(const SteeringFrame& frame);
+	static void							RunAVX512(const SteeringFrame& frame);
+	static void							RunScalar(const QuantisedFrame& frame);
+	static void							RunSSE41(const QuantisedFrame& frame);
+	static void							RunAVX2(const QuantisedFrame& frame);
+	static void							RunAVX512(const QuantisedFrame& frame);
+
+	static const bool					builtSSE41;
+	static const bool					builtAVX2;
+	static const bool					builtAVX512;
+};
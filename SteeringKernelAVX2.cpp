@@ -0,0 +1,31 @@
+#include "SteeringBatch.h"
+#include "QuantisedBatch.h"
+
+// built with /arch:AVX2 (set on this file only in the project), only called when CpuFeatures says the cpu has it
+// so include nothing else here, anything inline the rest of the exe shares could be kept as this file's avx copy
+
+#if defined(SIMD_HAS_AVX2)
+const bool SteeringKernel::builtAVX2 = true;
+
+void SteeringKernel::RunAVX2(const SteeringFrame& frame)
+{
+	SteerBatches<SimdAVX2>(frame);
+}
+
+void SteeringKernel::RunAVX2(const QuantisedFrame& frame)
+{
+	SteerQuantisedBatches<SimdAVX2>(frame);
+}
+#else
+const bool SteeringKernel::builtAVX2 = false;
+
+void SteeringKernel::RunAVX2(const SteeringFrame& frame)
+{
+	SteerBatches<SimdScalar>(frame);
+}
+
+void SteeringKernel::RunAVX2(const QuantisedFrame& frame)
+{
+	SteerQuantisedBatches<SimdScalar>(frame);
+}
+#endif
@@ -0,0 +1,31 @@
+#include "SteeringBatch.h"
+#include "QuantisedBatch.h"
+
+// built with /arch:AVX512 (set on this file only in the project), only called when CpuFeatures says the cpu has it
+// and, as for SteeringKernelAVX2.cpp, the two batch headers are all it may include
+
+#if defined(SIMD_HAS_AVX512)
+const bool SteeringKernel::builtAVX512 = true;
+
+void SteeringKernel::RunAVX512(const SteeringFrame& frame)
+{
+	SteerBatches<SimdAVX512>(frame);
+}
+
+void SteeringKernel::RunAVX512(const QuantisedFrame& frame)
+{
+	SteerQuantisedBatches<SimdAVX512>(frame);
+}
+#else
+const bool SteeringKernel::builtAVX512 = false;
+
+void SteeringKernel::RunAVX512(const SteeringFrame& frame)
+{
+	SteerBatches<SimdScalar>(frame);
+}
+
+void SteeringKernel::RunAVX512(const QuantisedFrame& frame)
+{
+	SteerQuantisedBatches<SimdScalar>(frame);
+}
+#endif
@@ -0,0 +1,30 @@
+#include "SteeringBatch.h"
+#include "QuantisedBatch.h"
+
+// msvc needs no special flags for SSE4.1, only called when CpuFeatures says the cpu has it
+
+#if defined(SIMD_HAS_SSE41)
+const bool SteeringKernel::builtSSE41 = true;
+
+void SteeringKernel::RunSSE41(const SteeringFrame& frame)
+{
+	SteerBatches<SimdSSE41>(frame);
+}
+
+void SteeringKernel::RunSSE41(const QuantisedFrame& frame)
+{
+	SteerQuantisedBatches<SimdSSE41>(frame);
+}
+#else
+const bool SteeringKernel::builtSSE41 = false;
+
+void SteeringKernel::RunSSE41(const SteeringFrame& frame)
+{
+	SteerBatches<SimdScalar>(frame);
+}
+
+void SteeringKernel::RunSSE41(const QuantisedFrame& frame)
+{
+	SteerQuantisedBatches<SimdScalar>(frame);
+}
+#endif
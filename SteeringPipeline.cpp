@@ -0,0 +1,43 @@
+#include "SteeringPipeline.h"
+
+void RuntimeSteeringPipeline::Update(Boid& self, float t, vecBoid* boidList, SpatialGrid* grid, vector<Predator*>* predatorList, SpatialGrid* predatorGrid)
+{
+	bool boids = false;
+	bool predators = false;
+	for (auto& rule : m_rules)
+	{
+		boids |= rule->boids;
+		predators |= rule->predators;
+	}
+	RulePipeline::Run(*this, boids, predators, self, t, boidList, grid, predatorList, predatorGrid);
+}
+
+void RuntimeSteeringPipeline::Begin(SteeringContext& c)
+{
+	for (auto& rule : m_rules)
+		rule->Begin(c);
+}
+
+void RuntimeSteeringPipeline::VisitBoid(SteeringContext& c, const SteeringNeighbour& n)
+{
+	for (auto& rule : m_rules)
+		rule->VisitBoid(c, n);
+}
+
+void RuntimeSteeringPipeline::VisitPredator(SteeringContext& c, const SteeringPredator& p)
+{
+	for (auto& rule : m_rules)
+		rule->VisitPredator(c, p);
+}
+
+XMFLOAT3 RuntimeSteeringPipeline::Forces(SteeringContext& c)
+{
+	XMFLOAT3 forces = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	for (auto& rule : m_rules)
+	{
+		XMFLOAT3 force = rule->Force(c);
+		XMFLOAT3 weighted = XMFLOAT3(force.x * rule->weight, force.y * rule->weight, force.z * rule->weight);
+		forces = XMFLOAT3(forces.x + weighted.x, forces.y + weighted.y, forces.z + weighted.z);
+	}
+	return forces;
+}
@@ -0,0 +1,483 @@
+#pragma once
+
+#include "Boid.h"
+#include "Predator.h"
+
+#include <tuple>
+#include <utility>
+#include <memory>
+#include <initializer_list>
+
+/*
+ the steering rules as policy types, composed into a pipeline when the program is built
+ SteeringPipeline<Separation<>, Alignment<>, Cohesion<>, Flee<>> gives exactly Boid::Update's fused pass,
+ every rule is fed from one loop over the nearby boids and one over the predators in range,
+ and a loop no rule in the pipeline wants isn't run at all
+ a rule's weight is either the boid's own scale for it (TraitWeight, the default) or a FixedWeight known
+ at build time, which the compiler folds into the sum (and drops entirely for a weight of 1)
+ RuntimeSteeringPipeline runs the same rules picked and weighted while the program runs, through virtual calls
+ only the plain range query is supported, not topological neighbours, neighbour lists, cell aggregates
+ or a limited flockmate field of view
+
+ a rule is a struct with
+	static const bool boids, predators		which loops it wants to see
+	struct State							what it gathers for one boid
+	Begin(State&, SteeringContext&)
+	VisitBoid(State&, SteeringContext&, const SteeringNeighbour&)
+	VisitPredator(State&, SteeringContext&, const SteeringPredator&)
+	XMFLOAT3 Force(State&, SteeringContext&)	the unweighted force once every neighbour has been seen
+	float Scale(const SteeringContext&)			the weight, from its Weight policy
+ deriving from SteeringRule gives empty visits and the vector maths the rules share
+*/
+
+// the boid being steered, as the rules see it
+struct SteeringContext
+{
+	const Boid*							boid;
+	XMFLOAT3							position;
+	XMFLOAT3							direction;
+	const BoidHotTraits*				hot;
+	bool								hasPredators;	// false when there are no predators at all
+	// written back to the boid once every rule has run
+	bool								alive;
+	bool								spotPredator;
+};
+
+// a boid inside NEARBY_DISTANCE
+struct SteeringNeighbour
+{
+	Boid*								boid;
+	XMFLOAT3							position;	// its nearest image when the world wraps
+	XMFLOAT3							diff;		// from it to the boid being steered
+	float								lSq;
+};
+
+// a predator inside the boid's predatorReach
+struct SteeringPredator
+{
+	Predator*							predator;
+	XMFLOAT3							diff;
+	float								lSq;
+};
+
+// the weight is the boid's own scale for the rule, read every update
+struct TraitWeight
+{
+	static float						Get(float trait) { return trait; }
+};
+
+// the weight is Numerator / Denominator whatever the boid's traits say (floats can't be template parameters)
+template<int Numerator, int Denominator = 1>
+struct FixedWeight
+{
+	static float						Get(float) { return (float)Numerator / (float)Denominator; }
+};
+
+struct SteeringRule
+{
+	template<class State> static void	VisitBoid(State&, SteeringContext&, const SteeringNeighbour&) {}
+	template<class State> static void	VisitPredator(State&, SteeringContext&, const SteeringPredator&) {}
+
+	// the same float operations as Boid's, so a pipeline matches Boid::Update exactly
+	static XMFLOAT3						Divide(const XMFLOAT3& f, float scalar) { return XMFLOAT3(f.x / scalar, f.y / scalar, f.z / scalar); }
+	static float						Magnitude(const XMFLOAT3& f) { return sqrt((f.x * f.x) + (f.y * f.y) + (f.z * f.z)); }
+	static XMFLOAT3						Normalise(const XMFLOAT3& f) { return Divide(f, Magnitude(f)); }
+};
+
+// away from boids inside SEPARATION_DISTANCE, closer ones counting for more
+template<class Weight = TraitWeight>
+struct Separation : SteeringRule
+{
+	static const bool					boids = true;
+	static const bool					predators = false;
+
+	struct State
+	{
+		XMFLOAT3						sum;
+		int								count;
+	};
+
+	static void							Begin(State& s, SteeringContext&) { s.sum = XMFLOAT3(0, 0, 0); s.count = 0; }
+
+	static void							VisitBoid(State& s, SteeringContext&, const SteeringNeighbour& n)
+	{
+		// a boid exactly on top of this one gives no direction to separate in
+		if (n.lSq < SEPARATION_DISTANCE * SEPARATION_DISTANCE && n.lSq > 0.0f)
+		{
+			float l = sqrt(n.lSq);
+			s.sum.x += (n.diff.x / l) / l;
+			s.sum.y += (n.diff.y / l) / l;
+			s.sum.z += (n.diff.z / l) / l;
+			s.count++;
+		}
+	}
+
+	static XMFLOAT3						Force(State& s, SteeringContext& c)
+	{
+		if (Magnitude(s.sum) > 0)
+			return Normalise(Divide(s.sum, (float)s.count));
+		return c.direction;
+	}
+
+	static float						Scale(const SteeringContext& c) { return Weight::Get(c.hot->separationScale); }
+};
+
+// the average heading of the nearby boids
+template<class Weight = TraitWeight>
+struct Alignment : SteeringRule
+{
+	static const bool					boids = true;
+	static const bool					predators = false;
+
+	struct State
+	{
+		XMFLOAT3						sum;
+		int								count;
+	};
+
+	static void							Begin(State& s, SteeringContext&) { s.sum = XMFLOAT3(0, 0, 0); s.count = 0; }
+
+	static void							VisitBoid(State& s, SteeringContext&, const SteeringNeighbour& n)
+	{
+		const XMFLOAT3& direction = *n.boid->ReadDirection();
+		s.sum = XMFLOAT3(direction.x + s.sum.x, direction.y + s.sum.y, direction.z + s.sum.z);
+		s.count++;
+	}
+
+	static XMFLOAT3						Force(State& s, SteeringContext& c)
+	{
+		if (s.count == 0)
+			return c.direction;
+		XMFLOAT3 average = Divide(s.sum, (float)s.count);
+		return Magnitude(average) > 0 ? Normalise(average) : c.direction;
+	}
+
+	static float						Scale(const SteeringContext& c) { return Weight::Get(c.hot->alignmentScale); }
+};
+
+// towards the average position of the nearby boids
+template<class Weight = TraitWeight>
+struct Cohesion : SteeringRule
+{
+	static const bool					boids = true;
+	static const bool					predators = false;
+
+	struct State
+	{
+		XMFLOAT3						sum;
+		int								count;
+	};
+
+	static void							Begin(State& s, SteeringContext&) { s.sum = XMFLOAT3(0, 0, 0); s.count = 0; }
+
+	static void							VisitBoid(State& s, SteeringContext&, const SteeringNeighbour& n)
+	{
+		s.sum = XMFLOAT3(n.position.x + s.sum.x, n.position.y + s.sum.y, n.position.z + s.sum.z);
+		s.count++;
+	}
+
+	static XMFLOAT3						Force(State& s, SteeringContext& c)
+	{
+		if (s.count == 0)
+			return c.direction;
+		XMFLOAT3 centre = Divide(s.sum, (float)s.count);
+		centre = XMFLOAT3(centre.x - c.position.x, centre.y - c.position.y, centre.z - c.position.z);
+		return Magnitude(centre) > 0 ? Normalise(centre) : c.direction;
+	}
+
+	static float						Scale(const SteeringContext& c) { return Weight::Get(c.hot->cohesionScale); }
+};
+
+// away from the predators the boid can see inside its flee distance, and caught by any inside its kill distance
+template<class Weight = TraitWeight>
+struct Flee : SteeringRule
+{
+	static const bool					boids = false;
+	static const bool					predators = true;
+
+	// predators in flee range wait to be tested against the field of view a batch at a time
+	struct State
+	{
+		XMFLOAT3						sum;
+		XMFLOAT3						waitingDiff[PERCEPTION_BATCH];
+		float							toX[PERCEPTION_BATCH];
+		float							toY[PERCEPTION_BATCH];
+		unsigned int					waiting;
+	};
+
+	static void							Begin(State& s, SteeringContext& c)
+	{
+		s.sum = XMFLOAT3(0, 0, 0);
+		s.waiting = 0;
+		if (c.hasPredators)
+			c.spotPredator = false;
+	}
+
+	static void							VisitPredator(State& s, SteeringContext& c, const SteeringPredator& p)
+	{
+		if (p.lSq > c.hot->killDistanceSq)
+		{
+			if (p.lSq < c.hot->fleeDistanceSq)
+			{
+				s.waitingDiff[s.waiting] = p.diff;
+				s.toX[s.waiting] = -p.diff.x;
+				s.toY[s.waiting] = -p.diff.y;
+				if (++s.waiting == PERCEPTION_BATCH)
+					Flush(s, c);
+			}
+		}
+		else if (c.boid->GetTraits().canDie)
+		{
+			c.alive = false;
+		}
+		else
+		{
+			s.sum = XMFLOAT3(s.sum.x + p.diff.x, s.sum.y + p.diff.y, s.sum.z + p.diff.z);
+		}
+	}
+
+	static XMFLOAT3						Force(State& s, SteeringContext& c)
+	{
+		if (!c.hasPredators)
+			return XMFLOAT3(0, 0, 0);
+		if (s.waiting > 0)
+			Flush(s, c);
+		return Magnitude(s.sum) > 0 ? s.sum : c.direction;
+	}
+
+	static float						Scale(const SteeringContext& c) { return Weight::Get(c.hot->fleeScale); }
+
+	static void							Flush(State& s, SteeringContext& c)
+	{
+		unsigned int inside = PerceptionCone::InsideBatch(c.direction.x, c.direction.y, c.hot->cosHalfFOV, s.toX, s.toY, s.waiting);
+		for (unsigned int i = 0; i < s.waiting; i++)
+		{
+			if (inside & (1u << i))
+			{
+				c.spotPredator = true;
+				s.sum = XMFLOAT3(s.sum.x + s.waitingDiff[i].x, s.sum.y + s.waitingDiff[i].y, s.sum.z + s.waitingDiff[i].z);
+			}
+		}
+		s.waiting = 0;
+	}
+};
+
+// the loops over the neighbours and predators and the move, the same whichever way the rules were put together
+// Rules is anything with Begin, VisitBoid, VisitPredator and Forces for one boid
+class RulePipeline
+{
+public:
+	template<class Rules>
+	static void							Run(Rules& rules, bool boids, bool predators, Boid& self, float t, vecBoid* boidList, SpatialGrid* grid, vector<Predator*>* predatorList, SpatialGrid* predatorGrid)
+	{
+		SteeringContext c;
+		c.boid = &self;
+		c.position = self.m_position;
+		c.direction = self.m_direction;
+		c.hot = &self.m_hot;
+		c.hasPredators = predatorList != nullptr && !predatorList->empty();
+		c.alive = self.isAlive;
+		c.spotPredator = self.spotPredator;
+		rules.Begin(c);
+
+		Boid* nearest = nullptr;
+		if (boids && boidList != nullptr)
+		{
+			const float nearbySq = NEARBY_DISTANCE * NEARBY_DISTANCE;
+			float nearestSq = FLT_MAX;
+			auto visit = [&](Boid* b, bool checkRange)
+			{
+				if (b == &self)
+					return;
+
+				SteeringNeighbour n;
+				n.boid = b;
+				n.position = self.NearestImage(*b->ReadPosition());
+				n.diff = XMFLOAT3(c.position.x - n.position.x, c.position.y - n.position.y, c.position.z - n.position.z);
+				n.lSq = (n.diff.x * n.diff.x) + (n.diff.y * n.diff.y) + (n.diff.z * n.diff.z);
+				if (checkRange && n.lSq >= nearbySq)
+					return;
+
+				rules.VisitBoid(c, n);
+				if (n.lSq < nearestSq)
+				{
+					nearestSq = n.lSq;
+					nearest = b;
+				}
+			};
+
+			if (grid != nullptr)
+			{
+				grid->ForEachInRadius(c.position, NEARBY_DISTANCE, [&](unsigned int i) { visit((*boidList)[i], false); });
+			}
+			else
+			{
+				for (Boid* b : *boidList)
+					visit(b, true);
+			}
+		}
+
+		if (predators && c.hasPredators)
+		{
+			auto check = [&](Predator* p)
+			{
+				SteeringPredator n;
+				n.predator = p;
+				XMFLOAT3 vP = self.NearestImage(*p->getPosition());
+				n.diff = XMFLOAT3(c.position.x - vP.x, c.position.y - vP.y, c.position.z - vP.z);
+				n.lSq = (n.diff.x * n.diff.x) + (n.diff.y * n.diff.y) + (n.diff.z * n.diff.z);
+				rules.VisitPredator(c, n);
+			};
+
+			if (predatorGrid != nullptr)
+			{
+				predatorGrid->ForEachInRadius(c.position, c.hot->predatorReach, [&](unsigned int i) { check((*predatorList)[i]); });
+			}
+			else
+			{
+				for (Predator* p : *predatorList)
+					check(p);
+			}
+		}
+
+		XMFLOAT3 forces = rules.Forces(c);
+		self.isAlive = c.alive;
+		self.spotPredator = c.spotPredator;
+		self.ApplyForces(t, forces, nearest, boidList, grid);
+	}
+
+	static constexpr bool				AnyOf(std::initializer_list<bool> flags)
+	{
+		for (bool flag : flags)
+		{
+			if (flag)
+				return true;
+		}
+		return false;
+	}
+};
+
+// the rules fixed when the program is built, every call inlines into the two loops
+template<class... Rules>
+class SteeringPipeline
+{
+public:
+	// step one boid, in place of Boid::Update
+	static void							Update(Boid& self, float t, vecBoid* boidList, SpatialGrid* grid, vector<Predator*>* predatorList, SpatialGrid* predatorGrid)
+	{
+		Fused fused;
+		RulePipeline::Run(fused, RulePipeline::AnyOf({ Rules::boids... }), RulePipeline::AnyOf({ Rules::predators... }), self, t, boidList, grid, predatorList, predatorGrid);
+	}
+
+private:
+	typedef std::index_sequence_for<Rules...>	Indices;
+
+	struct Fused
+	{
+		std::tuple<typename Rules::State...>	states;
+
+		void							Begin(SteeringContext& c) { Begin(c, Indices()); }
+		void							VisitBoid(SteeringContext& c, const SteeringNeighbour& n) { VisitBoid(c, n, Indices()); }
+		void							VisitPredator(SteeringContext& c, const SteeringPredator& p) { VisitPredator(c, p, Indices()); }
+		XMFLOAT3						Forces(SteeringContext& c) { return Forces(c, Indices()); }
+
+		// each expands to one call per rule, in the order the rules were listed
+		template<size_t... I>
+		void							Begin(SteeringContext& c, std::index_sequence<I...>)
+		{
+			int expand[] = { 0, (Rules::Begin(std::get<I>(states), c), 0)... };
+			(void)expand;
+		}
+
+		template<size_t... I>
+		void							VisitBoid(SteeringContext& c, const SteeringNeighbour& n, std::index_sequence<I...>)
+		{
+			int expand[] = { 0, (Rules::VisitBoid(std::get<I>(states), c, n), 0)... };
+			(void)expand;
+		}
+
+		template<size_t... I>
+		void							VisitPredator(SteeringContext& c, const SteeringPredator& p, std::index_sequence<I...>)
+		{
+			int expand[] = { 0, (Rules::VisitPredator(std::get<I>(states), c, p), 0)... };
+			(void)expand;
+		}
+
+		template<size_t... I>
+		XMFLOAT3						Forces(SteeringContext& c, std::index_sequence<I...>)
+		{
+			XMFLOAT3 forces = XMFLOAT3(0.0f, 0.0f, 0.0f);
+			int expand[] = { 0, (AddWeighted(forces, Rules::Force(std::get<I>(states), c), Rules::Scale(c)), 0)... };
+			(void)expand;
+			return forces;
+		}
+
+		static void						AddWeighted(XMFLOAT3& forces, const XMFLOAT3& force, float weight)
+		{
+			XMFLOAT3 weighted = XMFLOAT3(force.x * weight, force.y * weight, force.z * weight);
+			forces = XMFLOAT3(forces.x + weighted.x, forces.y + weighted.y, forces.z + weighted.z);
+		}
+	};
+};
+
+// the pipeline Boid::Update runs, usable wherever a Boid is
+typedef SteeringPipeline<Separation<>, Alignment<>, Cohesion<>, Flee<>>	FlockPipeline;
+
+// one rule of a RuntimeSteeringPipeline, with its weight
+class RuntimeSteeringRule
+{
+public:
+	virtual ~RuntimeSteeringRule() {}
+
+	virtual void						Begin(SteeringContext& c) = 0;
+	virtual void						VisitBoid(SteeringContext& c, const SteeringNeighbour& n) = 0;
+	virtual void						VisitPredator(SteeringContext& c, const SteeringPredator& p) = 0;
+	virtual XMFLOAT3					Force(SteeringContext& c) = 0;
+
+	float								weight = 1.0f;
+	bool								boids = false;
+	bool								predators = false;
+};
+
+// any of the rule types above behind the virtual calls
+template<class Rule>
+class RuntimeRule : public RuntimeSteeringRule
+{
+public:
+	void								Begin(SteeringContext& c) override { Rule::Begin(m_state, c); }
+	void								VisitBoid(SteeringContext& c, const SteeringNeighbour& n) override { Rule::VisitBoid(m_state, c, n); }
+	void								VisitPredator(SteeringContext& c, const SteeringPredator& p) override { Rule::VisitPredator(m_state, c, p); }
+	XMFLOAT3							Force(SteeringContext& c) override { return Rule::Force(m_state, c); }
+
+private:
+	typename Rule::State				m_state;
+};
+
+// the rules and their weights chosen while the program runs, each rule is a virtual call for every neighbour
+class RuntimeSteeringPipeline
+{
+public:
+	// rules are applied in the order they were added, the Rule's own Scale is ignored
+	template<class Rule>
+	void								Add(float weight)
+	{
+		RuntimeRule<Rule>* rule = new RuntimeRule<Rule>();
+		rule->weight = weight;
+		rule->boids = Rule::boids;
+		rule->predators = Rule::predators;
+		m_rules.push_back(unique_ptr<RuntimeSteeringRule>(rule));
+	}
+	void								Clear() { m_rules.clear(); }
+
+	// step one boid, in place of Boid::Update
+	void								Update(Boid& self, float t, vecBoid* boidList, SpatialGrid* grid, vector<Predator*>* predatorList, SpatialGrid* predatorGrid);
+
+	// what RulePipeline::Run calls
+	void								Begin(SteeringContext& c);
+	void								VisitBoid(SteeringContext& c, const SteeringNeighbour& n);
+	void								VisitPredator(SteeringContext& c, const SteeringPredator& p);
+	XMFLOAT3							Forces(SteeringContext& c);
+
+private:
+	vector<unique_ptr<RuntimeSteeringRule>>	m_rules;
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+
+using namespace std;
+
+/*
+ one writer hands a stream of Ts to one reader without either waiting on the other
+ the writer always has a buffer of its own to fill, the reader always has one of its own to read,
+ and the third is the newest finished one, Publish and Acquire swap with it in one atomic exchange
+ the writer never waits for the reader, so a reader that falls behind just skips to the newest,
+ and a reader that gets ahead keeps the one it has
+*/
+
+template<class T>
+class TripleBuffer
+{
+public:
+	TripleBuffer() {}
+	TripleBuffer(const TripleBuffer&) = delete;
+	TripleBuffer&						operator=(const TripleBuffer&) = delete;
+
+	// writer: fill this, then Publish it
+	T&									GetWriteBuffer() { return m_buffers[m_write]; }
+	// writer: the buffer just filled becomes the newest, and the writer gets back whichever one that replaces
+	void								Publish() { m_write = m_ready.exchange(m_write | FRESH, memory_order_acq_rel) & INDEX; }
+
+	// reader: take the newest buffer if one was published since last time, false (keeping the old one) if not
+	bool								Acquire()
+	{
+		if ((m_ready.load(memory_order_acquire) & FRESH) == 0)
+			return false;
+		m_read = m_ready.exchange(m_read, memory_order_acq_rel) & INDEX;
+		return true;
+	}
+	// reader: what Acquire last took
+	const T&							GetReadBuffer() const { return m_buffers[m_read]; }
+
+private:
+	enum { INDEX = 3, FRESH = 4 };
+
+	T									m_buffers[3];
+	unsigned int						m_write = 0;	// only the writer touches this
+	unsigned int						m_read = 1;		// only the reader touches this
+	atomic<unsigned int>				m_ready{ 2 };	// the newest, with FRESH set until the reader takes it
+};
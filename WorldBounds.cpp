@@ -0,0 +1,70 @@
+#include "WorldBounds.h"
+
+#include <algorithm>
+
+WorldBounds::WorldBounds()
+{
+	Set(XMFLOAT2(-1, -1), XMFLOAT2(1, 1));
+}
+
+WorldBounds::~WorldBounds()
+{
+}
+
+void WorldBounds::FromCamera(const XMMATRIX& view, const XMMATRIX& proj)
+{
+	XMMATRIX inverse = XMMatrixInverse(nullptr, XMMatrixMultiply(view, proj));
+
+	// follow the ray through two opposite screen corners from the near plane to the far plane and see where it crosses z = 0
+	XMFLOAT2 corners[2];
+	for (int i = 0; i < 2; i++)
+	{
+		float ndc = i == 0 ? -1.0f : 1.0f;
+		XMFLOAT3 nearPoint;
+		XMFLOAT3 farPoint;
+		XMStoreFloat3(&nearPoint, XMVector3TransformCoord(XMVectorSet(ndc, ndc, 0.0f, 1.0f), inverse));
+		XMStoreFloat3(&farPoint, XMVector3TransformCoord(XMVectorSet(ndc, ndc, 1.0f, 1.0f), inverse));
+
+		float s = nearPoint.z / (nearPoint.z - farPoint.z);
+		corners[i].x = nearPoint.x + (farPoint.x - nearPoint.x) * s;
+		corners[i].y = nearPoint.y + (farPoint.y - nearPoint.y) * s;
+	}
+
+	Set(XMFLOAT2(min(corners[0].x, corners[1].x), min(corners[0].y, corners[1].y)),
+		XMFLOAT2(max(corners[0].x, corners[1].x), max(corners[0].y, corners[1].y)));
+}
+
+void WorldBounds::Set(const XMFLOAT2& lower, const XMFLOAT2& upper)
+{
+	m_lower = lower;
+	m_upper = upper;
+	m_size = XMFLOAT2(upper.x - lower.x, upper.y - lower.y);
+	m_invSize = XMFLOAT2(1.0f / m_size.x, 1.0f / m_size.y);
+}
+
+unsigned int WorldBounds::Images(const XMFLOAT3& position, float radius, XMFLOAT2* offsets) const
+{
+	// a search near the left edge also has to look just past the right edge, which is the same as
+	// searching again from a position one width to the right
+	float x = 0.0f;
+	if (position.x - radius < m_lower.x)
+		x = m_size.x;
+	else if (position.x + radius > m_upper.x)
+		x = -m_size.x;
+
+	float y = 0.0f;
+	if (position.y - radius < m_lower.y)
+		y = m_size.y;
+	else if (position.y + radius > m_upper.y)
+		y = -m_size.y;
+
+	unsigned int count = 0;
+	offsets[count++] = XMFLOAT2(0, 0);
+	if (x != 0.0f)
+		offsets[count++] = XMFLOAT2(x, 0);
+	if (y != 0.0f)
+		offsets[count++] = XMFLOAT2(0, y);
+	if (x != 0.0f && y != 0.0f)
+		offsets[count++] = XMFLOAT2(x, y);
+	return count;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <vector>
+#include <cmath>
+#include <DirectXMath.h>
+
+using namespace std;
+using namespace DirectX;
+
+/*
+ the part of the z = 0 plane the camera can see, treated as a torus
+ worked out once from the view and projection matrices, after that keeping things on
+ screen is a floor per axis instead of pushing every position through the camera
+ anything that compares two positions uses Delta so boids near one edge see the boids
+ just over the other edge
+*/
+
+class WorldBounds
+{
+public:
+	WorldBounds();
+	~WorldBounds();
+
+	// the corners of the screen projected back onto z = 0, the camera must be looking at that plane
+	void								FromCamera(const XMMATRIX& view, const XMMATRIX& proj);
+	void								Set(const XMFLOAT2& lower, const XMFLOAT2& upper);
+
+	// move a position back inside the bounds, returns true if it moved
+	bool								Wrap(XMFLOAT3& position) const
+	{
+		float x = position.x - m_size.x * floorf((position.x - m_lower.x) * m_invSize.x);
+		float y = position.y - m_size.y * floorf((position.y - m_lower.y) * m_invSize.y);
+		bool moved = (x != position.x) || (y != position.y);
+		position.x = x;
+		position.y = y;
+		return moved;
+	}
+
+	// wrap every object in a list (boids or predators)
+	template<class T>
+	void								Wrap(const vector<T*>& objects) const
+	{
+		for (T* o : objects)
+		{
+			Wrap(*o->getPosition());
+		}
+	}
+
+	// wrap separate x and y arrays (see BoidPopulation), no branches so the loop vectorises
+	void								Wrap(float* x, float* y, unsigned int count) const
+	{
+		for (unsigned int i = 0; i < count; i++)
+		{
+			x[i] -= m_size.x * floorf((x[i] - m_lower.x) * m_invSize.x);
+			y[i] -= m_size.y * floorf((y[i] - m_lower.y) * m_invSize.y);
+		}
+	}
+
+	// a - b the short way round
+	XMFLOAT3							Delta(const XMFLOAT3& a, const XMFLOAT3& b) const
+	{
+		float dx = a.x - b.x;
+		float dy = a.y - b.y;
+		dx -= m_size.x * floorf(dx * m_invSize.x + 0.5f);
+		dy -= m_size.y * floorf(dy * m_invSize.y + 0.5f);
+		return XMFLOAT3(dx, dy, a.z - b.z);
+	}
+
+	// the copy of position that is closest to reference
+	XMFLOAT3							NearestImage(const XMFLOAT3& position, const XMFLOAT3& reference) const
+	{
+		XMFLOAT3 d = Delta(position, reference);
+		return XMFLOAT3(reference.x + d.x, reference.y + d.y, position.z);
+	}
+
+	// offsets to add to position so that searches of radius around each one cover everything
+	// within radius on the torus, the first is always (0, 0), returns how many (up to 4)
+	unsigned int						Images(const XMFLOAT3& position, float radius, XMFLOAT2* offsets) const;
+
+	const XMFLOAT2&						GetLower() const { return m_lower; }
+	const XMFLOAT2&						GetUpper() const { return m_upper; }
+	const XMFLOAT2&						GetSize() const { return m_size; }
+
+protected:
+	XMFLOAT2							m_lower;
+	XMFLOAT2							m_upper;
+	XMFLOAT2							m_size;
+	XMFLOAT2							m_invSize;
+};
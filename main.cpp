@@ -12,17 +12,33 @@
 //
 // Copyright (c) Microsoft Corporation. All rights reserved.
 //--------------------------------------------------------------------------------------
-#define _XM_NO_INTRINSICS_
-
 #include "main.h"
 
 #include <algorithm>
 #include <vector>
 #include <time.h>
 #include <string>
+#include <assert.h>
 #include "Boid.h"
 #include "Predator.h"
 #include "Debug.h"
+#include "SpatialGrid.h"
+#include "QuadTree.h"
+#include "CellAggregates.h"
+#include "WorldBounds.h"
+#include "NeighbourList.h"
+#include "MortonOrder.h"
+#include "BoidPopulation.h"
+#include "QuantisedPopulation.h"
+#include "SteeringPipeline.h"
+#include "LargePages.h"
+#include "EntityPool.h"
+#include "FrameArena.h"
+#include "AllocationCounter.h"
+#include "JobSystem.h"
+#include "SimulationThread.h"
+#include "Benchmark.h"
+#include "CpuFeatures.h"
 
 
 //--------------------------------------------------------------------------------------
@@ -40,6 +56,17 @@ HRESULT		InitWorld(int width, int height);
 void		CleanupDevice();
 LRESULT CALLBACK    WndProc(HWND, UINT, WPARAM, LPARAM);
 void		Render();
+void		StepSimulation(float t, SimulationSnapshot* snapshot);
+void		DrawSnapshot();
+void		DrawBoid(unsigned int i);
+void		DrawPredator(unsigned int i);
+void		UpdateBoid(Boid* b, float t);
+void		UpdateBoids(float t, bool draw);
+void		RemoveDeadBoids();
+void		CheckFrameAllocations();
+void		UpdatePopulation(float t);
+void		UpdateQuantisedPopulation(float t);
+void		ReadSimdOverride(LPCWSTR cmdLine);
 void		OutputValue(float f, string name);
 
 
@@ -75,21 +102,65 @@ XMMATRIX                g_Projection;
 int						g_viewWidth;
 int						g_viewHeight;
 
+#define POPULATION_DIMENSIONS	2 // the population flocks in 2d, or 3 through a slab FLOCK_DEPTH deep, fixed when compiled
+
+WorldBounds				g_WorldBounds; // what the camera can see, everything wraps around its edges
+
 vecBoid					g_Boids;
 vector<Predator*>       g_Predators;
+SpatialGrid				g_BoidGrid(NEARBY_DISTANCE); // rebuilt every frame, used for all boid neighbour searches
+SpatialGrid				g_PredatorGrid(FLEE_DISTANCE_MAX); // so boids only check the predators they could see
+QuadTree				g_BoidTree(BARNES_HUT_THETA_DEFAULT); // rebuilt every frame when predators use barnes-hut
+NeighbourList			g_NeighbourList(NEARBY_DISTANCE); // per boid lists that are kept across frames
+CellAggregates			g_CellAggregates; // per cell sums for approximate alignment and cohesion
+BoidPopulationT<POPULATION_DIMENSIONS> g_Population; // the flock as arrays instead of Boid objects, when useBoidPopulation is on
+DrawableGameObject		g_PopulationMesh; // the cube, texture and material every boid in g_Population is drawn with
+QuantisedPopulation		g_QuantisedPopulation; // g_Population packed into 16 bytes a boid, when useQuantisedPopulation is on
+EntityPool<Boid>		g_BoidPool; // every Boid and Predator made once up front, when useEntityPool is on
+EntityPool<Predator>	g_PredatorPool;
+JobSystem				g_JobSystem; // the boid and predator updates are split across its threads when useJobSystem is on
+SimulationThread		g_Simulation; // steps the boids and predators while Render draws its snapshots, when useSimulationThread is on
 
 const int               boidCount = 300;
 const int               predatorCount = 1;
+const bool              useNeighbourLists = true; // reuse each boid's neighbours until they could have moved out of the skin
+const bool              useMortonOrder = true; // periodically sort g_Boids along a z-order curve so neighbours are updated together
+const unsigned int      topologicalNeighbours = 0; // flock with the k nearest boids instead of all in range, TOPOLOGICAL_NEIGHBOURS is starling-like
+const bool              useBarnesHut = false; // approximate the predators' pull from far away boids, worth it with many boids and predators
+const bool              useCellAggregates = false; // approximate alignment and cohesion from per cell sums, for very large flocks
+const bool              useFlockmateFOV = false; // boids only flock with the boids they can see, not just the ones in range
+const bool              useBoidPopulation = false; // run the flock from arrays of positions and directions, only the exact rules in range (no neighbour lists, topological, aggregates or flockmate FOV)
+const bool              useSteeringKernel = true; // with useBoidPopulation, steer a batch of boids at a time with SIMD, using the widest instruction set the cpu has
+const bool              useQuantisedPopulation = false; // with useBoidPopulation, keep the flock in fixed point relative to its cell instead of floats, for millions of boids where memory bandwidth is the limit (2d only)
+const bool              useRulePipeline = false; // step each Boid with FlockPipeline, the rules composed at compile time, only the exact rules in range (no neighbour lists, topological, aggregates or flockmate FOV)
+const bool              useLargePages = true; // put the population arrays in large pages (needs the lock pages in memory privilege, normal pages without it)
+const bool              useEntityPool = true; // boids and predators come from fixed slots whose meshes are made once, dying and spawning never allocate
+const bool              useDoubleBuffering = true; // every boid reads the others as they were at the start of the frame, so the order they update in doesn't matter (not with cell aggregates)
+const bool              useJobSystem = true; // update the boids and predators on every core, needs useDoubleBuffering (without it, or with cell aggregates, they update on this thread), the population only with useSteeringKernel
+const unsigned int      jobThreads = 0; // 0 for one per core
+const bool              useSimulationThread = true; // step the boid objects on their own thread at simulationHz and draw at the display rate between the last two positions (not with useBoidPopulation)
+const float             simulationHz = SIMULATION_HZ_DEFAULT;
 
 
 void placeFish()
 {
 	HRESULT hr;
 
-	Boid* fish = new Boid();
-	hr = fish->initMesh(g_pd3dDevice, g_pImmediateContext);
-	if (FAILED(hr))
-		return;
+	Boid* fish = nullptr;
+	if (useEntityPool)
+	{
+		// the slot's mesh was made with the pool
+		fish = g_BoidPool.Spawn();
+		if (fish == nullptr)
+			return;
+	}
+	else
+	{
+		fish = new Boid();
+		hr = fish->initMesh(g_pd3dDevice, g_pImmediateContext);
+		if (FAILED(hr))
+			return;
+	}
 	fish->setPosition(XMFLOAT3(0, 0, 0));
 	g_Boids.push_back(fish);
 }
@@ -98,10 +169,20 @@ void placePredator()
 {
     HRESULT hr;
 
-    Predator* pred = new Predator();
-    hr = pred->initMesh(g_pd3dDevice, g_pImmediateContext);
-    if (FAILED(hr))
-        return;
+    Predator* pred = nullptr;
+    if (useEntityPool)
+    {
+        pred = g_PredatorPool.Spawn();
+        if (pred == nullptr)
+            return;
+    }
+    else
+    {
+        pred = new Predator();
+        hr = pred->initMesh(g_pd3dDevice, g_pImmediateContext);
+        if (FAILED(hr))
+            return;
+    }
     float randomFlt = (((float)rand()) / (float)RAND_MAX) * (500 - -500);
     pred->setPosition(XMFLOAT3(randomFlt, randomFlt, 0));
     g_Predators.push_back(pred);
@@ -114,17 +195,42 @@ void placePredator()
 int WINAPI wWinMain( _In_ HINSTANCE hInstance, _In_opt_ HINSTANCE hPrevInstance, _In_ LPWSTR lpCmdLine, _In_ int nCmdShow )
 {
     UNREFERENCED_PARAMETER( hPrevInstance );
-    UNREFERENCED_PARAMETER( lpCmdLine );
+
+    ReadSimdOverride( lpCmdLine );
+
+    // before any of the big arrays are allocated
+    LargePages::SetEnabled( useLargePages );
+    if( useLargePages && !LargePages::Enable() )
+        Debug::Print( "large pages not available, the population arrays use normal pages" );
+
+    // run the headless benchmarks instead of the simulation
+    if( wcsstr( lpCmdLine, L"-benchmark" ) != nullptr )
+    {
+        Benchmark::Run();
+        return 0;
+    }
 
     if( FAILED( InitWindow( hInstance, nCmdShow ) ) )
         return 0;
 
+    if( useJobSystem )
+    {
+        g_JobSystem.Start( jobThreads );
+        MortonOrder::SetJobSystem( &g_JobSystem );
+        g_Population.SetJobSystem( &g_JobSystem );
+        g_QuantisedPopulation.SetJobSystem( &g_JobSystem );
+    }
+
     if( FAILED( InitDevice() ) )
     {
         CleanupDevice();
         return 0;
     }
 
+    // from here on only the simulation thread touches the boids and predators
+    if( useSimulationThread && !useBoidPopulation )
+        g_Simulation.Start( simulationHz, []( float t, SimulationSnapshot& snapshot ) { StepSimulation( t, &snapshot ); }, CheckFrameAllocations );
+
     // Main message loop
     MSG msg = {0};
     while( WM_QUIT != msg.message )
@@ -517,9 +623,51 @@ HRESULT		InitMesh()
 		return hr;
 
 
-    for (int i = 0; i < boidCount; i++)
+    Boid::SetTopologicalNeighbours(topologicalNeighbours);
+    Boid::SetCellAggregates(useCellAggregates ? &g_CellAggregates : nullptr);
+    Boid::SetFlockmateFOV(useFlockmateFOV);
+    Boid::SetDoubleBuffered(useDoubleBuffering && !useCellAggregates);
+    if (useEntityPool)
+    {
+        // the meshes for every boid and predator there will ever be at once
+        g_BoidPool.Create(useBoidPopulation ? 0 : boidCount);
+        g_PredatorPool.Create(predatorCount);
+        hr = g_BoidPool.InitMeshes(g_pd3dDevice, g_pImmediateContext);
+        if (FAILED(hr))
+            return hr;
+        hr = g_PredatorPool.InitMeshes(g_pd3dDevice, g_pImmediateContext);
+        if (FAILED(hr))
+            return hr;
+    }
+
+    // the simulation thread's snapshots are drawn with one mesh too
+    if (useBoidPopulation || useSimulationThread)
     {
-        placeFish();
+        hr = g_PopulationMesh.initMesh(g_pd3dDevice, g_pImmediateContext);
+        if (FAILED(hr))
+            return hr;
+    }
+
+    if (useBoidPopulation)
+    {
+
+        // the same square as the boid objects below, spread through the slab in 3d
+        XMFLOAT3 previousPos = XMFLOAT3(0, 0, 0);
+        for (int i = 0; i < boidCount; i++)
+        {
+            XMFLOAT3 pos = previousPos.x < 200.0f ? XMFLOAT3(previousPos.x + 10.0f, previousPos.y, 0) : XMFLOAT3(0, previousPos.y + 10.0f, 0);
+            previousPos = pos;
+            if (POPULATION_DIMENSIONS == 3)
+                pos.z = (((float)rand() / (float)RAND_MAX) - 0.5f) * FLOCK_DEPTH;
+            g_Population.Add(pos);
+        }
+    }
+    else
+    {
+        for (int i = 0; i < boidCount; i++)
+        {
+            placeFish();
+        }
     }
 
     for (int i = 0; i < predatorCount; i++)
@@ -563,6 +711,23 @@ HRESULT		InitWorld(int width, int height)
 	// Initialize the projection matrix
 	g_Projection = XMMatrixPerspectiveFovLH(XM_PIDIV2, width / (FLOAT)height, 0.01f, 1000.0f);
 
+	// the camera never moves, so the edges of the screen only need working out once
+	g_WorldBounds.FromCamera(g_View, g_Projection);
+	Boid::SetWorldBounds(&g_WorldBounds);
+	Predator::SetWorldBounds(&g_WorldBounds);
+	g_BoidGrid.SetWorldBounds(&g_WorldBounds);
+	g_PredatorGrid.SetWorldBounds(&g_WorldBounds);
+	g_CellAggregates.SetWorldBounds(&g_WorldBounds);
+	g_Population.SetWorldBounds(&g_WorldBounds);
+
+	// the quantised flock's cells have to tile what the camera can see
+	if (useBoidPopulation && useQuantisedPopulation)
+	{
+		if (!g_QuantisedPopulation.SetWorldBounds(&g_WorldBounds))
+			return E_FAIL;
+		g_QuantisedPopulation.CopyFrom(g_Population);
+	}
+
 
 	return S_OK;
 }
@@ -573,17 +738,23 @@ HRESULT		InitWorld(int width, int height)
 //--------------------------------------------------------------------------------------
 void CleanupDevice()
 {
-	for (unsigned int i = 0; i < g_Boids.size(); i++)
-	{
-		delete g_Boids[i];
-	}
-	g_Boids.clear();
+    g_Simulation.Stop();
 
-    for (unsigned int i = 0; i < g_Predators.size(); i++)
+    // predators first, each one lets go of the boid it has claimed
+    for (unsigned int i = 0; i < g_Predators.size() && !useEntityPool; i++)
     {
         delete g_Predators[i];
     }
     g_Predators.clear();
+    g_PredatorPool.Clear();
+
+	for (unsigned int i = 0; i < g_Boids.size() && !useEntityPool; i++)
+	{
+		delete g_Boids[i];
+	}
+	g_Boids.clear();
+	g_BoidPool.Clear();
+    g_JobSystem.Stop();
 
     // Remove any bound render target or depth/stencil buffer
     ID3D11RenderTargetView* nullViews[] = { nullptr };
@@ -708,6 +879,23 @@ void setupTransformConstantBuffer(const unsigned int index)
 	cb1.vOutputColor = XMFLOAT4(0, 0, 0, 0);
 	g_pImmediateContext->UpdateSubresource(g_pConstantBuffer, 0, nullptr, &cb1, 0, 0);
 }
+void setupMaterialConstantBufferPopulation()
+{
+	MaterialPropertiesConstantBuffer mcb = g_PopulationMesh.getMaterial();
+	g_pImmediateContext->UpdateSubresource(g_pMaterialConstantBuffer, 0, nullptr, &mcb, 0, 0);
+}
+
+void setupTransformConstantBufferPopulation(const XMFLOAT3& position, float t, float scale = 1.0f)
+{
+	// the population keeps no world matrices, this one is made the same way DrawableGameObject::update would
+	ConstantBuffer cb1;
+	cb1.mWorld = XMMatrixTranspose(XMMatrixScaling(scale, scale, scale) * XMMatrixRotationZ(-t) * XMMatrixTranslation(position.x, position.y, position.z));
+	cb1.mView = XMMatrixTranspose(g_View);
+	cb1.mProjection = XMMatrixTranspose(g_Projection);
+	cb1.vOutputColor = XMFLOAT4(0, 0, 0, 0);
+	g_pImmediateContext->UpdateSubresource(g_pConstantBuffer, 0, nullptr, &cb1, 0, 0);
+}
+
 void setupTransformConstantBufferPredator(const unsigned int index)
 {
     ConstantBuffer cb1;
@@ -736,11 +924,12 @@ void Render()
 	static float cumulativeTime = 0;
 
 	// cap the framerate at 60 fps 
+	// (not with the simulation thread, it keeps its own rate and drawing is held to the display's by Present)
 	cumulativeTime += t;
 	if (cumulativeTime >= FPS60) {
 		cumulativeTime = cumulativeTime - FPS60;
 	}
-	else {
+	else if (!g_Simulation.GetRunning()) {
 		return;
 	}
     
@@ -750,77 +939,434 @@ void Render()
     // Clear the depth buffer to 1.0 (max depth)
     g_pImmediateContext->ClearDepthStencilView( g_pDepthStencilView, D3D11_CLEAR_DEPTH, 1.0f, 0 );
 
-	for(unsigned int i=0; i< g_Boids.size(); i++)
-	{ 
-		g_Boids[i]->Update(t, &g_Boids, g_Predators);
-        
-        if(g_Boids[i]->GetAlive())
+    if (g_Simulation.GetRunning())
+    {
+        DrawSnapshot();
+
+        // the display sets the pace now, the simulation keeps its own
+        g_pSwapChain->Present( 1, 0 );
+        FrameArena::Frame().Reset();
+
+        // the two rates are independent, so both are worth seeing
+        static double rateStart = SimulationThread::Now();
+        static unsigned long long rateSteps = 0;
+        static unsigned int rateFrames = 0;
+        rateFrames++;
+        double now = SimulationThread::Now();
+        if (now - rateStart >= 1.0)
         {
-            XMMATRIX vp = g_View * g_Projection;
-            Boid* dob = (Boid*)g_Boids[i];
+            unsigned long long steps = g_Simulation.GetSteps();
+            char sz[1024] = { 0 };
+            sprintf_s(sz, "simulation %.1f Hz, render %.1f Hz", (steps - rateSteps) / (now - rateStart), rateFrames / (now - rateStart));
+            Debug::Print(sz); // the allocation check is counting on the simulation thread, so no string
+            rateStart = now;
+            rateSteps = steps;
+            rateFrames = 0;
+        }
+        return;
+    }
 
-            dob->CheckIsOnScreenAndFix(g_View, g_Projection);
+    StepSimulation(t, nullptr);
 
-            setupTransformConstantBuffer(i);
-            setupLightingConstantBuffer();
-            setupMaterialConstantBuffer(i);
+    // Present our back buffer to our front buffer
+    g_pSwapChain->Present( 0, 0 );
 
-            // Render a cube
-            g_pImmediateContext->VSSetShader(g_pVertexShader, nullptr, 0);
-            g_pImmediateContext->VSSetConstantBuffers(0, 1, &g_pConstantBuffer);
+    // everything the frame borrowed from the arena goes back at once
+    FrameArena::Frame().Reset();
 
-            g_pImmediateContext->PSSetShader(g_pPixelShader, nullptr, 0);
-            g_pImmediateContext->PSSetConstantBuffers(1, 1, &g_pMaterialConstantBuffer);
-            g_pImmediateContext->PSSetConstantBuffers(2, 1, &g_pLightConstantBuffer);
+    CheckFrameAllocations();
+}
 
-            g_pImmediateContext->PSSetShaderResources(0, 1, g_Boids[i]->getTextureResourceView());
-            g_pImmediateContext->PSSetSamplers(0, 1, g_Boids[i]->getTextureSamplerState());
 
-            // draw 
-            g_Boids[i]->draw(g_pImmediateContext);
-        }
+//--------------------------------------------------------------------------------------
+// Once the arena, grids and neighbour caches have grown to fit, a step shouldn't touch the heap
+// called after each step's arena reset, by Render or by the simulation thread, whichever steps
+//--------------------------------------------------------------------------------------
+void CheckFrameAllocations()
+{
+#ifdef ALLOCATION_COUNTER
+    // the count covers every thread, so the render thread mustn't allocate while the simulation thread checks
+    // a boid dying rebuilds the lists and prints the count, so the warmup starts again whenever the count changes
+    static unsigned int allocationFrames = 0;
+    static size_t lastBoidCount = 0;
+    size_t liveCount = !useBoidPopulation ? g_Boids.size() : useQuantisedPopulation ? g_QuantisedPopulation.GetCount() : g_Population.GetCount();
+    unsigned long long allocations = AllocationCounter::EndFrame();
+    if (liveCount != lastBoidCount)
+        allocationFrames = 0;
+    else if (++allocationFrames > ZERO_ALLOCATION_WARMUP)
+        assert(allocations == 0);
+    lastBoidCount = liveCount;
+#endif
+}
+
+//--------------------------------------------------------------------------------------
+// Step the boids and predators by t, drawing them as they go or, given a snapshot,
+// filling it in for the render thread instead (no d3d calls, it runs on the simulation thread)
+//--------------------------------------------------------------------------------------
+void StepSimulation(float t, SimulationSnapshot* snapshot)
+{
+    // predators that went off screen last frame come back on the other side, the boids are wrapped in their own update
+    g_WorldBounds.Wrap(g_Predators);
+    if (snapshot != nullptr)
+    {
+        snapshot->predators.resize(g_Predators.size());
+        for (unsigned int i = 0; i < g_Predators.size(); i++)
+            snapshot->predators[i].previous = *g_Predators[i]->getPosition();
+    }
+    g_PredatorGrid.Build(g_Predators); // predators move after the boids, so this stays right for the whole boid update
+
+    if (useBoidPopulation)
+        UpdatePopulation(t);
+    else
+        UpdateBoids(t, snapshot == nullptr);
+
+    if (useBarnesHut)
+        g_BoidTree.Build(g_BoidGrid.GetSortedPositions());
+
+    // predators only read the boids and write themselves
+    g_JobSystem.ParallelFor((unsigned int)g_Predators.size(), [&](unsigned int begin, unsigned int end)
+    {
+        for (unsigned int i = begin; i < end; i++)
+            g_Predators[i]->Update(t, useBoidPopulation ? nullptr : &g_Boids, &g_BoidGrid, useBarnesHut ? &g_BoidTree : nullptr);
+    });
+
+    // boids caught this frame stay in the list, dead, until everything that reads them has run
+    if (!useBoidPopulation)
+        RemoveDeadBoids();
+
+    if (snapshot == nullptr)
+    {
+        for (unsigned int i = 0; i < g_Predators.size(); i++)
+            DrawPredator(i);
+        return;
+    }
+
+    // where everything went, for the render thread
+    for (unsigned int i = 0; i < g_Predators.size(); i++)
+        snapshot->predators[i].position = *g_Predators[i]->getPosition();
+    snapshot->boids.resize(g_Boids.size());
+    for (unsigned int i = 0; i < g_Boids.size(); i++)
+    {
+        // the read state is where the boid started the step (where it is, without double buffering)
+        snapshot->boids[i].previous = *g_Boids[i]->ReadPosition();
+        snapshot->boids[i].position = *g_Boids[i]->getPosition();
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Draw the simulation thread's newest snapshot, part way through its step
+//--------------------------------------------------------------------------------------
+void DrawSnapshot()
+{
+    g_Simulation.Acquire();
+    const SimulationSnapshot& snapshot = g_Simulation.GetSnapshot();
+    float alpha = snapshot.GetAlpha(SimulationThread::Now());
+
+    // every boid is the same cube, drawn like the population's
+    setupLightingConstantBuffer();
+    setupMaterialConstantBufferPopulation();
+    g_pImmediateContext->VSSetShader(g_pVertexShader, nullptr, 0);
+    g_pImmediateContext->VSSetConstantBuffers(0, 1, &g_pConstantBuffer);
+
+    g_pImmediateContext->PSSetShader(g_pPixelShader, nullptr, 0);
+    g_pImmediateContext->PSSetConstantBuffers(1, 1, &g_pMaterialConstantBuffer);
+    g_pImmediateContext->PSSetConstantBuffers(2, 1, &g_pLightConstantBuffer);
+
+    g_pImmediateContext->PSSetShaderResources(0, 1, g_PopulationMesh.getTextureResourceView());
+    g_pImmediateContext->PSSetSamplers(0, 1, g_PopulationMesh.getTextureSamplerState());
+
+    for (const SnapshotObject& b : snapshot.boids)
+    {
+        setupTransformConstantBufferPopulation(SimulationSnapshot::Interpolate(b, alpha), snapshot.stepLength);
+        g_PopulationMesh.draw(g_pImmediateContext);
+    }
+
+    // g_Predators is never added to or reordered once the simulation starts, and their meshes don't change
+    for (unsigned int i = 0; i < snapshot.predators.size(); i++)
+    {
+        setupTransformConstantBufferPopulation(SimulationSnapshot::Interpolate(snapshot.predators[i], alpha), snapshot.stepLength, *g_Predators[i]->getScale());
+        setupMaterialConstantBufferPredator(i);
+
+        g_pImmediateContext->PSSetShaderResources(0, 1, g_Predators[i]->getTextureResourceView());
+        g_pImmediateContext->PSSetSamplers(0, 1, g_Predators[i]->getTextureSamplerState());
+        g_Predators[i]->draw(g_pImmediateContext);
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Draw one boid or predator object where it is
+//--------------------------------------------------------------------------------------
+void DrawBoid(unsigned int i)
+{
+    setupTransformConstantBuffer(i);
+    setupLightingConstantBuffer();
+    setupMaterialConstantBuffer(i);
+
+    // Render a cube
+    g_pImmediateContext->VSSetShader(g_pVertexShader, nullptr, 0);
+    g_pImmediateContext->VSSetConstantBuffers(0, 1, &g_pConstantBuffer);
+
+    g_pImmediateContext->PSSetShader(g_pPixelShader, nullptr, 0);
+    g_pImmediateContext->PSSetConstantBuffers(1, 1, &g_pMaterialConstantBuffer);
+    g_pImmediateContext->PSSetConstantBuffers(2, 1, &g_pLightConstantBuffer);
+
+    g_pImmediateContext->PSSetShaderResources(0, 1, g_Boids[i]->getTextureResourceView());
+    g_pImmediateContext->PSSetSamplers(0, 1, g_Boids[i]->getTextureSamplerState());
+
+    // draw 
+    g_Boids[i]->draw(g_pImmediateContext);
+}
+
+void DrawPredator(unsigned int i)
+{
+    setupTransformConstantBufferPredator(i);
+    setupLightingConstantBuffer();
+    setupMaterialConstantBufferPredator(i);
+
+    // Render a cube
+    g_pImmediateContext->VSSetShader(g_pVertexShader, nullptr, 0);
+    g_pImmediateContext->VSSetConstantBuffers(0, 1, &g_pConstantBuffer);
+
+    g_pImmediateContext->PSSetShader(g_pPixelShader, nullptr, 0);
+    g_pImmediateContext->PSSetConstantBuffers(1, 1, &g_pMaterialConstantBuffer);
+    g_pImmediateContext->PSSetConstantBuffers(2, 1, &g_pLightConstantBuffer);
+
+    g_pImmediateContext->PSSetShaderResources(0, 1, g_Predators[i]->getTextureResourceView());
+    g_pImmediateContext->PSSetSamplers(0, 1, g_Predators[i]->getTextureSamplerState());
+
+    // draw 
+    g_Predators[i]->draw(g_pImmediateContext);
+}
+
+
+//--------------------------------------------------------------------------------------
+// Step one boid with whichever rules are in use
+//--------------------------------------------------------------------------------------
+void UpdateBoid(Boid* b, float t)
+{
+    if (useRulePipeline)
+        FlockPipeline::Update(*b, t, &g_Boids, &g_BoidGrid, &g_Predators, &g_PredatorGrid);
+    else
+        b->Update(t, &g_Boids, &g_BoidGrid, &g_Predators, &g_PredatorGrid);
+}
+
+//--------------------------------------------------------------------------------------
+// Update and draw the boid objects, draw is false on the simulation thread
+//--------------------------------------------------------------------------------------
+void UpdateBoids(float t, bool draw)
+{
+    // anything that went off screen last frame comes back on the other side
+    for (Boid* b : g_Boids)
+    {
+        if (g_WorldBounds.Wrap(*b->getPosition()) && useCellAggregates)
+            g_CellAggregates.Move(b);
+    }
+
+    // what the boids wrote last frame is what they read this frame
+    if (useDoubleBuffering)
+        Boid::SwapStates(g_Boids);
+
+    // keep boids that are close in the world close in the list
+    static unsigned int frameCount = 0;
+    if (useMortonOrder && frameCount % MORTON_SORT_INTERVAL == 0)
+    {
+        MortonOrder::SortBoids(g_Boids, useEntityPool ? &g_BoidPool : nullptr);
+        g_NeighbourList.Invalidate(); // the lists remember positions by list index
+    }
+
+    // the sums are kept up to date as boids move, a full rebuild now and then clears the rounding errors
+    if (useCellAggregates && frameCount % AGGREGATE_REBUILD_INTERVAL == 0)
+    {
+        g_CellAggregates.Build(g_Boids);
+    }
+    frameCount++;
+
+    // sort the boids into the grid once, every neighbour search this frame uses it
+    g_BoidGrid.Build(g_Boids);
+    if (topologicalNeighbours > 0)
+    {
+        // size the cells to hold about k boids each, so the k nearest are found in the first couple of rings however dense the flock gets
+        // the new size is used from next frame's build, this frame's searches keep the cells they were built with
+        g_BoidGrid.FitCellSize((float)topologicalNeighbours, 1.0f, NEARBY_DISTANCE * 4.0f);
+    }
+    else if (useNeighbourLists && !useCellAggregates && !useRulePipeline)
+    {
+        g_NeighbourList.Update(t, &g_Boids, &g_BoidGrid);
+    }
+
+    // every boid is updated before any are drawn
+    if (useDoubleBuffering)
+    {
+        // each boid only writes itself, so they can be split across threads once they only read last frame's state
+        auto updateRange = [&](unsigned int begin, unsigned int end)
+        {
+            for (unsigned int i = begin; i < end; i++)
+                UpdateBoid(g_Boids[i], t);
+        };
+        if (Boid::GetDoubleBuffered())
+            g_JobSystem.ParallelFor((unsigned int)g_Boids.size(), updateRange);
         else
+            updateRange(0, (unsigned int)g_Boids.size());
+    }
+
+	for(unsigned int i=0; i< g_Boids.size(); i++)
+	{ 
+        if (!useDoubleBuffering)
+            UpdateBoid(g_Boids[i], t);
+        
+        // the dead are left where they are for RemoveDeadBoids, so the boid after one isn't skipped
+        if(g_Boids[i]->GetAlive())
         {
-            // remove boid from list
-            delete g_Boids[i];
-            g_Boids.erase(remove(g_Boids.begin(), g_Boids.end(), g_Boids[i]), g_Boids.end());
+            if (useCellAggregates)
+                g_CellAggregates.Move(g_Boids[i]);
 
-            // output number of boids left
-            Debug::Print((int)g_Boids.size());
+            if (draw)
+                DrawBoid(i);
         }
 	}
+}
 
-    for (unsigned int i = 0; i < g_Predators.size(); i++)
+//--------------------------------------------------------------------------------------
+// Take the boids that died this frame out of g_Boids in one go, once the boids and predators have all moved
+//--------------------------------------------------------------------------------------
+void RemoveDeadBoids()
+{
+    unsigned int dead = Boid::RemoveDead(g_Boids, [](Boid* b)
     {
-        g_Predators[i]->Update(t, &g_Boids);
-        XMMATRIX vp = g_View * g_Projection;
-        Boid* dob = (Boid*)g_Predators[i];
+        if (useCellAggregates)
+            g_CellAggregates.Remove(b);
+        if (Predator* hunter = b->GetTargetedBy())
+            hunter->ReleaseTarget(); // it would be left chasing a deleted boid
+        if (useEntityPool)
+            g_BoidPool.Despawn(b);
+        else
+            delete b;
+    });
+    if (dead == 0)
+        return;
 
-        dob->CheckIsOnScreenAndFix(g_View, g_Projection);
+    // the neighbour lists remember boids by list index, the grid is rebuilt from the new list at the start of the next frame anyway
+    g_NeighbourList.Invalidate();
 
-        setupTransformConstantBufferPredator(i);
-        setupLightingConstantBuffer();
-        setupMaterialConstantBufferPredator(i);
+    // output number of boids left
+    Debug::Print((int)g_Boids.size());
+}
 
-        // Render a cube
-        g_pImmediateContext->VSSetShader(g_pVertexShader, nullptr, 0);
-        g_pImmediateContext->VSSetConstantBuffers(0, 1, &g_pConstantBuffer);
+//--------------------------------------------------------------------------------------
+// Update and draw the boids in g_Population
+//--------------------------------------------------------------------------------------
+void UpdatePopulation(float t)
+{
+    if (useQuantisedPopulation)
+    {
+        UpdateQuantisedPopulation(t);
+        return;
+    }
 
-        g_pImmediateContext->PSSetShader(g_pPixelShader, nullptr, 0);
-        g_pImmediateContext->PSSetConstantBuffers(1, 1, &g_pMaterialConstantBuffer);
-        g_pImmediateContext->PSSetConstantBuffers(2, 1, &g_pLightConstantBuffer);
+    g_Population.Wrap();
 
-        g_pImmediateContext->PSSetShaderResources(0, 1, g_Predators[i]->getTextureResourceView());
-        g_pImmediateContext->PSSetSamplers(0, 1, g_Predators[i]->getTextureSamplerState());
+    // keep boids that are close in the world close in the arrays
+    static unsigned int frameCount = 0;
+    if (useMortonOrder && frameCount % MORTON_SORT_INTERVAL == 0)
+    {
+        g_Population.SortMorton();
+    }
+    frameCount++;
 
-        // draw 
-        g_Predators[i]->draw(g_pImmediateContext);
+    g_BoidGrid.Build(g_Population.GetX(), g_Population.GetY(), g_Population.GetCount(), g_Population.GetZ());
+    if (useSteeringKernel)
+        g_Population.UpdateBatched(t, &g_BoidGrid, &g_PredatorGrid, SteeringKernel::Best());
+    else
+        g_Population.Update(t, &g_BoidGrid, &g_Predators, &g_PredatorGrid);
+
+    // every boid uses the same mesh, so the shaders and texture only need setting once
+    setupLightingConstantBuffer();
+    setupMaterialConstantBufferPopulation();
+    g_pImmediateContext->VSSetShader(g_pVertexShader, nullptr, 0);
+    g_pImmediateContext->VSSetConstantBuffers(0, 1, &g_pConstantBuffer);
+
+    g_pImmediateContext->PSSetShader(g_pPixelShader, nullptr, 0);
+    g_pImmediateContext->PSSetConstantBuffers(1, 1, &g_pMaterialConstantBuffer);
+    g_pImmediateContext->PSSetConstantBuffers(2, 1, &g_pLightConstantBuffer);
+
+    g_pImmediateContext->PSSetShaderResources(0, 1, g_PopulationMesh.getTextureResourceView());
+    g_pImmediateContext->PSSetSamplers(0, 1, g_PopulationMesh.getTextureSamplerState());
+
+    for (unsigned int i = 0; i < g_Population.GetCount(); i++)
+    {
+        if (!g_Population.GetAlive(i))
+            continue;
+
+        setupTransformConstantBufferPopulation(g_Population.GetPosition(i), t);
+        g_PopulationMesh.draw(g_pImmediateContext);
     }
 
-    // Present our back buffer to our front buffer
-    g_pSwapChain->Present( 0, 0 );
+    // the dead are taken out in one go once everyone has moved
+    if (g_Population.RemoveDead() > 0)
+    {
+        // output number of boids left
+        Debug::Print((int)g_Population.GetCount());
+    }
+}
+
+//--------------------------------------------------------------------------------------
+// Update and draw the boids in g_QuantisedPopulation
+//--------------------------------------------------------------------------------------
+void UpdateQuantisedPopulation(float t)
+{
+    // no grid to build, the quantised flock is kept in cell order and the dead are dropped as it is re-sorted
+    unsigned int count = g_QuantisedPopulation.GetCount();
+    g_QuantisedPopulation.Update(t, &g_PredatorGrid, SteeringKernel::Best());
+
+    setupLightingConstantBuffer();
+    setupMaterialConstantBufferPopulation();
+    g_pImmediateContext->VSSetShader(g_pVertexShader, nullptr, 0);
+    g_pImmediateContext->VSSetConstantBuffers(0, 1, &g_pConstantBuffer);
+
+    g_pImmediateContext->PSSetShader(g_pPixelShader, nullptr, 0);
+    g_pImmediateContext->PSSetConstantBuffers(1, 1, &g_pMaterialConstantBuffer);
+    g_pImmediateContext->PSSetConstantBuffers(2, 1, &g_pLightConstantBuffer);
+
+    g_pImmediateContext->PSSetShaderResources(0, 1, g_PopulationMesh.getTextureResourceView());
+    g_pImmediateContext->PSSetSamplers(0, 1, g_PopulationMesh.getTextureSamplerState());
+
+    for (unsigned int i = 0; i < g_QuantisedPopulation.GetCount(); i++)
+    {
+        setupTransformConstantBufferPopulation(g_QuantisedPopulation.GetPosition(i), t);
+        g_PopulationMesh.draw(g_pImmediateContext);
+    }
+
+    if (g_QuantisedPopulation.GetCount() < count)
+    {
+        // output number of boids left
+        Debug::Print((int)g_QuantisedPopulation.GetCount());
+    }
 }
 
+//--------------------------------------------------------------------------------------
+// Pick the instruction set for the simd kernels, the best the cpu has unless "-simd=<level>"
+// is on the command line or BOIDS_SIMD is set, e.g. to benchmark one path against another
+//--------------------------------------------------------------------------------------
+void ReadSimdOverride(LPCWSTR cmdLine)
+{
+    char name[32] = { 0 };
+    const wchar_t* arg = wcsstr(cmdLine, L"-simd=");
+    if (arg != nullptr)
+    {
+        arg += wcslen(L"-simd=");
+        for (unsigned int i = 0; i < sizeof(name) - 1 && arg[i] != L'\0' && arg[i] != L' '; i++)
+            name[i] = (char)arg[i];
+    }
+    else if (GetEnvironmentVariableA("BOIDS_SIMD", name, sizeof(name)) >= sizeof(name))
+    {
+        name[0] = '\0';
+    }
+
+    if (name[0] != '\0' && !CpuFeatures::ForceLevel(name))
+        Debug::Print(string("simd level not known or not supported on this cpu: ") + name);
+
+    Debug::Print(string("simd kernels: ") + CpuFeatures::Name(CpuFeatures::Level()));
+}
 
 void OutputValue(float f, string name)
 {
@@ -33,6 +33,17 @@ using namespace std;
 
 typedef vector<Boid*> vecBoid;
 
+// boids held by something else (a vecBoid or a FrameArena), for functions that only read them
+struct BoidSpan
+{
+	Boid* const* data;
+	size_t count;
+
+	Boid* const* begin() const { return data; }
+	Boid* const* end() const { return data + count; }
+	size_t size() const { return count; }
+};
+
 struct ConstantBuffer
 {
 	XMMATRIX mWorld;